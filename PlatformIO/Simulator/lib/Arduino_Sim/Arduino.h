@@ -0,0 +1,35 @@
+/**
+ * Arduino.h
+ *
+ * Host (Linux) stand-in for the Arduino core, see Arduino_Sim.h
+ *
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino_Sim.h"
+#include "HardwareSerial.h"
+
+#define HIGH            0x1
+#define LOW             0x0
+
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+#endif
@@ -0,0 +1,299 @@
+/**
+ * Arduino_Sim.cpp
+ *
+ * Host (Linux) stand-in for the Arduino core, see Arduino_Sim.h
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "HardwareSerial.h"
+
+#define SIM_NUM_OF_PINS     32
+
+/* I2C byte is 8 data bits + ACK, add START/STOP per segment */
+#define I2C_BITS(bytes)     ((uint32_t)(bytes) * 9 + 2)
+
+static uint64_t sim_clock_ns = 0;
+static uint64_t sim_analog_read_ns = 0;
+
+static struct {
+    sim_pin_read_t read;
+    void * ctx;
+    uint8_t level;
+} sim_pins[SIM_NUM_OF_PINS];
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Virtual clock
+///////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t sim_time_ns(void)
+{
+    return sim_clock_ns;
+}
+
+void sim_advance_ns(uint64_t ns)
+{
+    sim_clock_ns += ns;
+}
+
+void sim_reset_time(void)
+{
+    sim_clock_ns = 0;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(sim_clock_ns / 1000000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)(sim_clock_ns / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    sim_advance_ns((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    sim_advance_ns((uint64_t)us * 1000);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// GPIO
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void sim_attach_pin(uint8_t pin, sim_pin_read_t read, void * ctx)
+{
+    if (pin < SIM_NUM_OF_PINS) {
+        sim_pins[pin].read = read;
+        sim_pins[pin].ctx = ctx;
+    }
+}
+
+void sim_detach_pin(uint8_t pin)
+{
+    if (pin < SIM_NUM_OF_PINS) {
+        sim_pins[pin].read = 0;
+        sim_pins[pin].ctx = 0;
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < SIM_NUM_OF_PINS && mode == INPUT_PULLUP && sim_pins[pin].read == 0) {
+        sim_pins[pin].level = HIGH;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < SIM_NUM_OF_PINS) {
+        sim_pins[pin].level = val ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin < SIM_NUM_OF_PINS) {
+        if (sim_pins[pin].read) {
+            return sim_pins[pin].read(sim_pins[pin].ctx) ? HIGH : LOW;
+        }
+        return sim_pins[pin].level;
+    }
+    return LOW;
+}
+
+void sim_set_analog_read_ns(uint64_t ns)
+{
+    sim_analog_read_ns = ns;
+}
+
+int analogRead(uint8_t pin)
+{
+    sim_advance_ns(sim_analog_read_ns);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TwoWire
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TwoWire::TwoWire():
+    frequency(100000),
+    tx_address(0),
+    tx_length(0),
+    rx_length(0),
+    rx_index(0),
+    observer(0),
+    observer_ctx(0),
+    fault_nack_every(0),
+    fault_stuck_every(0),
+    fault_count(0),
+    bus_held(false),
+    hold_until_ns(0)
+{
+    memset(slaves, 0, sizeof(slaves));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency)
+{
+    if (frequency) {
+        this->frequency = frequency;
+    }
+    bus_held = false;
+    return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency)
+{
+    if (frequency) {
+        this->frequency = frequency;
+    }
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    tx_address = address;
+    tx_length = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (tx_length < sizeof(tx_buffer)) {
+        tx_buffer[tx_length++] = data;
+        return 1;
+    }
+    return 0;
+}
+
+size_t TwoWire::write(const uint8_t * data, size_t count)
+{
+    size_t n = 0;
+    while (n < count && write(data[n])) {
+        n++;
+    }
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    TwoWire_slave_c * slave = find(tx_address);
+    uint64_t start = sim_time_ns();
+    bool ack = !fault() && slave && slave->i2c_slave_write(tx_buffer, tx_length);
+    account(1 + tx_length, ack);
+    if (observer) {
+        observer(observer_ctx, tx_address, false, tx_buffer, tx_length, ack, start, sim_time_ns());
+    }
+    tx_length = 0;
+    return ack ? 0 : 2;     /* 2: NACK on address, same code as the Arduino core */
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t count, bool sendStop)
+{
+    TwoWire_slave_c * slave = find(address);
+    if (count > sizeof(rx_buffer)) {
+        count = sizeof(rx_buffer);
+    }
+    uint64_t start = sim_time_ns();
+    bool ack = !fault() && slave && slave->i2c_slave_read(rx_buffer, count);
+    account(1 + (ack ? count : 0), ack);
+    rx_index = 0;
+    rx_length = ack ? count : 0;
+    if (observer) {
+        observer(observer_ctx, address, true, rx_buffer, rx_length, ack, start, sim_time_ns());
+    }
+    return rx_length;
+}
+
+int TwoWire::available(void)
+{
+    return rx_length - rx_index;
+}
+
+int TwoWire::read(void)
+{
+    return rx_index < rx_length ? rx_buffer[rx_index++] : -1;
+}
+
+bool TwoWire::attach(uint8_t address, TwoWire_slave_c * slave)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave == 0 || slaves[i].address == address) {
+            slaves[i].address = address;
+            slaves[i].slave = slave;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TwoWire::detach(uint8_t address)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave && slaves[i].address == address) {
+            slaves[i].slave = 0;
+        }
+    }
+}
+
+void TwoWire::set_faults(uint32_t nack_every, uint32_t stuck_every)
+{
+    fault_nack_every = nack_every;
+    fault_stuck_every = stuck_every;
+    fault_count = 0;
+    bus_held = false;
+    hold_until_ns = 0;
+}
+
+void TwoWire::hold(uint32_t ms)
+{
+    hold_until_ns = sim_time_ns() + (uint64_t)ms * 1000000;
+    stats.stuck++;
+}
+
+/* The failing transaction does not reach the slave */
+bool TwoWire::fault(void)
+{
+    fault_count++;
+    if (fault_stuck_every && fault_count % fault_stuck_every == 0 && !bus_held) {
+        bus_held = true;
+        stats.stuck++;
+    }
+    return bus_held || sim_time_ns() < hold_until_ns || (fault_nack_every && fault_count % fault_nack_every == 0);
+}
+
+void TwoWire::reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+TwoWire_slave_c * TwoWire::find(uint8_t address)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave && slaves[i].address == address) {
+            return slaves[i].slave;
+        }
+    }
+    return 0;
+}
+
+void TwoWire::account(uint8_t count, bool ack)
+{
+    uint64_t t = (uint64_t)I2C_BITS(count) * 1000000000 / frequency;
+    stats.transactions++;
+    stats.bytes += count;
+    stats.bus_time_ns += t;
+    if (!ack) {
+        stats.nacks++;
+    }
+    sim_advance_ns(t);
+}
@@ -0,0 +1,28 @@
+/**
+ * Arduino_Sim.h
+ *
+ * Host (Linux) stand-in for the small part of the Arduino core used by the PD library.
+ * Time is virtual: millis()/micros() return the simulated clock and delay() advances it,
+ * so a simulated negotiation runs as fast as the host can execute it.
+ *
+ */
+
+#ifndef ARDUINO_SIM_H
+#define ARDUINO_SIM_H
+
+#include <stdint.h>
+
+/* Virtual clock in nanoseconds since simulation start */
+uint64_t sim_time_ns(void);
+void sim_advance_ns(uint64_t ns);
+void sim_reset_time(void);
+
+/* Conversion time every analogRead() takes from the virtual clock, 0 by default */
+void sim_set_analog_read_ns(uint64_t ns);
+
+/* Input pins can be wired to a simulated device, e.g. FUSB302 INT_N */
+typedef int (*sim_pin_read_t)(void * ctx);
+void sim_attach_pin(uint8_t pin, sim_pin_read_t read, void * ctx);
+void sim_detach_pin(uint8_t pin);
+
+#endif
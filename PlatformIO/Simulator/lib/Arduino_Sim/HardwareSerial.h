@@ -0,0 +1,44 @@
+/**
+ * HardwareSerial.h
+ *
+ * Host (Linux) stand-in for the Arduino serial port, output goes to stdout
+ * or to the stream set with sim_set_output(), NULL to discard
+ *
+ */
+
+#ifndef HARDWARESERIAL_H
+#define HARDWARESERIAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "WString.h"
+
+class HardwareSerial
+{
+    public:
+        HardwareSerial() : out(stdout) {}
+        void begin(unsigned long baud) {}
+        size_t print(const char * s) { return out && fputs(s, out) >= 0 ? strlen(s) : 0; }
+        size_t print(const String & s) { return print(s.c_str()); }
+        size_t print(int value) { return print(String(value)); }
+        size_t print(unsigned int value) { return print(String(value)); }
+        size_t print(long value) { return print(String(value)); }
+        size_t print(unsigned long value) { return print(String(value)); }
+        size_t print(double value, int digits = 2) { return print(String(value, digits)); }
+        template <typename T> size_t println(T value) { return print(value) + print("\n"); }
+        size_t println(void) { return print("\n"); }
+        size_t write(const char * s) { return print(s); }
+        int availableForWrite(void) { return 256; }
+        operator bool() { return true; }
+        // Simulation
+        void sim_set_output(FILE * f) { out = f; }
+
+    protected:
+        FILE * out;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * WString.h
+ *
+ * Host (Linux) stand-in for the Arduino String class, the subset used by the firmware
+ *
+ */
+
+#ifndef WSTRING_H
+#define WSTRING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+class String
+{
+    public:
+        String(const char * s = "") : s(s ? s : "") {}
+        String(const std::string & s) : s(s) {}
+        explicit String(int value) : s(std::to_string(value)) {}
+        explicit String(unsigned int value) : s(std::to_string(value)) {}
+        explicit String(long value) : s(std::to_string(value)) {}
+        explicit String(unsigned long value) : s(std::to_string(value)) {}
+        explicit String(double value, unsigned int decimals = 2)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+            s = buf;
+        }
+        const char * c_str(void) const { return s.c_str(); }
+        unsigned int length(void) const { return s.length(); }
+        float toFloat(void) const { return (float)atof(s.c_str()); }
+        long toInt(void) const { return atol(s.c_str()); }
+        bool operator==(const String & other) const { return s == other.s; }
+        bool operator==(const char * other) const { return s == other; }
+        bool operator!=(const String & other) const { return s != other.s; }
+        bool operator!=(const char * other) const { return s != other; }
+        String operator+(const String & other) const { return String(s + other.s); }
+
+    protected:
+        std::string s;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * Wire.h
+ *
+ * Host (Linux) stand-in for the Arduino I2C master.
+ * Transactions are routed to simulated slaves attached with TwoWire::attach(). Every
+ * transaction advances the virtual clock by its bus time at the configured SCL rate,
+ * so I2C cost shows up in simulated latency the same way it does on the board.
+ *
+ * Bus faults can be injected with set_faults(), counted in transactions so a run is reproducible.
+ * A held bus fails every transaction until end() and begin(), which stand for the bus clear of
+ * the I2C transport. hold() keeps it held for a time, as a slave holding SDA, a bus clear does
+ * not free it earlier.
+ *
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WIRE_SIM_MAX_SLAVES     4
+#define WIRE_SIM_BUFFER_SIZE    128
+
+/* Simulated I2C slave, one bus transaction per call, data[0] of a write is the register pointer */
+class TwoWire_slave_c
+{
+    public:
+        virtual ~TwoWire_slave_c() {}
+        virtual bool i2c_slave_write(const uint8_t * data, uint8_t count) = 0;
+        virtual bool i2c_slave_read(uint8_t * data, uint8_t count) = 0;
+};
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;         /* Bytes on the bus, including address bytes */
+    uint32_t nacks;
+    uint32_t stuck;         /* Times the bus was left held by set_faults() or hold() */
+    uint64_t bus_time_ns;
+} TwoWire_stats_t;
+
+/* Called after every transaction with what was written or read, times in simulation ns */
+typedef void (*TwoWire_observer_t)(void * ctx, uint8_t address, bool read, const uint8_t * data, uint8_t count,
+    bool ack, uint64_t start_ns, uint64_t end_ns);
+
+class TwoWire
+{
+    public:
+        TwoWire();
+        bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+        void end(void) {}
+        bool setClock(uint32_t frequency);
+        uint32_t getClock(void) { return frequency; }
+        void beginTransmission(uint8_t address);
+        size_t write(uint8_t data);
+        size_t write(const uint8_t * data, size_t count);
+        uint8_t endTransmission(bool sendStop = true);
+        uint8_t requestFrom(uint8_t address, uint8_t count, bool sendStop = true);
+        int available(void);
+        int read(void);
+        // Simulation
+        bool attach(uint8_t address, TwoWire_slave_c * slave);
+        void detach(uint8_t address);
+        const TwoWire_stats_t & get_stats(void) { return stats; }
+        void reset_stats(void);
+        void set_observer(TwoWire_observer_t observer, void * ctx) { this->observer = observer; observer_ctx = ctx; }
+        // Every nack_every-th transaction is not acknowledged, every stuck_every-th leaves the bus
+        // held until the next begin(). 0 to disable, the transaction count restarts
+        void set_faults(uint32_t nack_every, uint32_t stuck_every);
+        // Every transaction fails for ms of simulation time from now, cleared by set_faults()
+        void hold(uint32_t ms);
+
+    protected:
+        TwoWire_slave_c * find(uint8_t address);
+        void account(uint8_t count, bool ack);
+        bool fault(void);
+        struct {
+            uint8_t address;
+            TwoWire_slave_c * slave;
+        } slaves[WIRE_SIM_MAX_SLAVES];
+        uint32_t frequency;
+        uint8_t tx_address;
+        uint8_t tx_buffer[WIRE_SIM_BUFFER_SIZE];
+        uint8_t tx_length;
+        uint8_t rx_buffer[WIRE_SIM_BUFFER_SIZE];
+        uint8_t rx_length;
+        uint8_t rx_index;
+        TwoWire_stats_t stats;
+        TwoWire_observer_t observer;
+        void * observer_ctx;
+        uint32_t fault_nack_every;
+        uint32_t fault_stuck_every;
+        uint32_t fault_count;
+        bool bus_held;
+        uint64_t hold_until_ns;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,599 @@
+/**
+ * FUSB302_Sim.cpp
+ *
+ * Register model of the FUSB302 for host simulation of the PD library, see FUSB302_Sim.h
+ *
+ * Reference: FUSB302B datasheet, Rev. 5 - Register Definitions
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <Arduino_Sim.h>
+#include "FUSB302_Sim.h"
+
+/* Switches0 : 02h */
+#define PDWN2           (0x01 << 1)
+#define PDWN1           (0x01 << 0)
+#define MEAS_CC2        (0x01 << 3)
+#define MEAS_CC1        (0x01 << 2)
+
+/* Switches1 : 03h */
+#define AUTO_CRC        (0x01 << 2)
+#define TXCC2           (0x01 << 1)
+#define TXCC1           (0x01 << 0)
+
+/* Measure : 04h */
+#define MEAS_VBUS       (0x01 << 6)
+#define MDAC_MASK       (0x3F << 0)
+
+/* Control0 : 06h */
+#define TX_FLUSH        (0x01 << 6)
+#define INT_MASK        (0x01 << 5)
+#define TX_START        (0x01 << 0)
+
+/* Control1 : 07h */
+#define RX_FLUSH        (0x01 << 2)
+
+/* Control2 : 08h */
+#define MODE_MASK       (0x03 << 1)
+#define MODE_UFP        (0x02 << 1)
+#define TOGGLE          (0x01 << 0)
+
+/* Control3 : 09h */
+#define SEND_HARDRESET  (0x01 << 6)
+#define N_RETRIES(r)    (((r) >> 1) & 0x03)
+#define AUTO_RETRY      (0x01 << 0)
+
+/* Power : 0Bh */
+#define PWR_INT_OSC     (0x01 << 3)
+#define PWR_MEASURE     (0x01 << 2)
+#define PWR_RECEIVER    (0x01 << 1)
+#define PWR_BANDGAP     (0x01 << 0)
+
+/* Reset : 0Ch */
+#define PD_RESET        (0x01 << 1)
+#define SW_RES          (0x01 << 0)
+
+/* Status0a : 3Ch */
+#define SOFTFAIL        (0x01 << 5)
+#define RETRYFAIL       (0x01 << 4)
+#define SOFTRST         (0x01 << 1)
+#define HARDRST         (0x01 << 0)
+
+/* Status1a : 3Dh */
+#define TOGSS_MASK      (0x07 << 3)
+#define TOGSS_SNK1      (0x05 << 3)
+#define TOGSS_SNK2      (0x06 << 3)
+#define RXSOP           (0x01 << 0)
+
+/* Interrupta : 3Eh */
+#define I_TOGDONE       (0x01 << 6)
+#define I_RETRYFAIL     (0x01 << 4)
+#define I_HARDSENT      (0x01 << 3)
+#define I_TXSENT        (0x01 << 2)
+#define I_HARDRST       (0x01 << 0)
+
+/* Interruptb : 3Fh */
+#define I_GCRCSENT      (0x01 << 0)
+
+/* Status0 : 40h */
+#define VBUSOK          (0x01 << 7)
+#define COMP            (0x01 << 5)
+#define BC_LVL_MASK     (0x03 << 0)
+
+/* Status1 : 41h */
+#define RX_EMPTY        (0x01 << 5)
+#define RX_FULL         (0x01 << 4)
+#define TX_EMPTY        (0x01 << 3)
+#define TX_FULL         (0x01 << 2)
+
+/* Interrupt : 42h */
+#define I_VBUSOK        (0x01 << 7)
+#define I_COMP_CHNG     (0x01 << 5)
+#define I_CRC_CHK       (0x01 << 4)
+#define I_BC_LVL        (0x01 << 0)
+
+#define ADDRESS_DEVICE_ID   0x01
+#define ADDRESS_SWITCHES0   0x02
+#define ADDRESS_SWITCHES1   0x03
+#define ADDRESS_MEASURE     0x04
+#define ADDRESS_SLICE       0x05
+#define ADDRESS_CONTROL0    0x06
+#define ADDRESS_CONTROL1    0x07
+#define ADDRESS_CONTROL2    0x08
+#define ADDRESS_CONTROL3    0x09
+#define ADDRESS_MASK        0x0A
+#define ADDRESS_POWER       0x0B
+#define ADDRESS_RESET       0x0C
+#define ADDRESS_OCPREG      0x0D
+#define ADDRESS_MASKA       0x0E
+#define ADDRESS_MASKB       0x0F
+#define ADDRESS_CONTROL4    0x10
+#define ADDRESS_STATUS0A    0x3C
+#define ADDRESS_STATUS1A    0x3D
+#define ADDRESS_INTERRUPTA  0x3E
+#define ADDRESS_INTERRUPTB  0x3F
+#define ADDRESS_STATUS0     0x40
+#define ADDRESS_STATUS1     0x41
+#define ADDRESS_INTERRUPT   0x42
+#define ADDRESS_FIFOS       0x43
+
+#define TX_TOKEN_TXON       0xA1
+#define TX_TOKEN_PACKSYM    0x80
+#define RX_TOKEN_SOP        0xE0
+
+#define VBUSOK_THRESHOLD_MV 4000
+
+/* CC voltage across Rd (5.1k) for each Rp current source, 0: no Rp */
+static const uint16_t rp_rd_mv[] = {0, 408, 918, 1683};
+
+static uint32_t crc32(const uint8_t * data, uint8_t count)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (count--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FUSB302_Sim_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FUSB302_Sim_c::FUSB302_Sim_c(uint8_t device_id):
+    partner(0),
+    device_id(device_id),
+    vbus_mv(0),
+    tx_time_ns(0)
+{
+    rp[0] = FUSB302_SIM_RP_OPEN;
+    rp[1] = FUSB302_SIM_RP_OPEN;
+    reset();
+    reset_stats();
+}
+
+void FUSB302_Sim_c::reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[ADDRESS_DEVICE_ID] = device_id;
+    regs[ADDRESS_SWITCHES0] = PDWN1 | PDWN2;
+    regs[ADDRESS_SWITCHES1] = 0x20;
+    regs[ADDRESS_MEASURE]   = 0x31;
+    regs[ADDRESS_SLICE]     = 0x60;
+    regs[ADDRESS_CONTROL0]  = 0x24;
+    regs[ADDRESS_CONTROL2]  = 0x02;
+    regs[ADDRESS_CONTROL3]  = 0x06;
+    regs[ADDRESS_POWER]     = PWR_BANDGAP;
+    regs[ADDRESS_OCPREG]    = 0x0F;
+    pointer = 0;
+    rx_read = 0;
+    rx_count = 0;
+    tx_count = 0;
+    tx_data_left = 0;
+    tx_on_line = 0;
+    status0_last = status0();
+}
+
+void FUSB302_Sim_c::reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool FUSB302_Sim_c::reg_read(uint8_t address, uint8_t * data, uint8_t count)
+{
+    if (address >= FUSB302_SIM_NUM_OF_REG) {
+        return false;
+    }
+    tx_poll();
+    stats.reg_reads++;
+    stats.reads[address]++;
+    stats.bytes_read += count;
+    for (uint8_t i = 0; i < count; i++) {
+        data[i] = read_reg(address);
+        if (address != ADDRESS_FIFOS) {
+            address++;  /* FIFO is the only register without auto-increment */
+        }
+    }
+    pointer = address;
+    return true;
+}
+
+bool FUSB302_Sim_c::reg_write(uint8_t address, const uint8_t * data, uint8_t count)
+{
+    if (address >= FUSB302_SIM_NUM_OF_REG) {
+        return false;
+    }
+    tx_poll();
+    stats.reg_writes++;
+    stats.writes[address]++;
+    stats.bytes_written += count;
+    for (uint8_t i = 0; i < count; i++) {
+        write_reg(address, data[i]);
+        if (address != ADDRESS_FIFOS) {
+            address++;
+        }
+    }
+    pointer = address;
+    update_status();
+    return true;
+}
+
+bool FUSB302_Sim_c::i2c_slave_write(const uint8_t * data, uint8_t count)
+{
+    if (count == 0) {
+        return true;
+    }
+    if (count == 1) {   /* Register pointer only, read follows */
+        pointer = data[0];
+        return pointer < FUSB302_SIM_NUM_OF_REG;
+    }
+    return reg_write(data[0], data + 1, count - 1);
+}
+
+bool FUSB302_Sim_c::i2c_slave_read(uint8_t * data, uint8_t count)
+{
+    return reg_read(pointer, data, count);
+}
+
+uint8_t FUSB302_Sim_c::read_reg(uint8_t address)
+{
+    uint8_t value;
+    switch (address) {
+    case ADDRESS_RESET:
+        return 0;
+    case ADDRESS_INTERRUPTA:
+    case ADDRESS_INTERRUPTB:
+    case ADDRESS_INTERRUPT:
+        value = regs[address];
+        regs[address] = 0;  /* Clear on read */
+        return value;
+    case ADDRESS_STATUS0:
+        return status0();
+    case ADDRESS_STATUS1:
+        value = 0;
+        value |= rx_count == 0 ? RX_EMPTY : 0;
+        value |= rx_count == FUSB302_SIM_RX_FIFO_SIZE ? RX_FULL : 0;
+        value |= tx_count == 0 ? TX_EMPTY : 0;
+        value |= tx_count == FUSB302_SIM_TX_FIFO_SIZE ? TX_FULL : 0;
+        return value;
+    case ADDRESS_FIFOS:
+        if (rx_count == 0) {
+            return 0;
+        }
+        value = rx_fifo[rx_read];
+        rx_read = (rx_read + 1) % FUSB302_SIM_RX_FIFO_SIZE;
+        if (--rx_count == 0) {
+            regs[ADDRESS_STATUS1A] &= ~RXSOP;
+        }
+        return value;
+    default:
+        return address < FUSB302_SIM_NUM_OF_REG ? regs[address] : 0;
+    }
+}
+
+void FUSB302_Sim_c::write_reg(uint8_t address, uint8_t value)
+{
+    switch (address) {
+    case ADDRESS_SWITCHES0:
+    case ADDRESS_SWITCHES1:
+    case ADDRESS_MEASURE:
+    case ADDRESS_SLICE:
+    case ADDRESS_MASK:
+    case ADDRESS_POWER:
+    case ADDRESS_OCPREG:
+    case ADDRESS_MASKA:
+    case ADDRESS_MASKB:
+    case ADDRESS_CONTROL4:
+        regs[address] = value;
+        break;
+    case ADDRESS_CONTROL0:
+        regs[address] = value & ~(TX_FLUSH | TX_START);
+        if (value & TX_FLUSH) {
+            tx_count = 0;
+            tx_data_left = 0;
+        }
+        if (value & TX_START) {
+            transmit();
+        }
+        break;
+    case ADDRESS_CONTROL1:
+        regs[address] = value & ~RX_FLUSH;
+        if (value & RX_FLUSH) {
+            rx_count = 0;
+            regs[ADDRESS_STATUS1A] &= ~RXSOP;
+        }
+        break;
+    case ADDRESS_CONTROL2:
+        if ((value ^ regs[address]) & TOGGLE) {
+            regs[ADDRESS_STATUS1A] &= ~TOGSS_MASK;  /* Toggle restarted or stopped */
+        }
+        regs[address] = value;
+        break;
+    case ADDRESS_CONTROL3:
+        regs[address] = value & ~SEND_HARDRESET;
+        if (value & SEND_HARDRESET) {
+            tx_hard_reset();
+        }
+        break;
+    case ADDRESS_RESET:
+        if (value & SW_RES) {
+            reset();
+        } else if (value & PD_RESET) {
+            pd_reset();
+        }
+        break;
+    case ADDRESS_FIFOS:
+        if (tx_count < FUSB302_SIM_TX_FIFO_SIZE) {
+            tx_fifo[tx_count++] = value;
+        }
+        if (tx_data_left) {
+            tx_data_left--;
+        } else if ((value & 0xE0) == TX_TOKEN_PACKSYM) {
+            tx_data_left = value & 0x1F;
+        } else if (value == TX_TOKEN_TXON) {
+            transmit();
+        }
+        break;
+    default:
+        break;  /* Read only */
+    }
+}
+
+uint16_t FUSB302_Sim_c::cc_mv(uint8_t cc)
+{
+    uint8_t pdwn = cc == 0 ? PDWN1 : PDWN2;
+    if (rp[cc] == FUSB302_SIM_RP_OPEN) {
+        return 0;
+    }
+    return (regs[ADDRESS_SWITCHES0] & pdwn) ? rp_rd_mv[rp[cc]] : 3300;
+}
+
+uint8_t FUSB302_Sim_c::status0(void)
+{
+    uint8_t value = 0, mdac = regs[ADDRESS_MEASURE] & MDAC_MASK;
+    uint16_t mv = 0;
+    if ((regs[ADDRESS_POWER] & PWR_BANDGAP) && vbus_mv >= VBUSOK_THRESHOLD_MV) {
+        value |= VBUSOK;
+    }
+    if (regs[ADDRESS_SWITCHES0] & MEAS_CC1) {
+        mv = cc_mv(0);
+    } else if (regs[ADDRESS_SWITCHES0] & MEAS_CC2) {
+        mv = cc_mv(1);
+    }
+    /* BC_LVL comparators: 200mV, 660mV, 1.23V */
+    value |= mv < 200 ? 0 : mv < 660 ? 1 : mv < 1230 ? 2 : 3;
+    /* MDAC comparator, 42mV steps on CC, 420mV steps on VBUS */
+    if (regs[ADDRESS_MEASURE] & MEAS_VBUS) {
+        value |= vbus_mv > (uint32_t)(mdac + 1) * 420 ? COMP : 0;
+    } else {
+        value |= mv > (uint32_t)(mdac + 1) * 42 ? COMP : 0;
+    }
+    return value;
+}
+
+void FUSB302_Sim_c::update_status(void)
+{
+    uint8_t s = status0();
+    uint8_t changed = s ^ status0_last;
+    if (changed & VBUSOK) {
+        regs[ADDRESS_INTERRUPT] |= I_VBUSOK;
+    }
+    if (changed & COMP) {
+        regs[ADDRESS_INTERRUPT] |= I_COMP_CHNG;
+    }
+    if (changed & BC_LVL_MASK) {
+        regs[ADDRESS_INTERRUPT] |= I_BC_LVL;
+    }
+    status0_last = s;
+    toggle();
+}
+
+void FUSB302_Sim_c::toggle(void)
+{
+    /* SNK toggle only, Rp is found at once instead of within a tDRP period, then the toggle
+       logic stops with the result in TOGSS until TOGGLE is written again */
+    uint8_t orientation = get_cc_orientation();
+    if ((regs[ADDRESS_CONTROL2] & TOGGLE) == 0 || (regs[ADDRESS_CONTROL2] & MODE_MASK) != MODE_UFP ||
+        (regs[ADDRESS_POWER] & PWR_INT_OSC) == 0 || (regs[ADDRESS_STATUS1A] & TOGSS_MASK) || orientation == 0) {
+        return;
+    }
+    regs[ADDRESS_STATUS1A] |= orientation == 1 ? TOGSS_SNK1 : TOGSS_SNK2;
+    regs[ADDRESS_INTERRUPTA] |= I_TOGDONE;
+}
+
+uint8_t FUSB302_Sim_c::get_cc_orientation(void)
+{
+    if (rp[0] != FUSB302_SIM_RP_OPEN) {
+        return 1;
+    }
+    if (rp[1] != FUSB302_SIM_RP_OPEN) {
+        return 2;
+    }
+    return 0;
+}
+
+bool FUSB302_Sim_c::receiver_on(uint8_t cc)
+{
+    uint8_t txcc = cc == 1 ? TXCC1 : cc == 2 ? TXCC2 : 0;
+    uint8_t pwr = PWR_RECEIVER | PWR_INT_OSC;
+    return txcc && (regs[ADDRESS_SWITCHES1] & txcc) && (regs[ADDRESS_POWER] & pwr) == pwr;
+}
+
+void FUSB302_Sim_c::set_cc(enum FUSB302_sim_rp_t cc1, enum FUSB302_sim_rp_t cc2)
+{
+    rp[0] = cc1;
+    rp[1] = cc2;
+    update_status();
+}
+
+void FUSB302_Sim_c::set_vbus(uint16_t mv)
+{
+    vbus_mv = mv;
+    update_status();
+}
+
+int FUSB302_Sim_c::get_int_n(void)
+{
+    uint8_t pending;
+    tx_poll();
+    if (regs[ADDRESS_CONTROL0] & INT_MASK) {
+        return 1;
+    }
+    pending = (regs[ADDRESS_INTERRUPT] & ~regs[ADDRESS_MASK]) |
+              (regs[ADDRESS_INTERRUPTA] & ~regs[ADDRESS_MASKA]) |
+              (regs[ADDRESS_INTERRUPTB] & ~regs[ADDRESS_MASKB] & I_GCRCSENT);
+    return pending ? 0 : 1;
+}
+
+void FUSB302_Sim_c::pd_reset(void)
+{
+    rx_count = 0;
+    tx_count = 0;
+    tx_data_left = 0;
+    tx_on_line = 0;
+    regs[ADDRESS_STATUS0A] &= ~(SOFTFAIL | RETRYFAIL | SOFTRST | HARDRST);
+    regs[ADDRESS_STATUS1A] &= ~RXSOP;
+}
+
+bool FUSB302_Sim_c::rx_fifo_push(uint16_t header, const uint32_t * obj)
+{
+    uint8_t buf[2 + 7 * 4 + 4], n = 0;
+    uint8_t num_of_obj = (header >> 12) & 0x7;
+    uint32_t crc;
+    if (rx_count + 1 + 2 + num_of_obj * 4 + 4 > FUSB302_SIM_RX_FIFO_SIZE) {
+        return false;
+    }
+    buf[n++] = header & 0xFF;
+    buf[n++] = header >> 8;
+    for (uint8_t i = 0; i < num_of_obj; i++) {
+        uint32_t d = obj[i];
+        buf[n++] = d & 0xFF; d >>= 8;
+        buf[n++] = d & 0xFF; d >>= 8;
+        buf[n++] = d & 0xFF; d >>= 8;
+        buf[n++] = d & 0xFF;
+    }
+    crc = crc32(buf, n);
+    buf[n++] = crc & 0xFF; crc >>= 8;
+    buf[n++] = crc & 0xFF; crc >>= 8;
+    buf[n++] = crc & 0xFF; crc >>= 8;
+    buf[n++] = crc & 0xFF;
+    rx_fifo[(rx_read + rx_count++) % FUSB302_SIM_RX_FIFO_SIZE] = RX_TOKEN_SOP;
+    for (uint8_t i = 0; i < n; i++) {
+        rx_fifo[(rx_read + rx_count++) % FUSB302_SIM_RX_FIFO_SIZE] = buf[i];
+    }
+    regs[ADDRESS_STATUS1A] |= RXSOP;
+    regs[ADDRESS_INTERRUPT] |= I_CRC_CHK;
+    return true;
+}
+
+bool FUSB302_Sim_c::send_message(uint16_t header, const uint32_t * obj)
+{
+    if (!receiver_on(get_cc_orientation()) || !rx_fifo_push(header, obj)) {
+        stats.rx_dropped++;
+        return false;
+    }
+    stats.rx_messages++;
+    if (regs[ADDRESS_SWITCHES1] & AUTO_CRC) {
+        regs[ADDRESS_INTERRUPTB] |= I_GCRCSENT;
+        return true;
+    }
+    return false;
+}
+
+void FUSB302_Sim_c::send_hard_reset(void)
+{
+    if (!receiver_on(get_cc_orientation())) {
+        return;
+    }
+    stats.hard_reset_received++;
+    rx_count = 0;
+    tx_count = 0;
+    tx_data_left = 0;
+    tx_on_line = 0;
+    regs[ADDRESS_STATUS0A] |= HARDRST;
+    regs[ADDRESS_INTERRUPTA] |= I_HARDRST;
+}
+
+void FUSB302_Sim_c::transmit(void)
+{
+    uint8_t i = 0, n = 0, data[2 + 7 * 4];
+
+    /* Extract the packed symbols, ignore SOP / CRC / EOP tokens */
+    while (i < tx_count) {
+        uint8_t token = tx_fifo[i++];
+        if ((token & 0xE0) == TX_TOKEN_PACKSYM) {
+            for (uint8_t len = token & 0x1F; len && i < tx_count; len--) {
+                if (n < sizeof(data)) {
+                    data[n++] = tx_fifo[i];
+                }
+                i++;
+            }
+        }
+    }
+    tx_count = 0;
+    tx_data_left = 0;
+    if (n < 2) {
+        return;
+    }
+    tx_header = data[0] | ((uint16_t)data[1] << 8);
+    memset(tx_obj, 0, sizeof(tx_obj));
+    for (i = 0; i < ((tx_header >> 12) & 0x7) && 2 + i * 4 + 3 < n; i++) {
+        uint8_t * d = &data[2 + i * 4];
+        tx_obj[i] = d[0] | ((uint32_t)d[1] << 8) | ((uint32_t)d[2] << 16) | ((uint32_t)d[3] << 24);
+    }
+    stats.tx_messages++;
+    tx_on_line = 1;
+    tx_done_ns = sim_time_ns() + tx_time_ns;
+    tx_poll();
+}
+
+void FUSB302_Sim_c::tx_poll(void)
+{
+    if (tx_on_line && sim_time_ns() >= tx_done_ns) {
+        tx_on_line = 0;
+        tx_complete();
+    }
+}
+
+void FUSB302_Sim_c::tx_complete(void)
+{
+    uint8_t attempts = 1 + ((regs[ADDRESS_CONTROL3] & AUTO_RETRY) ? N_RETRIES(regs[ADDRESS_CONTROL3]) : 0);
+    bool ack = false;
+
+    if (partner && receiver_on(get_cc_orientation())) {
+        for (uint8_t i = 0; i < attempts && !ack; i++) {
+            ack = partner->sim_rx_message(tx_header, tx_obj);
+        }
+    }
+    if (ack) {
+        /* GoodCRC from the source is received into the RX FIFO, same MessageID */
+        uint16_t good_crc = 0x0001 |                    /* GoodCRC */
+                            (1 << 5) |                  /* Port Data Role: DFP */
+                            (tx_header & (0x3 << 6)) |  /* Specification Revision */
+                            (1 << 8) |                  /* Port Power Role: Source */
+                            (tx_header & (0x7 << 9));   /* MessageID */
+        rx_fifo_push(good_crc, 0);
+        regs[ADDRESS_INTERRUPTA] |= I_TXSENT;
+    } else {
+        stats.tx_retry_fail++;
+        regs[ADDRESS_STATUS0A] |= RETRYFAIL;
+        regs[ADDRESS_INTERRUPTA] |= I_RETRYFAIL;
+    }
+}
+
+void FUSB302_Sim_c::tx_hard_reset(void)
+{
+    stats.hard_reset_sent++;
+    rx_count = 0;
+    tx_count = 0;
+    tx_data_left = 0;
+    tx_on_line = 0;
+    regs[ADDRESS_INTERRUPTA] |= I_HARDSENT;
+    if (partner && receiver_on(get_cc_orientation())) {
+        partner->sim_rx_hard_reset();
+    }
+}
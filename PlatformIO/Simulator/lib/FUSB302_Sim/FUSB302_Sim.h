@@ -0,0 +1,140 @@
+/**
+ * FUSB302_Sim.h
+ *
+ * Register model of the FUSB302 for host simulation of the PD library.
+ *
+ * Implements the registers the FUSB302_UFP driver touches (DEVICE_ID, SWITCHES0/1, MEASURE,
+ * CONTROL0-3, MASK/MASKA/MASKB, POWER, RESET, STATUS0A..INTERRUPTB, STATUS0/1, INTERRUPT
+ * and FIFOS) with I2C auto-increment, read-to-clear interrupt registers, the SNK toggle logic
+ * (TOGSS, I_TOGDONE) and the INT_N pin.
+ * The CC lines, VBUS and the port partner are driven by the simulation:
+ *  - set_cc() / set_vbus() set the analog state seen by BC_LVL, COMP and VBUSOK
+ *  - send_message() / send_hard_reset() deliver traffic from the partner into the RX FIFO
+ *  - messages the driver transmits are passed to FUSB302_Sim_partner_c, at TX start or after
+ *    set_tx_time() on the virtual clock (Arduino_Sim.h) as on the line
+ *
+ * Bus access is through TwoWire (see Wire.h) or directly with reg_read() / reg_write().
+ *
+ */
+
+#ifndef FUSB302_SIM_H
+#define FUSB302_SIM_H
+
+#include <stdint.h>
+
+#include <Wire.h>
+
+#define FUSB302_SIM_DEVICE_ID       0x92    /* FUSB302B, version B, revision C */
+#define FUSB302_SIM_NUM_OF_REG      0x44
+#define FUSB302_SIM_RX_FIFO_SIZE    80
+#define FUSB302_SIM_TX_FIFO_SIZE    48
+
+enum FUSB302_sim_rp_t {     /* Rp advertised by the source on a CC line */
+    FUSB302_SIM_RP_OPEN = 0,
+    FUSB302_SIM_RP_USB,     /* Default USB power, 80uA */
+    FUSB302_SIM_RP_1A5,     /* 1.5A, 180uA */
+    FUSB302_SIM_RP_3A0      /* 3.0A, 330uA */
+};
+
+typedef struct {
+    uint32_t reg_reads;             /* Read transactions */
+    uint32_t reg_writes;            /* Write transactions */
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t reads[FUSB302_SIM_NUM_OF_REG];     /* Read transactions by start register */
+    uint32_t writes[FUSB302_SIM_NUM_OF_REG];    /* Write transactions by start register */
+    uint32_t tx_messages;
+    uint32_t tx_retry_fail;
+    uint32_t rx_messages;
+    uint32_t rx_dropped;            /* Partner message not received, no GoodCRC */
+    uint32_t hard_reset_sent;
+    uint32_t hard_reset_received;
+} FUSB302_sim_stats_t;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FUSB302_Sim_partner_c, the far end of the CC wire
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FUSB302_Sim_partner_c
+{
+    public:
+        virtual ~FUSB302_Sim_partner_c() {}
+        /* Message transmitted by the FUSB302, return true to answer with GoodCRC.
+           Replies must be queued and sent later, not from inside this call. */
+        virtual bool sim_rx_message(uint16_t header, const uint32_t * obj) = 0;
+        virtual void sim_rx_hard_reset(void) {}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FUSB302_Sim_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FUSB302_Sim_c : public TwoWire_slave_c
+{
+    public:
+        FUSB302_Sim_c(uint8_t device_id = FUSB302_SIM_DEVICE_ID);
+        // Power on reset, all registers to default
+        void reset(void);
+        // Register access, same semantic as one I2C transaction
+        bool reg_read(uint8_t address, uint8_t * data, uint8_t count);
+        bool reg_write(uint8_t address, const uint8_t * data, uint8_t count);
+        uint8_t peek(uint8_t address) { return address < FUSB302_SIM_NUM_OF_REG ? regs[address] : 0; }
+        // TwoWire_slave_c
+        virtual bool i2c_slave_write(const uint8_t * data, uint8_t count);
+        virtual bool i2c_slave_read(uint8_t * data, uint8_t count);
+        // Port state
+        void set_partner(FUSB302_Sim_partner_c * partner) { this->partner = partner; }
+        void set_cc(enum FUSB302_sim_rp_t cc1, enum FUSB302_sim_rp_t cc2);
+        void set_vbus(uint16_t mv);
+        uint16_t get_vbus(void) { return vbus_mv; }
+        uint8_t get_cc_orientation(void);   /* 0: none, 1: CC1, 2: CC2 */
+        // Time from TX start to I_TXSENT / I_RETRYFAIL, 0: done at TX start
+        void set_tx_time(uint32_t us) { tx_time_ns = (uint64_t)us * 1000; }
+        // Partner traffic, return true if FUSB302 answered GoodCRC
+        bool send_message(uint16_t header, const uint32_t * obj);
+        void send_hard_reset(void);
+        // INT_N pin, active low
+        int get_int_n(void);
+        static int int_n_read(void * ctx) { return ((FUSB302_Sim_c *)ctx)->get_int_n(); }
+        // Statistics
+        const FUSB302_sim_stats_t & get_stats(void) { return stats; }
+        void reset_stats(void);
+
+    protected:
+        uint8_t read_reg(uint8_t address);
+        void write_reg(uint8_t address, uint8_t value);
+        uint16_t cc_mv(uint8_t cc);
+        uint8_t status0(void);
+        void update_status(void);
+        void toggle(void);
+        bool receiver_on(uint8_t cc);
+        void pd_reset(void);
+        void transmit(void);
+        void tx_poll(void);
+        void tx_complete(void);
+        void tx_hard_reset(void);
+        bool rx_fifo_push(uint16_t header, const uint32_t * obj);
+
+        FUSB302_Sim_partner_c * partner;
+        uint8_t device_id;
+        uint8_t regs[FUSB302_SIM_NUM_OF_REG];
+        uint8_t pointer;
+        uint8_t status0_last;
+        // Port
+        enum FUSB302_sim_rp_t rp[2];
+        uint16_t vbus_mv;
+        // FIFOs
+        uint8_t rx_fifo[FUSB302_SIM_RX_FIFO_SIZE];
+        uint8_t rx_read;
+        uint8_t rx_count;
+        uint8_t tx_fifo[FUSB302_SIM_TX_FIFO_SIZE];
+        uint8_t tx_count;
+        uint8_t tx_data_left;   /* Payload bytes following a PACKSYM token */
+        // Message on the line
+        uint64_t tx_time_ns;
+        uint64_t tx_done_ns;
+        uint8_t tx_on_line;
+        uint16_t tx_header;
+        uint32_t tx_obj[7];
+        FUSB302_sim_stats_t stats;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * I2C_Sim.cpp
+ *
+ * In-memory asynchronous I2C bus for host simulation, see I2C_Sim.h
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "I2C_Sim.h"
+
+/* I2C byte is 8 data bits + ACK, add START/STOP per segment, as the Wire stand-in */
+#define I2C_BITS(bytes)     ((uint32_t)(bytes) * 9 + 2)
+
+I2C_Sim_c::I2C_Sim_c(uint32_t frequency, bool posted_writes):
+    queue_head(0),
+    queue_count(0),
+    frequency(frequency),
+    bus_free_ns(0),
+    wait_ns(0)
+{
+    memset(slaves, 0, sizeof(slaves));
+    memset(&stats, 0, sizeof(stats));
+    if (posted_writes) {
+        posted_init(posted_txn, PD_UFP_I2C_POSTED);
+    }
+}
+
+bool I2C_Sim_c::attach(uint8_t address, TwoWire_slave_c * slave)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave == 0 || slaves[i].address == address) {
+            slaves[i].address = address;
+            slaves[i].slave = slave;
+            return true;
+        }
+    }
+    return false;
+}
+
+void I2C_Sim_c::detach(uint8_t address)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave && slaves[i].address == address) {
+            slaves[i].slave = 0;
+        }
+    }
+}
+
+TwoWire_slave_c * I2C_Sim_c::find(uint8_t address)
+{
+    for (uint8_t i = 0; i < WIRE_SIM_MAX_SLAVES; i++) {
+        if (slaves[i].slave && slaves[i].address == address) {
+            return slaves[i].slave;
+        }
+    }
+    return 0;
+}
+
+/* Bus time of one transaction, count includes the address byte */
+uint64_t I2C_Sim_c::account(uint8_t count, bool ack)
+{
+    uint64_t t = (uint64_t)I2C_BITS(count) * 1000000000 / frequency;
+    stats.transactions++;
+    stats.bytes += count;
+    stats.bus_time_ns += t;
+    if (!ack) {
+        stats.nacks++;
+    }
+    return t;
+}
+
+FUSB302_ret_t I2C_Sim_c::submit(PD_UFP_i2c_txn_t * txn)
+{
+    TwoWire_slave_c * slave = find(txn->dev_addr);
+    uint64_t now = sim_time_ns(), bus_ns;
+    FUSB302_ret_t ret;
+    poll();
+    if (queue_count >= I2C_SIM_QUEUE) {
+        return FUSB302_BUSY;
+    }
+    if (txn->read) {
+        bool ack = slave && slave->i2c_slave_write(txn->buffer, 1);
+        bus_ns = account(2, ack);
+        if (ack) {
+            ack = slave->i2c_slave_read(txn->data, txn->count);
+            bus_ns += account(1 + (ack ? txn->count : 0), ack);
+        }
+        ret = ack ? FUSB302_SUCCESS : FUSB302_ERR_READ_DEVICE;
+    } else {
+        bool ack = slave && slave->i2c_slave_write(txn->buffer, 1 + txn->count);
+        bus_ns = account(2 + txn->count, ack);
+        ret = ack ? FUSB302_SUCCESS : FUSB302_ERR_WRITE_DEVICE;
+    }
+    bus_free_ns = (bus_free_ns > now ? bus_free_ns : now) + bus_ns;
+    uint8_t i = (queue_head + queue_count++) % I2C_SIM_QUEUE;
+    queue[i].txn = txn;
+    queue[i].ret = ret;
+    queue[i].end_ns = bus_free_ns;
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t I2C_Sim_c::wait(PD_UFP_i2c_txn_t * txn)
+{
+    poll();
+    while (txn->ret == FUSB302_BUSY && queue_count) {
+        uint64_t now = sim_time_ns(), end = queue[queue_head].end_ns;
+        if (end > now) {
+            wait_ns += end - now;
+            sim_advance_ns(end - now);
+        }
+        poll();
+    }
+    return txn->ret;
+}
+
+void I2C_Sim_c::poll(void)
+{
+    uint64_t now = sim_time_ns();
+    while (queue_count && queue[queue_head].end_ns <= now) {
+        PD_UFP_i2c_txn_t * txn = queue[queue_head].txn;
+        FUSB302_ret_t ret = queue[queue_head].ret;
+        queue_head = (queue_head + 1) % I2C_SIM_QUEUE;
+        queue_count--;
+        complete(txn, ret);
+    }
+}
+
+void I2C_Sim_c::reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    wait_ns = 0;
+}
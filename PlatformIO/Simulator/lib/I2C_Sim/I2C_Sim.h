@@ -0,0 +1,65 @@
+/**
+ * I2C_Sim.h
+ *
+ * In-memory asynchronous I2C bus for host simulation, a PD_UFP_I2C_c transport (src/PD_UFP_I2C.h)
+ * for PD_UFP_c::i2c_transport_set().
+ *
+ * Transactions go to the simulated slaves (TwoWire_slave_c, see Wire.h) in submission order.
+ * The slave sees a transaction when it is submitted, the bus is then busy for its time at the
+ * SCL rate from when it is free, in virtual time, and the transaction completes (result and
+ * callback) once the simulation clock has reached its end. wait() advances the clock to that
+ * point, the time the caller is blocked on the bus. A posted write costs the caller nothing,
+ * its bus time overlaps with whatever the simulation does next.
+ *
+ * Accounting is the same as the Wire stand-in: a register read is a pointer write and a read.
+ *
+ */
+
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+#include <stdint.h>
+
+#include <Wire.h>
+#include <PD_UFP_I2C.h>
+
+#define I2C_SIM_QUEUE   8
+
+class I2C_Sim_c : public PD_UFP_I2C_c
+{
+    public:
+        I2C_Sim_c(uint32_t frequency = 100000, bool posted_writes = true);
+        bool attach(uint8_t address, TwoWire_slave_c * slave);
+        void detach(uint8_t address);
+        // PD_UFP_I2C_c
+        virtual FUSB302_ret_t submit(PD_UFP_i2c_txn_t * txn);
+        virtual FUSB302_ret_t wait(PD_UFP_i2c_txn_t * txn);
+        // Complete the transactions the simulation clock has reached the end of
+        void poll(void);
+        // Statistics
+        const TwoWire_stats_t & get_stats(void) { return stats; }
+        uint64_t get_wait_ns(void) { return wait_ns; }     /* Time callers were blocked in wait() */
+        void reset_stats(void);
+
+    protected:
+        TwoWire_slave_c * find(uint8_t address);
+        uint64_t account(uint8_t count, bool ack);
+        struct {
+            uint8_t address;
+            TwoWire_slave_c * slave;
+        } slaves[WIRE_SIM_MAX_SLAVES];
+        struct {
+            PD_UFP_i2c_txn_t * txn;
+            FUSB302_ret_t ret;
+            uint64_t end_ns;
+        } queue[I2C_SIM_QUEUE];
+        uint8_t queue_head;
+        uint8_t queue_count;
+        uint32_t frequency;
+        uint64_t bus_free_ns;
+        TwoWire_stats_t stats;
+        uint64_t wait_ns;
+        PD_UFP_i2c_txn_t posted_txn[PD_UFP_I2C_POSTED];
+};
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * PD_Source_Profiles.cpp
+ *
+ * Library of charger profiles for PD_Source_Sim_c. PDOs follow the published capabilities
+ * of each class of charger, timing is typical for the class, not worst case.
+ *
+ */
+
+#include <string.h>
+
+#include "PD_Source_Profiles.h"
+
+const PD_source_profile_t PD_source_profiles[] = {
+    {   /* Type-C only power bank, no PD */
+        .name = "typec_only_3a", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 0, .pdo = {0},
+        .t_first_src_cap = 0, .t_response = 0, .t_src_transition = 0, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* Phone charger, PD2.0, 5V only */
+        .name = "pd2_5v_3a", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 1,
+        .pdo_count = 1, .pdo = {PDO_FIXED(5000, 3000)},
+        .t_first_src_cap = 150, .t_response = 4, .t_src_transition = 30, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* 20W phone charger, PD3.0, no PPS */
+        .name = "pd3_20w", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 3, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 2220), PDO_FIXED(12000, 1670)},
+        .t_first_src_cap = 120, .t_response = 3, .t_src_transition = 40, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* 65W laptop charger, PD3.0, no PPS */
+        .name = "pd3_65w_laptop", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 4, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 3250)},
+        .t_first_src_cap = 200, .t_response = 5, .t_src_transition = 120, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* 25W phone charger with PPS */
+        .name = "pps_25w", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 4, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 2770), PDO_PPS(3300, 5900, 3000), PDO_PPS(3300, 11000, 2250)},
+        .t_first_src_cap = 100, .t_response = 3, .t_src_transition = 35, .t_pps_timeout = 15000,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* 45W charger with wide range PPS */
+        .name = "pps_45w", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 5, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 2250), PDO_PPS(3300, 21000, 2100)},
+        .t_first_src_cap = 150, .t_response = 4, .t_src_transition = 60, .t_pps_timeout = 15000,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* 100W GaN charger, 5A cable */
+        .name = "pps_100w", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 6, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(12000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 5000), PDO_PPS(3300, 21000, 5000)},
+        .t_first_src_cap = 180, .t_response = 2, .t_src_transition = 50, .t_pps_timeout = 15000,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* Bench supply with variable and battery supply PDOs */
+        .name = "var_bat_bench", .rp = FUSB302_SIM_RP_1A5, .spec_rev = 2,
+        .pdo_count = 3, .pdo = {PDO_FIXED(5000, 1500), PDO_VARIABLE(5000, 12000, 2000), PDO_BATTERY(5000, 20000, 45000)},
+        .t_first_src_cap = 100, .t_response = 5, .t_src_transition = 80, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* Slow charger, late capabilities and long transitions close to the spec limit */
+        .name = "slow_transition", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 4, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 3000)},
+        .t_first_src_cap = 245, .t_response = 25, .t_src_transition = 500, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0,
+    },
+    {   /* Shared port charger, busy, answers Wait twice before Accept */
+        .name = "wait_twice", .rp = FUSB302_SIM_RP_1A5, .spec_rev = 2,
+        .pdo_count = 3, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 2000), PDO_PPS(3300, 11000, 2000)},
+        .t_first_src_cap = 150, .t_response = 5, .t_src_transition = 40, .t_pps_timeout = 15000,
+        .request_reply = PD_SOURCE_REPLY_WAIT, .reply_count = 2,
+    },
+    {   /* USB-C dock, PD controller starts late, silent until the sink sends a Hard Reset */
+        .name = "dock_late_pd", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 4, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 3000)},
+        .t_first_src_cap = 150, .t_response = 4, .t_src_transition = 60, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0, .pd_after_hard_reset = 1,
+    },
+    {   /* Power budget exhausted, rejects every Request */
+        .name = "reject_all", .rp = FUSB302_SIM_RP_USB, .spec_rev = 2,
+        .pdo_count = 2, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 2000)},
+        .t_first_src_cap = 150, .t_response = 5, .t_src_transition = 40, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_REJECT, .reply_count = 255,
+    },
+    {   /* 45W PD3.0 charger with a Manufacturer String of two chunks */
+        .name = "pd3_mfg_chunked", .rp = FUSB302_SIM_RP_3A0, .spec_rev = 2,
+        .pdo_count = 3, .pdo = {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000)},
+        .t_first_src_cap = 150, .t_response = 4, .t_src_transition = 60, .t_pps_timeout = 0,
+        .request_reply = PD_SOURCE_REPLY_ACCEPT, .reply_count = 0, .pd_after_hard_reset = 0,
+        .mfg_string = "Spark Analyzer simulated charger, 2 chunks",
+    },
+};
+
+const uint8_t PD_source_profile_count = sizeof(PD_source_profiles) / sizeof(PD_source_profiles[0]);
+
+const PD_source_profile_t * PD_source_profile_find(const char * name)
+{
+    for (uint8_t i = 0; i < PD_source_profile_count; i++) {
+        if (strcmp(PD_source_profiles[i].name, name) == 0) {
+            return &PD_source_profiles[i];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+/**
+ * PD_Source_Profiles.h
+ *
+ * Library of charger profiles for PD_Source_Sim_c, one per class of charger the Spark
+ * Analyzer is deployed behind.
+ *
+ */
+
+#ifndef PD_SOURCE_PROFILES_H
+#define PD_SOURCE_PROFILES_H
+
+#include <stdint.h>
+
+#include "PD_Source_Sim.h"
+
+extern const PD_source_profile_t PD_source_profiles[];
+extern const uint8_t PD_source_profile_count;
+
+/* Return NULL if no profile has this name */
+const PD_source_profile_t * PD_source_profile_find(const char * name);
+
+#endif
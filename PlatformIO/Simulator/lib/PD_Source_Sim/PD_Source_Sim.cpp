@@ -0,0 +1,544 @@
+/**
+ * PD_Source_Sim.cpp
+ *
+ * Scriptable USB PD source (charger) for host simulation, see PD_Source_Sim.h
+ *
+ * Reference: USB_PD_R3_0 V2.0 20190829 - Chapter 6. Protocol Layer, 7. Power Supply
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <Arduino_Sim.h>
+#include "PD_Source_Sim.h"
+
+#define PD_CONTROL_MSG_TYPE_GOOD_CRC        0x1
+#define PD_CONTROL_MSG_TYPE_ACCEPT          0x3
+#define PD_CONTROL_MSG_TYPE_REJECT          0x4
+#define PD_CONTROL_MSG_TYPE_PS_RDY          0x6
+#define PD_CONTROL_MSG_TYPE_GET_SRC_CAP     0x7
+#define PD_CONTROL_MSG_TYPE_WAIT            0xC
+#define PD_CONTROL_MSG_TYPE_SOFT_RESET      0xD
+#define PD_CONTROL_MSG_TYPE_NOT_SUPPORT     0x10
+#define PD_CONTROL_MSG_TYPE_GET_SRC_CAP_EXT 0x11
+#define PD_CONTROL_MSG_TYPE_GET_STATUS      0x12
+#define PD_CONTROL_MSG_TYPE_GET_PPS_STATUS  0x14
+
+#define PD_DATA_MSG_TYPE_SRC_CAP            0x1
+#define PD_DATA_MSG_TYPE_REQUEST            0x2
+#define PD_DATA_MSG_TYPE_SINK_CAP           0x4
+#define PD_DATA_MSG_TYPE_VENDOR_DEFINED     0xF
+
+#define PD_EXT_MSG_TYPE_SRC_CAP_EXT         0x1
+#define PD_EXT_MSG_TYPE_STATUS              0x2
+#define PD_EXT_MSG_TYPE_GET_MFG_INFO        0x6
+#define PD_EXT_MSG_TYPE_MFG_INFO            0x7
+#define PD_EXT_MSG_TYPE_PPS_STATUS          0xC
+
+#define PD_EXT_CHUNK_SIZE                   26
+#define EXT_HEADER_CHUNKED                  (1 << 15)
+#define EXT_HEADER_CHUNK_NUMBER(n)          ((uint32_t)(n) << 11)
+#define EXT_HEADER_REQUEST_CHUNK            (1 << 10)
+#define EXT_HEADER_DATA_SIZE_MASK           0x1FF
+
+/* Made up source identity, pid.codes test VID */
+#define SIM_VID                 0x1209
+#define SIM_PID                 0x0001
+
+#define t_TypeCSendSourceCap    150
+#define t_PSHardReset           30
+#define t_SrcRecover            700
+#define n_CapsCount             50
+
+#define NS_PER_MS               1000000ULL
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_Source_Sim_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PD_Source_Sim_c::PD_Source_Sim_c(FUSB302_Sim_c * phy, const PD_source_profile_t * profile):
+    phy(phy),
+    profile(profile),
+    queue_count(0),
+    attached(0),
+    pd_started(0),
+    message_id(0),
+    rx_message_id(-1),
+    reply_count(0),
+    request_reply(PD_SOURCE_REPLY_ACCEPT),
+    caps_count(0),
+    soft_reset_pending(0),
+    rx_drop(0),
+    ext_tx_size(0),
+    ext_tx_type(0),
+    ext_tx_chunk(0),
+    time_last_request(0),
+    load_ma(0)
+{
+    memset(&contract, 0, sizeof(contract));
+    memset(&pending, 0, sizeof(pending));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void PD_Source_Sim_c::attach(void)
+{
+    attached = 1;
+    clear_schedule();
+    reset_protocol();
+    memset(&contract, 0, sizeof(contract));
+    phy->set_partner(this);
+    phy->set_cc(profile->rp, FUSB302_SIM_RP_OPEN);
+    phy->set_vbus(5000);
+    stats.time_attach_ns = now();
+    pd_started = !profile->pd_after_hard_reset;
+    if (profile->pdo_count && pd_started) {
+        schedule(ACTION_SRC_CAP, profile->t_first_src_cap);
+    }
+}
+
+void PD_Source_Sim_c::reset_stats(void)
+{
+    uint64_t time_attach_ns = stats.time_attach_ns;
+    memset(&stats, 0, sizeof(stats));
+    stats.time_attach_ns = time_attach_ns;
+}
+
+void PD_Source_Sim_c::detach(void)
+{
+    attached = 0;
+    clear_schedule();
+    memset(&contract, 0, sizeof(contract));
+    phy->set_cc(FUSB302_SIM_RP_OPEN, FUSB302_SIM_RP_OPEN);
+    phy->set_vbus(0);
+}
+
+void PD_Source_Sim_c::run(void)
+{
+    uint64_t t = now();
+    while (attached && queue_count) {
+        uint8_t i, earliest = 0;
+        for (i = 1; i < queue_count; i++) {
+            if (queue[i].time < queue[earliest].time) {
+                earliest = i;
+            }
+        }
+        if (queue[earliest].time > t) {
+            break;
+        }
+        uint8_t action = queue[earliest].action;
+        queue[earliest] = queue[--queue_count];
+        execute(action);
+    }
+    if (attached && contract.active && contract.pps && profile->t_pps_timeout &&
+        t - time_last_request > profile->t_pps_timeout * NS_PER_MS) {
+        /* Reference: 6.6.20 PPS Timer, no Request within tPPSTimeout, Hard Reset */
+        uint32_t interval = (uint32_t)((t - time_last_request) / NS_PER_MS);
+        if (interval > stats.max_request_interval_ms) {
+            stats.max_request_interval_ms = interval;
+        }
+        stats.pps_timeouts++;
+        inject_hard_reset();
+    }
+}
+
+void PD_Source_Sim_c::set_reply(enum PD_source_reply_t reply, uint8_t count)
+{
+    request_reply = reply;
+    reply_count = count;
+}
+
+void PD_Source_Sim_c::inject_soft_reset(void)
+{
+    if (attached) {
+        schedule(ACTION_SOFT_RESET, 0);
+    }
+}
+
+void PD_Source_Sim_c::inject_hard_reset(void)
+{
+    if (attached) {
+        phy->send_hard_reset();
+        hard_reset();
+    }
+}
+
+bool PD_Source_Sim_c::sim_rx_message(uint16_t header, const uint32_t * obj)
+{
+    uint8_t type = header & 0x1F;
+    uint8_t id = (header >> 9) & 0x7;
+    uint8_t num_of_obj = (header >> 12) & 0x7;
+    if (!attached || profile->pdo_count == 0 || !pd_started) {
+        return false;   /* No PD PHY on the source, no GoodCRC */
+    }
+    if (rx_drop) {
+        rx_drop--;
+        return false;
+    }
+    if (!(header & 0x8000) && num_of_obj == 0 && type == PD_CONTROL_MSG_TYPE_SOFT_RESET) {
+        stats.soft_resets++;
+        clear_schedule();
+        reset_protocol();
+        schedule(ACTION_SOFT_RESET_ACCEPT, profile->t_response);
+        return true;
+    }
+    if (id == rx_message_id) {
+        stats.retries++;
+        return true;    /* Retry of a message already received, GoodCRC only */
+    }
+    rx_message_id = id;
+
+    if (header & 0x8000) {
+        /* Only Get_Manufacturer_Info needs an answer, then Chunk Requests for a long one */
+        if (num_of_obj && (obj[0] & EXT_HEADER_REQUEST_CHUNK)) {
+            handle_chunk_request(type, obj[0] & 0xFFFF);
+        } else if (type == PD_EXT_MSG_TYPE_GET_MFG_INFO) {
+            schedule(profile->spec_rev >= 2 ? ACTION_MFG_INFO : ACTION_NOT_SUPPORTED, profile->t_response);
+        }
+    } else if (num_of_obj) {
+        switch (type) {
+        case PD_DATA_MSG_TYPE_REQUEST:
+            handle_request(obj[0]);
+            break;
+        case PD_DATA_MSG_TYPE_SINK_CAP:
+        case PD_DATA_MSG_TYPE_VENDOR_DEFINED:
+            break;
+        default:
+            schedule(ACTION_NOT_SUPPORTED, profile->t_response);
+            break;
+        }
+    } else {
+        switch (type) {
+        case PD_CONTROL_MSG_TYPE_GET_SRC_CAP:
+            schedule(ACTION_SRC_CAP, profile->t_response);
+            break;
+        case PD_CONTROL_MSG_TYPE_ACCEPT:
+            if (soft_reset_pending) {
+                soft_reset_pending = 0;
+                schedule(ACTION_SRC_CAP, profile->t_response);
+            }
+            break;
+        case PD_CONTROL_MSG_TYPE_GET_PPS_STATUS:
+            schedule(contract.active && contract.pps ? ACTION_PPS_STATUS : ACTION_NOT_SUPPORTED, profile->t_response);
+            break;
+        case PD_CONTROL_MSG_TYPE_GET_SRC_CAP_EXT:
+            schedule(profile->spec_rev >= 2 ? ACTION_SRC_CAP_EXT : ACTION_NOT_SUPPORTED, profile->t_response);
+            break;
+        case PD_CONTROL_MSG_TYPE_GET_STATUS:
+            schedule(profile->spec_rev >= 2 ? ACTION_STATUS : ACTION_NOT_SUPPORTED, profile->t_response);
+            break;
+        case PD_CONTROL_MSG_TYPE_REJECT:
+        case PD_CONTROL_MSG_TYPE_NOT_SUPPORT:
+            break;
+        default:
+            schedule(ACTION_NOT_SUPPORTED, profile->t_response);
+            break;
+        }
+    }
+    return true;
+}
+
+void PD_Source_Sim_c::sim_rx_hard_reset(void)
+{
+    hard_reset();
+}
+
+void PD_Source_Sim_c::handle_request(uint32_t rdo)
+{
+    /* Reference: 6.4.2 Request Message */
+    uint8_t position = (rdo >> 28) & 0x7;
+    uint8_t valid = 0;
+    uint64_t t = now();
+    stats.requests++;
+    if (contract.active && contract.pps) {
+        uint32_t interval = (uint32_t)((t - time_last_request) / NS_PER_MS);
+        if (interval > stats.max_request_interval_ms) {
+            stats.max_request_interval_ms = interval;
+        }
+    }
+    time_last_request = t;
+
+    memset(&pending, 0, sizeof(pending));
+    if (position >= 1 && position <= profile->pdo_count) {
+        uint32_t pdo = profile->pdo[position - 1];
+        uint16_t min_mv = ((pdo >> 10) & 0x3FF) * 50;
+        uint16_t max_mv = ((pdo >> 20) & 0x3FF) * 50;
+        uint16_t op = (rdo >> 10) & 0x3FF;
+        pending.position = position;
+        switch (pdo >> 30) {
+        case 0:     /* Fixed, current in 10mA units */
+            pending.mv = min_mv;
+            pending.ma = op * 10;
+            valid = op <= (pdo & 0x3FF);
+            break;
+        case 1:     /* Battery, power in 250mW units */
+            pending.mv = max_mv;
+            pending.ma = (uint32_t)op * 250000 / max_mv;
+            valid = op <= (pdo & 0x3FF);
+            break;
+        case 2:     /* Variable, current in 10mA units */
+            pending.mv = max_mv;
+            pending.ma = op * 10;
+            valid = op <= (pdo & 0x3FF);
+            break;
+        case 3:     /* PPS, voltage in 20mV units, current in 50mA units */
+            pending.pps = 1;
+            pending.mv = ((rdo >> 9) & 0x7FF) * 20;
+            pending.ma = (rdo & 0x7F) * 50;
+            valid = pending.mv >= ((pdo >> 8) & 0xFF) * 100 && pending.mv <= ((pdo >> 17) & 0xFF) * 100 &&
+                    pending.ma <= (pdo & 0x7F) * 50;
+            break;
+        }
+    }
+    pending.active = valid;
+
+    if (!valid) {
+        schedule(ACTION_REJECT, profile->t_response);
+    } else if (reply_count && request_reply != PD_SOURCE_REPLY_ACCEPT) {
+        reply_count--;
+        schedule(request_reply == PD_SOURCE_REPLY_REJECT ? ACTION_REJECT : ACTION_WAIT, profile->t_response);
+    } else {
+        schedule(ACTION_ACCEPT, profile->t_response);
+    }
+}
+
+void PD_Source_Sim_c::execute(uint8_t action)
+{
+    switch (action) {
+    case ACTION_SRC_CAP:
+        if (send(PD_DATA_MSG_TYPE_SRC_CAP, profile->pdo_count, profile->pdo)) {
+            caps_count = 0;
+            reply_count = profile->reply_count;
+            request_reply = profile->request_reply;
+        } else if (++caps_count < n_CapsCount && !contract.active) {
+            schedule(ACTION_SRC_CAP, t_TypeCSendSourceCap);
+        }
+        stats.src_cap_sent++;
+        break;
+    case ACTION_ACCEPT:
+        stats.accepts++;
+        if (send(PD_CONTROL_MSG_TYPE_ACCEPT, 0, 0)) {
+            schedule(ACTION_PS_RDY, profile->t_src_transition);
+        }
+        break;
+    case ACTION_REJECT:
+        stats.rejects++;
+        send(PD_CONTROL_MSG_TYPE_REJECT, 0, 0);
+        break;
+    case ACTION_WAIT:
+        stats.waits++;
+        send(PD_CONTROL_MSG_TYPE_WAIT, 0, 0);
+        break;
+    case ACTION_PS_RDY:
+        contract = pending;
+        phy->set_vbus(contract.mv);
+        time_last_request = now();
+        if (send(PD_CONTROL_MSG_TYPE_PS_RDY, 0, 0)) {
+            stats.ps_rdy++;
+            if (stats.time_first_ps_rdy_ns == 0) {
+                stats.time_first_ps_rdy_ns = now();
+            }
+        }
+        break;
+    case ACTION_PPS_STATUS: {
+        /* Reference: 6.5.10 PPS_Status Message */
+        uint8_t ppssdb[4];
+        uint16_t mv = contract.mv, ma = load_ma ? load_ma : contract.ma;
+        uint8_t current_limit = ma > contract.ma;
+        if (current_limit) {
+            mv = (uint32_t)mv * contract.ma / ma;
+            ma = contract.ma;
+        }
+        ppssdb[0] = (mv / 20) & 0xFF;                           /* Output Voltage in 20mV units */
+        ppssdb[1] = (mv / 20) >> 8;
+        ppssdb[2] = ma / 50;                                    /* Output Current in 50mA units */
+        ppssdb[3] = (1 << 1) | (current_limit << 3);            /* PTF: Normal, OMF */
+        if (send_ext(PD_EXT_MSG_TYPE_PPS_STATUS, ppssdb, sizeof(ppssdb))) {
+            stats.pps_status_sent++;
+        }
+        break; }
+    case ACTION_SRC_CAP_EXT: {
+        /* Reference: 6.5.1 Source_Capabilities_Extended Message, PDP is the largest PDO */
+        uint8_t scedb[25];
+        uint32_t pdp_mw = 0;
+        for (uint8_t i = 0; i < profile->pdo_count; i++) {
+            uint32_t pdo = profile->pdo[i], mw;
+            switch (pdo >> 30) {
+            case 0:  mw = ((pdo >> 10) & 0x3FF) * 50 * (pdo & 0x3FF) * 10 / 1000; break;
+            case 1:  mw = (pdo & 0x3FF) * 250; break;
+            case 2:  mw = ((pdo >> 20) & 0x3FF) * 50 * (pdo & 0x3FF) * 10 / 1000; break;
+            default: mw = ((pdo >> 17) & 0xFF) * 100 * (pdo & 0x7F) * 50 / 1000; break;
+            }
+            pdp_mw = mw > pdp_mw ? mw : pdp_mw;
+        }
+        memset(scedb, 0, sizeof(scedb));
+        scedb[0] = SIM_VID & 0xFF;                              /* VID */
+        scedb[1] = SIM_VID >> 8;
+        scedb[2] = SIM_PID & 0xFF;                              /* PID */
+        scedb[3] = SIM_PID >> 8;
+        scedb[8] = 1;                                           /* FW Version */
+        scedb[9] = 1;                                           /* HW Version */
+        scedb[11] = 3;                                          /* Holdup Time, 3ms */
+        scedb[12] = 1 << 0;                                     /* Compliance: LPS */
+        for (uint8_t i = 0; i < 3; i++) {
+            /* Peak Current 150%/130%/110% for 20ms/40ms/60ms at 10% duty cycle */
+            uint16_t peak = (15 - i * 2) | ((i + 1) << 5) | (2 << 11);
+            scedb[14 + i * 2] = peak & 0xFF;
+            scedb[15 + i * 2] = peak >> 8;
+        }
+        scedb[20] = 1;                                          /* Touch Temp: IEC 62368-1 TS1 */
+        scedb[21] = 1 << 0;                                     /* Source Inputs: external supply */
+        scedb[23] = pdp_mw / 1000;                              /* Source PDP in W */
+        send_ext(PD_EXT_MSG_TYPE_SRC_CAP_EXT, scedb, sizeof(scedb));
+        break; }
+    case ACTION_STATUS: {
+        /* Reference: 6.5.2 Status Message */
+        uint8_t sdb[6];
+        memset(sdb, 0, sizeof(sdb));
+        sdb[0] = 40;                                            /* Internal Temp, 40C */
+        sdb[1] = 1 << 1;                                        /* Present Input: external power */
+        sdb[4] = 1 << 1;                                        /* Temperature Status: Normal */
+        send_ext(PD_EXT_MSG_TYPE_STATUS, sdb, sizeof(sdb));
+        break; }
+    case ACTION_MFG_INFO: {
+        /* Reference: 6.5.7 Manufacturer_Info Message, the profile name as Manufacturer String */
+        uint8_t midb[PD_SOURCE_EXT_DATA_SIZE];
+        const char * mfg_string = profile->mfg_string ? profile->mfg_string : profile->name;
+        uint8_t len = strlen(mfg_string);
+        len = len < sizeof(midb) - 4 ? len : sizeof(midb) - 4;
+        midb[0] = SIM_VID & 0xFF;
+        midb[1] = SIM_VID >> 8;
+        midb[2] = SIM_PID & 0xFF;
+        midb[3] = SIM_PID >> 8;
+        memcpy(&midb[4], mfg_string, len);
+        send_ext(PD_EXT_MSG_TYPE_MFG_INFO, midb, 4 + len);
+        break; }
+    case ACTION_EXT_CHUNK:
+        send_chunk();
+        break;
+    case ACTION_NOT_SUPPORTED:
+        if (profile->spec_rev >= 2) {
+            send(PD_CONTROL_MSG_TYPE_NOT_SUPPORT, 0, 0);
+        } else {
+            send(PD_CONTROL_MSG_TYPE_REJECT, 0, 0);
+        }
+        break;
+    case ACTION_SOFT_RESET:
+        stats.soft_resets++;
+        clear_schedule();
+        reset_protocol();
+        soft_reset_pending = 1;
+        send(PD_CONTROL_MSG_TYPE_SOFT_RESET, 0, 0);
+        break;
+    case ACTION_SOFT_RESET_ACCEPT:
+        if (send(PD_CONTROL_MSG_TYPE_ACCEPT, 0, 0)) {
+            schedule(ACTION_SRC_CAP, profile->t_response);
+        }
+        break;
+    case ACTION_VBUS_OFF:
+        phy->set_vbus(0);
+        schedule(ACTION_VBUS_ON, t_SrcRecover);
+        break;
+    case ACTION_VBUS_ON:
+        phy->set_vbus(5000);
+        if (profile->pdo_count) {
+            schedule(ACTION_SRC_CAP, profile->t_first_src_cap);
+        }
+        break;
+    }
+}
+
+bool PD_Source_Sim_c::send(uint8_t type, uint8_t obj_count, const uint32_t * obj, bool extended)
+{
+    /* Reference: 6.2.1.1 Message Header */
+    uint16_t header = ((uint16_t)type << 0) |                   /*   4...0  Message Type */
+                      ((uint16_t)1 << 5) |                      /*       5  Port Data Role: DFP */
+                      ((uint16_t)profile->spec_rev << 6) |      /*   7...6  Specification Revision */
+                      ((uint16_t)1 << 8) |                      /*       8  Port Power Role: Source */
+                      ((uint16_t)message_id << 9) |             /*  11...9  MessageID */
+                      ((uint16_t)obj_count << 12) |             /* 14...12  Number of Data Objects */
+                      ((uint16_t)(extended ? 1 : 0) << 15);     /*      15  Extended */
+    if (phy->send_message(header, obj)) {
+        message_id = (message_id + 1) & 0x7;
+        return true;
+    }
+    stats.tx_fail++;
+    return false;
+}
+
+/* Extended message, up to PD_SOURCE_EXT_DATA_SIZE data bytes, chunk 0 now */
+bool PD_Source_Sim_c::send_ext(uint8_t type, const uint8_t * data, uint8_t size)
+{
+    memcpy(ext_tx, data, size);
+    ext_tx_size = size;
+    ext_tx_type = type;
+    ext_tx_chunk = 0;
+    return send_chunk();
+}
+
+/* Chunk ext_tx_chunk of the extended message, the next one then waits for its Chunk Request */
+bool PD_Source_Sim_c::send_chunk(void)
+{
+    /* Reference: 6.2.1.2 Extended Message Header, in the first 2 bytes of the data objects */
+    uint32_t obj[7];
+    uint8_t offset = ext_tx_chunk * PD_EXT_CHUNK_SIZE;
+    uint8_t size = ext_tx_size - offset < PD_EXT_CHUNK_SIZE ? ext_tx_size - offset : PD_EXT_CHUNK_SIZE;
+    memset(obj, 0, sizeof(obj));
+    obj[0] = ext_tx_size | EXT_HEADER_CHUNK_NUMBER(ext_tx_chunk) | EXT_HEADER_CHUNKED;
+    for (uint8_t i = 0; i < size; i++) {
+        obj[(i + 2) / 4] |= (uint32_t)ext_tx[offset + i] << ((i + 2) % 4 * 8);
+    }
+    ext_tx_chunk = offset + size < ext_tx_size ? ext_tx_chunk + 1 : 0;
+    return send(ext_tx_type, (size + 5) / 4, obj, true);
+}
+
+void PD_Source_Sim_c::handle_chunk_request(uint8_t type, uint32_t ext_header)
+{
+    /* Reference: 6.12.2.1.2 Chunking, a request for the next chunk of the message sent, no data */
+    uint8_t chunk = (ext_header >> 11) & 0xF;
+    if (ext_tx_chunk == 0 || type != ext_tx_type || chunk != ext_tx_chunk ||
+        (ext_header & EXT_HEADER_CHUNKED) == 0 || (ext_header & EXT_HEADER_DATA_SIZE_MASK)) {
+        stats.chunk_errors++;
+        return;
+    }
+    stats.chunk_requests++;
+    schedule(ACTION_EXT_CHUNK, profile->t_response);
+}
+
+void PD_Source_Sim_c::hard_reset(void)
+{
+    /* Reference: 7.1.5 Response to Hard Resets, VBUS to vSafe0V then back to vSafe5V */
+    stats.hard_resets++;
+    pd_started = 1;
+    clear_schedule();
+    reset_protocol();
+    memset(&contract, 0, sizeof(contract));
+    schedule(ACTION_VBUS_OFF, t_PSHardReset);
+}
+
+void PD_Source_Sim_c::reset_protocol(void)
+{
+    message_id = 0;
+    rx_message_id = -1;
+    caps_count = 0;
+    soft_reset_pending = 0;
+    ext_tx_chunk = 0;
+}
+
+void PD_Source_Sim_c::schedule(uint8_t action, uint32_t delay_ms)
+{
+    if (queue_count < PD_SOURCE_QUEUE_SIZE) {
+        queue[queue_count].time = now() + delay_ms * NS_PER_MS;
+        queue[queue_count].action = action;
+        queue_count++;
+    }
+}
+
+void PD_Source_Sim_c::clear_schedule(void)
+{
+    queue_count = 0;
+}
+
+uint64_t PD_Source_Sim_c::now(void)
+{
+    return sim_time_ns();
+}
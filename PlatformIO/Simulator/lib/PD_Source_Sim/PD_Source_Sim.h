@@ -0,0 +1,186 @@
+/**
+ * PD_Source_Sim.h
+ *
+ * Scriptable USB PD source (charger) for host simulation, connected to the sink through the
+ * CC wire of FUSB302_Sim_c.
+ *
+ * - Advertises fixed, variable, battery and PPS power data objects from a profile
+ * - Answers Request with Accept, Reject or Wait, then PS_RDY after tSrcTransition
+ * - Answers Get_Source_Cap, Soft_Reset and Get_PPS_Status, a load above the PPS current is
+ *   reported in current limit with the output voltage dropped as into a resistor
+ * - PD3.0 profiles answer Get_Source_Cap_Extended, Get_Status and Get_Manufacturer_Info, made up
+ *   from the profile: PDP from the power data objects, manufacturer from the name or mfg_string.
+ *   A message over one chunk is sent a chunk per Chunk Request, a request out of sequence is
+ *   counted (chunk_errors) and not answered
+ * - Hard resets the port if a PPS contract is not refreshed within tPPSTimeout (15s)
+ * - A profile can keep PD silent after attach until a Hard Reset, as a dock that misses it
+ * - Soft_Reset and Hard_Reset can be injected at any time, sink messages can be left without
+ *   GoodCRC
+ *
+ * Time is taken from the simulation clock, call run() from the simulation loop.
+ *
+ * Reference: USB_PD_R3_0 V2.0 20190829 - Chapter 6. Protocol Layer, 7. Power Supply
+ *
+ */
+
+#ifndef PD_SOURCE_SIM_H
+#define PD_SOURCE_SIM_H
+
+#include <stdint.h>
+
+#include <FUSB302_Sim.h>
+
+/* Power data objects, voltage in mV, current in mA, power in mW */
+#define PDO_FIXED(mv, ma)           (((uint32_t)(mv) / 50 << 10) | ((uint32_t)(ma) / 10))
+#define PDO_VARIABLE(min, max, ma)  (((uint32_t)2 << 30) | ((uint32_t)(max) / 50 << 20) | ((uint32_t)(min) / 50 << 10) | ((uint32_t)(ma) / 10))
+#define PDO_BATTERY(min, max, mw)   (((uint32_t)1 << 30) | ((uint32_t)(max) / 50 << 20) | ((uint32_t)(min) / 50 << 10) | ((uint32_t)(mw) / 250))
+#define PDO_PPS(min, max, ma)       (((uint32_t)3 << 30) | ((uint32_t)(max) / 100 << 17) | ((uint32_t)(min) / 100 << 8) | ((uint32_t)(ma) / 50))
+
+#define PD_SOURCE_MAX_NUM_OF_PDO    7
+#define PD_SOURCE_QUEUE_SIZE        8
+#define PD_SOURCE_EXT_DATA_SIZE     52      /* Extended message, two chunks */
+
+enum PD_source_reply_t {
+    PD_SOURCE_REPLY_ACCEPT = 0,
+    PD_SOURCE_REPLY_REJECT,
+    PD_SOURCE_REPLY_WAIT
+};
+
+typedef struct {
+    const char * name;
+    enum FUSB302_sim_rp_t rp;
+    uint8_t spec_rev;                   /* 1: PD2.0, 2: PD3.0 */
+    uint8_t pdo_count;                  /* 0: Type-C current only, no PD */
+    uint32_t pdo[PD_SOURCE_MAX_NUM_OF_PDO];
+    /* Timing in ms */
+    uint16_t t_first_src_cap;           /* VBUS on to first Source_Capabilities, tFirstSourceCap <= 250 */
+    uint16_t t_response;                /* Request to Accept / Reject / Wait, tSenderResponse <= 30 */
+    uint16_t t_src_transition;          /* Accept to PS_RDY, tSrcTransition + tPSTransition */
+    uint16_t t_pps_timeout;             /* tPPSTimeout, 0 to disable */
+    /* Reply to the first reply_count Requests after each Source_Capabilities, then Accept */
+    enum PD_source_reply_t request_reply;
+    uint8_t reply_count;
+    uint8_t pd_after_hard_reset;        /* PD silent after attach, no GoodCRC, until the first Hard Reset */
+    /* Manufacturer String, the name if NULL. Over 22 bytes Manufacturer_Info takes two chunks,
+       longer than the spec allows, to test chunking */
+    const char * mfg_string;
+} PD_source_profile_t;
+
+typedef struct {
+    uint32_t src_cap_sent;
+    uint32_t requests;
+    uint32_t accepts;
+    uint32_t rejects;
+    uint32_t waits;
+    uint32_t ps_rdy;
+    uint32_t soft_resets;
+    uint32_t hard_resets;
+    uint32_t pps_timeouts;
+    uint32_t pps_status_sent;
+    uint32_t tx_fail;                   /* Message without GoodCRC from the sink */
+    uint32_t retries;                   /* Message with the MessageID of the last one, GoodCRC only */
+    uint32_t chunk_requests;            /* Chunk Request for the next chunk of the last extended message */
+    uint32_t chunk_errors;              /* Chunk Request for another message or chunk */
+    uint64_t time_attach_ns;
+    uint64_t time_first_ps_rdy_ns;      /* 0 until the first explicit contract */
+    uint32_t max_request_interval_ms;   /* Longest gap between Requests in a PPS contract */
+} PD_source_stats_t;
+
+typedef struct {
+    uint8_t active;
+    uint8_t position;                   /* Object position, 1...7 */
+    uint8_t pps;
+    uint16_t mv;
+    uint16_t ma;
+} PD_source_contract_t;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_Source_Sim_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class PD_Source_Sim_c : public FUSB302_Sim_partner_c
+{
+    public:
+        PD_Source_Sim_c(FUSB302_Sim_c * phy, const PD_source_profile_t * profile);
+        // Cable
+        void attach(void);
+        void detach(void);
+        // Task
+        void run(void);
+        // Script
+        void set_profile(const PD_source_profile_t * profile) { this->profile = profile; }
+        void set_reply(enum PD_source_reply_t reply, uint8_t count);   /* Until the next Source_Capabilities */
+        void inject_soft_reset(void);
+        void inject_hard_reset(void);
+        void drop_rx(uint8_t count) { rx_drop = count; }               /* No GoodCRC, retries count */
+        void set_load(uint16_t ma) { load_ma = ma; }                   /* 0: the contract current */
+        // Status
+        const PD_source_contract_t & get_contract(void) { return contract; }
+        const PD_source_stats_t & get_stats(void) { return stats; }
+        uint64_t get_time_last_request(void) { return time_last_request; }
+        uint8_t get_ext_tx(const uint8_t ** data) { *data = ext_tx; return ext_tx_size; }   /* Last extended message */
+        void reset_stats(void);                                         /* Keep the attach time */
+        // FUSB302_Sim_partner_c
+        virtual bool sim_rx_message(uint16_t header, const uint32_t * obj);
+        virtual void sim_rx_hard_reset(void);
+
+    protected:
+        enum {
+            ACTION_SRC_CAP,
+            ACTION_ACCEPT,
+            ACTION_REJECT,
+            ACTION_WAIT,
+            ACTION_PS_RDY,
+            ACTION_PPS_STATUS,
+            ACTION_SRC_CAP_EXT,
+            ACTION_STATUS,
+            ACTION_MFG_INFO,
+            ACTION_EXT_CHUNK,
+            ACTION_NOT_SUPPORTED,
+            ACTION_SOFT_RESET,
+            ACTION_SOFT_RESET_ACCEPT,
+            ACTION_VBUS_OFF,
+            ACTION_VBUS_ON
+        };
+        void schedule(uint8_t action, uint32_t delay_ms);
+        void clear_schedule(void);
+        void execute(uint8_t action);
+        bool send(uint8_t type, uint8_t obj_count, const uint32_t * obj, bool extended = false);
+        bool send_ext(uint8_t type, const uint8_t * data, uint8_t size);
+        bool send_chunk(void);
+        void handle_chunk_request(uint8_t type, uint32_t ext_header);
+        void handle_request(uint32_t rdo);
+        void hard_reset(void);
+        void reset_protocol(void);
+        uint64_t now(void);
+
+        FUSB302_Sim_c * phy;
+        const PD_source_profile_t * profile;
+        struct {
+            uint64_t time;
+            uint8_t action;
+        } queue[PD_SOURCE_QUEUE_SIZE];
+        uint8_t queue_count;
+        // Protocol
+        uint8_t attached;
+        uint8_t pd_started;
+        uint8_t message_id;
+        int8_t rx_message_id;               /* Last MessageID from the sink, -1 after reset */
+        uint8_t reply_count;
+        enum PD_source_reply_t request_reply;
+        uint8_t caps_count;
+        uint8_t soft_reset_pending;         /* Soft_Reset sent, waiting for Accept */
+        uint8_t rx_drop;                    /* Sink transmissions left without GoodCRC, see drop_rx() */
+        // Extended message being sent
+        uint8_t ext_tx[PD_SOURCE_EXT_DATA_SIZE];
+        uint8_t ext_tx_size;
+        uint8_t ext_tx_type;
+        uint8_t ext_tx_chunk;               /* Next chunk, sent on its Chunk Request, 0 if none */
+        // Contract
+        PD_source_contract_t contract;
+        PD_source_contract_t pending;
+        uint64_t time_last_request;
+        uint16_t load_ma;
+        PD_source_stats_t stats;
+};
+
+#endif
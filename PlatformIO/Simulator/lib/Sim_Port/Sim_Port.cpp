@@ -0,0 +1,92 @@
+/**
+ * Sim_Port.cpp
+ *
+ * One simulated USB-C port for the simulator programs, see Sim_Port.h
+ *
+ */
+
+#include <stdint.h>
+
+#include "Sim_Port.h"
+
+static uint32_t delayed_ms;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Virtual clock
+///////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t sim_clock_ms(void)
+{
+    return (uint32_t)(sim_time_ns() / SIM_NS_PER_MS);
+}
+
+void sim_delay_ms(uint32_t ms)
+{
+    delayed_ms += ms;
+    sim_advance_ns(ms * SIM_NS_PER_MS);
+}
+
+uint32_t sim_delayed_ms(void)
+{
+    return delayed_ms;
+}
+
+void sim_delayed_reset(void)
+{
+    delayed_ms = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Sim_port_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Sim_port_c::Sim_port_c(const PD_source_profile_t * profile, uint8_t int_pin, uint8_t address, TwoWire & wire):
+    source(&phy, profile),
+    int_pin(int_pin),
+    address(address),
+    wire(&wire),
+    bus(0),
+    connected(false)
+{
+}
+
+void Sim_port_c::connect(I2C_Sim_c * bus)
+{
+    this->bus = bus;
+    if (bus) {
+        bus->attach(address, &phy);
+        bus->reset_stats();
+    } else {
+        wire->attach(address, &phy);
+        wire->reset_stats();
+    }
+    sim_attach_pin(int_pin, FUSB302_Sim_c::int_n_read, &phy);
+    connected = true;
+}
+
+void Sim_port_c::disconnect(void)
+{
+    if (!connected) {
+        return;
+    }
+    if (bus) {
+        bus->flush();
+        bus->detach(address);
+    } else {
+        wire->detach(address);
+    }
+    sim_detach_pin(int_pin);
+    connected = false;
+}
+
+void Sim_port_c::init(PD_UFP_c & sink)
+{
+    sink.init_PPS(int_pin, PPS_V(9.0), PPS_A(2.0), PD_POWER_OPTION_MAX_20V);
+}
+
+void Sim_port_c::run_for(PD_UFP_c & sink, uint32_t ms)
+{
+    uint64_t end_ns = sim_time_ns() + ms * SIM_NS_PER_MS;
+    while (sim_time_ns() < end_ns) {
+        run(sink);
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * Sim_Port.h
+ *
+ * One simulated USB-C port for the simulator programs: a FUSB302 register model (FUSB302_Sim_c)
+ * on an I2C bus address and INT_N pin, with a charger (PD_Source_Sim_c) on the other end of
+ * the cable, and the virtual clock given to the sink in place of millis()/delay().
+ *
+ * sim_delay_ms() is the delay of the library and is counted, the main loop paces itself with
+ * sim_advance_ns() so that time spent blocked in the library can be told apart.
+ *
+ */
+
+#ifndef SIM_PORT_H
+#define SIM_PORT_H
+
+#include <stdint.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <I2C_Sim.h>
+#include <FUSB302_Sim.h>
+#include <PD_Source_Sim.h>
+
+#define SIM_PORT_INT_PIN    10
+#define SIM_PORT_ADDRESS    0x22
+#define SIM_NS_PER_MS       1000000ULL
+
+/* Virtual clock for PD_UFP_c::clock_source_set() */
+uint32_t sim_clock_ms(void);
+void sim_delay_ms(uint32_t ms);
+uint32_t sim_delayed_ms(void);          /* sim_delay_ms() total since sim_delayed_reset() */
+void sim_delayed_reset(void);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Sim_port_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class Sim_port_c
+{
+    public:
+        Sim_port_c(const PD_source_profile_t * profile, uint8_t int_pin = SIM_PORT_INT_PIN,
+            uint8_t address = SIM_PORT_ADDRESS, TwoWire & wire = Wire);
+        ~Sim_port_c() { disconnect(); }
+        // FUSB302 on the Wire bus, or on an asynchronous bus, and on the INT_N pin
+        void connect(I2C_Sim_c * bus = 0);
+        void disconnect(void);
+        // Sink asking for PPS 9V 2A, fixed up to 20V otherwise, the request of every program
+        void init(PD_UFP_c & sink);
+        // Charger then sink, once per pass of the main loop
+        void run(PD_UFP_c & sink) { source.run(); sink.run(); }
+        // Main loop for ms, paced at 1ms
+        void run_for(PD_UFP_c & sink, uint32_t ms);
+        uint8_t get_int_pin(void) { return int_pin; }
+        uint8_t get_address(void) { return address; }
+
+        FUSB302_Sim_c phy;
+        PD_Source_Sim_c source;
+
+    protected:
+        uint8_t int_pin;
+        uint8_t address;
+        TwoWire * wire;
+        I2C_Sim_c * bus;
+        bool connected;
+};
+
+#endif
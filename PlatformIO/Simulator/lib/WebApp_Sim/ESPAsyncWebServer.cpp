@@ -0,0 +1,97 @@
+/**
+ * ESPAsyncWebServer.cpp
+ *
+ * Host (Linux) stand-in for ESPAsyncWebServer, see ESPAsyncWebServer.h
+ *
+ */
+
+#include <string.h>
+
+#include "ESPAsyncWebServer.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// AsyncWebServerRequest
+///////////////////////////////////////////////////////////////////////////////////////////////////
+AsyncWebServerRequest::AsyncWebServerRequest(const char * url) : code(0), responses(0), cost_ns(0)
+{
+    const char * query = strchr(url, '?');
+    if (query == 0) {
+        _url = String(url);
+        return;
+    }
+    _url = String(std::string(url, query - url));
+    /* name=value pairs separated by '&', no percent decoding, the Web App does not need it */
+    const char * p = query + 1;
+    while (*p) {
+        const char * end = strchr(p, '&');
+        std::string pair = end ? std::string(p, end - p) : std::string(p);
+        size_t eq = pair.find('=');
+        if (!pair.empty()) {
+            params.push_back(AsyncWebParameter(String(pair.substr(0, eq)),
+                String(eq == std::string::npos ? std::string() : pair.substr(eq + 1))));
+        }
+        if (end == 0) {
+            break;
+        }
+        p = end + 1;
+    }
+}
+
+bool AsyncWebServerRequest::hasParam(const String & name) const
+{
+    for (const AsyncWebParameter & param : params) {
+        if (param.name() == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncWebParameter * AsyncWebServerRequest::getParam(const String & name)
+{
+    for (AsyncWebParameter & param : params) {
+        if (param.name() == name) {
+            return &param;
+        }
+    }
+    return 0;
+}
+
+void AsyncWebServerRequest::send(int code, const String & content_type, const String & content)
+{
+    if (responses++ == 0) {
+        sim_advance_ns(cost_ns);
+        this->code = code;
+        body = content;
+    }
+}
+
+void AsyncWebServerRequest::send(fs::FS & fs, const String & path, const String & content_type)
+{
+    send(200, content_type, path);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// AsyncWebServer
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void AsyncWebServer::on(const char * uri, WebRequestMethod method, ArRequestHandlerFunction handler)
+{
+    if (route_count < ASYNC_WEB_SERVER_MAX_ROUTES) {
+        routes[route_count].uri = uri;
+        routes[route_count].handler = handler;
+        route_count++;
+    }
+}
+
+void AsyncWebServer::sim_request(AsyncWebServerRequest * request)
+{
+    if (started) {
+        for (uint8_t i = 0; i < route_count; i++) {
+            if (routes[i].uri == request->url().c_str()) {
+                routes[i].handler(request);
+                return;
+            }
+        }
+    }
+    request->send(404, "text/plain", "Not found");
+}
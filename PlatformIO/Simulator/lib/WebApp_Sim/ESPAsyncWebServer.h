@@ -0,0 +1,90 @@
+/**
+ * ESPAsyncWebServer.h
+ *
+ * Host (Linux) stand-in for ESPAsyncWebServer, the subset used by the Web App firmware.
+ *
+ * There is no socket: a request is a URL handed to AsyncWebServer::sim_request(), which runs the
+ * matching handler on the calling thread and returns what the handler sent. The caller decides
+ * when a request is served relative to loop(), see src/webapp_load.cpp. The cost of a request
+ * is taken from the virtual clock by the first send(), so it falls inside the handler.
+ *
+ */
+
+#ifndef ESPASYNCWEBSERVER_H
+#define ESPASYNCWEBSERVER_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define ASYNC_WEB_SERVER_MAX_ROUTES     32
+
+typedef enum {
+    HTTP_GET     = 0b00000001,
+    HTTP_POST    = 0b00000010,
+    HTTP_ANY     = 0b01111111
+} WebRequestMethod;
+
+class AsyncWebParameter
+{
+    public:
+        AsyncWebParameter(const String & name, const String & value) : _name(name), _value(value) {}
+        const String & name(void) const { return _name; }
+        const String & value(void) const { return _value; }
+
+    protected:
+        String _name;
+        String _value;
+};
+
+class AsyncWebServerRequest
+{
+    public:
+        AsyncWebServerRequest(const char * url);
+        // Handler API
+        const String & url(void) const { return _url; }
+        bool hasParam(const String & name) const;
+        AsyncWebParameter * getParam(const String & name);
+        void send(int code, const String & content_type = String(), const String & content = String());
+        void send(fs::FS & fs, const String & path, const String & content_type = String());
+        // Simulation
+        int sim_code(void) const { return code; }
+        const String & sim_body(void) const { return body; }
+        uint8_t sim_responses(void) const { return responses; }    /* More than 1 is a handler bug */
+        void sim_set_cost(uint64_t ns) { cost_ns = ns; }            /* Network stack, parsing and response */
+
+    protected:
+        String _url;
+        std::vector<AsyncWebParameter> params;
+        int code;
+        String body;
+        uint8_t responses;
+        uint64_t cost_ns;
+};
+
+typedef std::function<void(AsyncWebServerRequest * request)> ArRequestHandlerFunction;
+
+class AsyncWebServer
+{
+    public:
+        AsyncWebServer(uint16_t port) : port(port), route_count(0), started(false) {}
+        void on(const char * uri, WebRequestMethod method, ArRequestHandlerFunction handler);
+        void begin(void) { started = true; }
+        // Simulation: run the handler for url, 404 if there is none or begin() was not called
+        void sim_request(AsyncWebServerRequest * request);
+
+    protected:
+        uint16_t port;
+        struct {
+            std::string uri;
+            ArRequestHandlerFunction handler;
+        } routes[ASYNC_WEB_SERVER_MAX_ROUTES];
+        uint8_t route_count;
+        bool started;
+};
+
+#endif
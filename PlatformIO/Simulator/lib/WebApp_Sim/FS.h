@@ -0,0 +1,22 @@
+/**
+ * FS.h
+ *
+ * Host (Linux) stand-in for the ESP32 file system base class, nothing is stored
+ *
+ */
+
+#ifndef FS_H
+#define FS_H
+
+namespace fs {
+
+class FS
+{
+    public:
+        bool begin(bool format_on_fail = false) { return true; }
+        void end(void) {}
+};
+
+}
+
+#endif
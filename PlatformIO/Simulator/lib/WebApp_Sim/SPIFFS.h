@@ -0,0 +1,23 @@
+/**
+ * SPIFFS.h
+ *
+ * Host (Linux) stand-in for the ESP32 SPIFFS, mounts always succeed, see FS.h
+ *
+ */
+
+#ifndef SPIFFS_H
+#define SPIFFS_H
+
+#include <FS.h>
+
+namespace fs {
+
+class SPIFFSFS : public FS
+{
+};
+
+}
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif
@@ -0,0 +1,12 @@
+/**
+ * WebApp_Sim.cpp
+ *
+ * Globals of the Web App stand-ins, see SPIFFS.h and WiFi.h
+ *
+ */
+
+#include "SPIFFS.h"
+#include "WiFi.h"
+
+fs::SPIFFSFS SPIFFS;
+WiFiClass WiFi;
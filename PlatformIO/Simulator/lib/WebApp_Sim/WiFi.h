@@ -0,0 +1,21 @@
+/**
+ * WiFi.h
+ *
+ * Host (Linux) stand-in for the ESP32 WiFi class, always connected on the loopback address
+ *
+ */
+
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <Arduino.h>
+
+class WiFiClass
+{
+    public:
+        String localIP(void) { return String("127.0.0.1"); }
+};
+
+extern WiFiClass WiFi;
+
+#endif
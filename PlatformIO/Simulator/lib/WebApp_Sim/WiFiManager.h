@@ -0,0 +1,18 @@
+/**
+ * WiFiManager.h
+ *
+ * Host (Linux) stand-in for WiFiManager, the connection always succeeds at once
+ *
+ */
+
+#ifndef WIFIMANAGER_H
+#define WIFIMANAGER_H
+
+class WiFiManager
+{
+    public:
+        bool autoConnect(const char * ap_name = 0, const char * password = 0) { return true; }
+        void resetSettings(void) {}
+};
+
+#endif
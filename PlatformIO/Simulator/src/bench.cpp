@@ -0,0 +1,165 @@
+/*
+   -- Negotiation Benchmark --
+
+   Measures, for a set of charger behaviours, how fast the PD sink library reaches usable power
+   and what it costs on the I2C bus. Results are printed as JSON so they can be stored per
+   firmware release and compared:
+
+   - ready_ms            VBUS attach to is_power_ready() / is_PPS_ready(), null if never ready
+   - ps_rdy_ms           VBUS attach to the first PS_RDY sent by the source
+   - i2c_transactions    I2C transactions from attach to ready
+   - i2c_bytes           Bytes on the bus from attach to ready, including address bytes
+   - i2c_bus_us          Time the bus was busy from attach to ready
+   - i2c_wait_us         Time the library waited for the bus from attach to ready, all of the bus
+                         time with Wire, only reads and full write queues with the async bus
+   - run_iterations      Calls to run() from attach to ready, one per ms of simulation time
+   - blocked_ms          Time spent inside delay_ms from attach to ready
+
+   Numbers are taken in virtual time and are the same on every run of the same firmware.
+   With -a the FUSB302 is on the in-memory asynchronous bus (lib/I2C_Sim) instead of Wire,
+   register and FIFO writes are posted. With -t attach is found by the FUSB302 toggle logic,
+   see PD_UFP_c::set_toggle_attach().
+
+   Build and run:
+     pio run -e bench -t exec
+     .pio/build/bench/program [-a] [-t] [charger] > bench.json
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <I2C_Sim.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define BENCH_TIMEOUT_MS    10000
+
+/* Scripted charger behaviours, in the order they are reported */
+static const char * const chargers[] = {
+    "pd2_5v_3a",
+    "pd3_20w",
+    "pd3_65w_laptop",
+    "pps_25w",
+    "pps_45w",
+    "pps_100w",
+    "var_bat_bench",
+    "slow_transition",
+    "wait_twice",
+    "reject_all",
+    "typec_only_3a",
+};
+
+typedef struct {
+    int32_t ready_ms;
+    int32_t ps_rdy_ms;
+    uint8_t ps_status;
+    uint32_t i2c_transactions;
+    uint32_t i2c_bytes;
+    uint32_t i2c_bus_us;
+    uint32_t i2c_wait_us;
+    uint32_t run_iterations;
+    uint32_t blocked_ms;
+} bench_result_t;
+
+static bool async;
+static bool toggle;
+
+static void run_charger(const PD_source_profile_t * profile, bench_result_t * result)
+{
+    Sim_port_c port(profile);
+    PD_UFP_c sink;
+    I2C_Sim_c bus;
+    I2C_Sim_c * async_bus = async ? &bus : 0;
+    uint32_t time_attach;
+
+    memset(result, 0, sizeof(bench_result_t));
+    result->ready_ms = -1;
+    sim_reset_time();
+    port.connect(async_bus);
+    PD_UFP_c::i2c_transport_set(async_bus);
+    sink.set_toggle_attach(toggle);
+    port.init(sink);
+
+    /* Attach VBUS once the sink has settled in the unattached state */
+    sim_advance_ns(10 * SIM_NS_PER_MS);
+    Wire.reset_stats();
+    if (async_bus) {
+        async_bus->reset_stats();
+    }
+    sim_delayed_reset();
+    time_attach = sim_clock_ms();
+    port.source.attach();
+    while (sim_clock_ms() - time_attach < BENCH_TIMEOUT_MS) {
+        port.run(sink);
+        result->run_iterations++;
+        if (sink.is_power_ready() || sink.is_PPS_ready()) {
+            result->ready_ms = sim_clock_ms() - time_attach;
+            break;
+        }
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+
+    const PD_source_stats_t & s = port.source.get_stats();
+    const TwoWire_stats_t & w = async_bus ? async_bus->get_stats() : Wire.get_stats();
+    result->ps_rdy_ms = s.time_first_ps_rdy_ns ? (int32_t)((s.time_first_ps_rdy_ns - s.time_attach_ns) / SIM_NS_PER_MS) : -1;
+    result->ps_status = sink.get_ps_status();
+    result->i2c_transactions = w.transactions;
+    result->i2c_bytes = w.bytes;
+    result->i2c_bus_us = (uint32_t)(w.bus_time_ns / 1000);
+    result->i2c_wait_us = (uint32_t)((async_bus ? async_bus->get_wait_ns() : w.bus_time_ns) / 1000);
+    result->blocked_ms = sim_delayed_ms();
+    port.disconnect();
+    PD_UFP_c::i2c_transport_set(0);
+}
+
+static void print_ms(const char * key, int32_t ms)
+{
+    if (ms < 0) {
+        printf("\"%s\": null, ", key);
+    } else {
+        printf("\"%s\": %d, ", key, (int)ms);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    const char * separator = "";
+    PD_UFP_c::clock_source_set(sim_clock_ms, sim_delay_ms);
+    while (argc > 1 && (strcmp(argv[1], "-a") == 0 || strcmp(argv[1], "-t") == 0)) {
+        async |= argv[1][1] == 'a';
+        toggle |= argv[1][1] == 't';
+        argc--;
+        argv++;
+    }
+
+    printf("{\n  \"benchmark\": \"pd_negotiation\",\n  \"version\": 1,\n");
+    printf("  \"transport\": \"%s\",\n", async ? "async" : "wire");
+    printf("  \"attach\": \"%s\",\n", toggle ? "toggle" : "poll");
+    printf("  \"sink\": {\"pps_mv\": 9000, \"pps_ma\": 2000, \"power_option\": \"MAX_20V\"},\n");
+    printf("  \"timeout_ms\": %d,\n  \"results\": [", BENCH_TIMEOUT_MS);
+    for (uint8_t i = 0; i < sizeof(chargers) / sizeof(chargers[0]); i++) {
+        const PD_source_profile_t * profile = PD_source_profile_find(chargers[i]);
+        const char * status_name[] = {"NA", "TYP", "PPS"};
+        bench_result_t r;
+        if (profile == 0 || (argc > 1 && strcmp(argv[1], chargers[i]) != 0)) {
+            continue;
+        }
+        run_charger(profile, &r);
+        printf("%s\n    {\"charger\": \"%s\", ", separator, profile->name);
+        print_ms("ready_ms", r.ready_ms);
+        print_ms("ps_rdy_ms", r.ps_rdy_ms);
+        printf("\"power\": \"%s\", \"i2c_transactions\": %u, \"i2c_bytes\": %u, \"i2c_bus_us\": %u, "
+            "\"i2c_wait_us\": %u, \"run_iterations\": %u, \"blocked_ms\": %u}",
+            r.ps_status < 3 ? status_name[r.ps_status] : "?",
+            (unsigned)r.i2c_transactions, (unsigned)r.i2c_bytes, (unsigned)r.i2c_bus_us,
+            (unsigned)r.i2c_wait_us, (unsigned)r.run_iterations, (unsigned)r.blocked_ms);
+        separator = ",";
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+   -- Charger Profile Run --
+
+   Runs the PD sink library against every charger profile in lib/PD_Source_Sim and reports,
+   per charger class, the attach to PS_RDY latency seen by the source, the time until the sink
+   reports usable power, and how the PPS keepalive behaves over a soak period.
+
+   The sink asks for PPS 9V 2A and falls back to the highest fixed supply up to 20V. Once ready
+   it asks for Source_Capabilities_Extended, Status and Manufacturer_Info: pdp and temp are from
+   the replies, mfg is yes if the manufacturer string is the one of the charger ('-' if the
+   charger does not support them). A Manufacturer_Info of two chunks (pd3_mfg_chunked) must be
+   reassembled by the sink as sent, after one Chunk Request for each chunk past the first and
+   none out of sequence: chunk is yes, '-' for one chunk.
+
+   Exit code is 1 if a manufacturer string or a chunked message is not received as sent, or the
+   charger drops a PPS contract for a missed keepalive (pps_tmo).
+
+   Build and run:
+     pio run -e chargers -t exec
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define SOAK_TIME_MS        60000
+
+/* Sink that shows the last extended message as reassembled from its chunks */
+class Chargers_sink_c : public PD_UFP_c
+{
+    public:
+        const PD_ext_rx_t & get_ext_rx(void) { return protocol.ext_rx; }
+};
+
+static const char * power_status_name(status_power_t status)
+{
+    const char * name[] = {"NA", "TYP", "PPS"};
+    return status < sizeof(name) / sizeof(name[0]) ? name[status] : "?";
+}
+
+/* Return false if the manufacturer string or a chunked message is not received as sent, or on a PPS timeout */
+static bool run_profile(const PD_source_profile_t * profile)
+{
+    Sim_port_c port(profile);
+    PD_Source_Sim_c & source = port.source;
+    Chargers_sink_c sink;
+    unsigned long time_ready = 0;
+    uint8_t info_requested = 0;
+    PD_src_cap_ext_t src_cap_ext;
+    PD_status_t status;
+    PD_mfg_info_t mfg_info;
+    char pdp[8] = "-", temp[8] = "-";
+    const char * mfg = "-", * chunk = "-";
+    const uint8_t * ext_tx;
+    uint8_t ext_tx_size;
+
+    sim_reset_time();
+    port.connect();
+    port.init(sink);
+
+    source.attach();
+    while (millis() < SOAK_TIME_MS) {
+        port.run(sink);
+        if (time_ready == 0 && (sink.is_power_ready() || sink.is_PPS_ready())) {
+            time_ready = millis();
+        }
+        if (time_ready && info_requested < 3) {
+            /* One at a time, request_*() is refused while a reply is pending */
+            bool (PD_UFP_c::*request[])(void) = {
+                &PD_UFP_c::request_src_cap_ext, &PD_UFP_c::request_status, &PD_UFP_c::request_manufacturer_info
+            };
+            info_requested += (sink.*request[info_requested])();
+        }
+        delay(1);
+    }
+    if (sink.get_src_cap_ext(&src_cap_ext)) {
+        snprintf(pdp, sizeof(pdp), "%u", src_cap_ext.source_PDP);
+    }
+    if (sink.get_status(&status)) {
+        snprintf(temp, sizeof(temp), "%u", status.internal_temp);
+    }
+    if (sink.get_manufacturer_info(&mfg_info)) {
+        const char * mfg_string = profile->mfg_string ? profile->mfg_string : profile->name;
+        mfg = strncmp(mfg_info.name, mfg_string, sizeof(mfg_info.name) - 1) == 0 ? "yes" : "NO";
+    }
+
+    const PD_source_stats_t & s = source.get_stats();
+    ext_tx_size = source.get_ext_tx(&ext_tx);
+    if (ext_tx_size > PD_PROTOCOL_EXT_CHUNK_SIZE || s.chunk_errors) {
+        /* The last extended message, Manufacturer_Info */
+        const PD_ext_rx_t & rx = sink.get_ext_rx();
+        bool same = rx.size == ext_tx_size && memcmp(rx.data, ext_tx, ext_tx_size) == 0;
+        chunk = same && s.chunk_requests == (ext_tx_size - 1u) / PD_PROTOCOL_EXT_CHUNK_SIZE && s.chunk_errors == 0 ? "yes" : "NO";
+    }
+    const PD_source_contract_t & c = source.get_contract();
+    unsigned long ps_rdy = s.time_first_ps_rdy_ns ? (unsigned long)((s.time_first_ps_rdy_ns - s.time_attach_ns) / 1000000) : 0;
+    printf("%-16s %8lu %8lu  %-3s %6u %6u %5u %5u %6u %8u %5u %5u %4s %4s %4s %5s\n",
+        profile->name, ps_rdy, time_ready, power_status_name(sink.get_ps_status()),
+        c.active ? c.mv : 0, c.active ? c.ma : 0,
+        (unsigned)s.requests, (unsigned)s.rejects + (unsigned)s.waits, (unsigned)s.max_request_interval_ms,
+        (unsigned)s.pps_timeouts, (unsigned)s.hard_resets, (unsigned)(Wire.get_stats().transactions * 1000 / SOAK_TIME_MS),
+        pdp, temp, mfg, chunk);
+    return mfg[0] != 'N' && chunk[0] != 'N' && s.pps_timeouts == 0;
+}
+
+int main(int argc, char * argv[])
+{
+    uint8_t failed = 0;
+    printf("%-16s %8s %8s  %-3s %6s %6s %5s %5s %6s %8s %5s %5s %4s %4s %4s %5s\n",
+        "charger", "ps_rdy", "ready", "pwr", "mV", "mA", "req", "rj/wt", "max_ka", "pps_tmo", "hrst", "i2c/s",
+        "pdp", "temp", "mfg", "chunk");
+    for (uint8_t i = 0; i < PD_source_profile_count; i++) {
+        if (argc > 1 && strcmp(argv[1], PD_source_profiles[i].name) != 0) {
+            continue;
+        }
+        failed |= !run_profile(&PD_source_profiles[i]);
+    }
+    return failed;
+}
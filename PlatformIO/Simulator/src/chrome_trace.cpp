@@ -0,0 +1,278 @@
+/*
+   -- Negotiation Timeline Export --
+
+   Runs PD_UFP_c against a charger profile in virtual time and writes the whole negotiation
+   as Chrome trace-event JSON, to open in Perfetto (ui.perfetto.dev) or chrome://tracing:
+
+   - PD_UFP      FUSB302 attached span (FUSB302_STATE_ATTACHED until detach), instants for
+                 every PD message sent and received, failed transmissions, protocol timer
+                 expirations in PD_UFP_c::timer(), Hard Reset and configuration changes
+   - run()       Calls to PD_UFP_c::run() that took time
+   - delay_ms    Time blocked in the library delay
+   - I2C         Every FUSB302 transaction, a register pointer write and the read that
+                 follows are one span
+
+   Library events come from the PD_UFP_c trace (PD_UFP_Trace.h). They are stamped with the
+   simulation time of the next I2C transaction, delay or the end of run(), whichever comes first,
+   so they line up with the bus traffic they cause.
+
+   Build and run:
+     pio run -e chrome_trace
+     .pio/build/chrome_trace/program [charger] [duration_ms] > negotiation.json
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_UFP_Trace.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define TRACE_BUFFER_SIZE   4096
+#define ATTACH_AT_MS        10
+#define DEFAULT_DURATION_MS 1000
+
+enum {
+    TID_PD_UFP = 1,
+    TID_RUN,
+    TID_DELAY,
+    TID_I2C
+};
+
+static PD_trace_t trace;
+static uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+static const char * separator = "";
+static bool attached;
+static struct {
+    bool active;
+    uint8_t reg;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} pointer;
+
+static const char * reg_name(uint8_t reg_addr)
+{
+    static const char * const control_name[] = {
+        "DEVICE_ID", "SWITCHES0", "SWITCHES1", "MEASURE", "SLICE", "CONTROL0", "CONTROL1", "CONTROL2",
+        "CONTROL3", "MASK", "POWER", "RESET", "OCPREG", "MASKA", "MASKB", "CONTROL4"
+    };
+    static const char * const status_name[] = {
+        "STATUS0A", "STATUS1A", "INTERRUPTA", "INTERRUPTB", "STATUS0", "STATUS1", "INTERRUPT", "FIFOS"
+    };
+    if (reg_addr >= 0x01 && reg_addr <= 0x10) {
+        return control_name[reg_addr - 0x01];
+    }
+    if (reg_addr >= 0x3C && reg_addr <= 0x43) {
+        return status_name[reg_addr - 0x3C];
+    }
+    return "?";
+}
+
+static void end_args(const char * args)
+{
+    if (args) {
+        printf(",\"args\":{%s}}", args);
+    } else {
+        printf("}");
+    }
+}
+
+/* Trace event timestamps are in us, keep ns resolution */
+static void event_begin(const char * ph, const char * name, uint8_t tid, uint64_t ns)
+{
+    printf("%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u", separator, ph, name,
+        (unsigned)tid, (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+    separator = ",";
+}
+
+static void span(const char * name, uint8_t tid, uint64_t start_ns, uint64_t end_ns, const char * args)
+{
+    uint64_t dur = end_ns - start_ns;
+    event_begin("X", name, tid, start_ns);
+    printf(",\"dur\":%llu.%03u", (unsigned long long)(dur / 1000), (unsigned)(dur % 1000));
+    end_args(args);
+}
+
+static void instant(const char * name, uint8_t tid, uint64_t ns, const char * args)
+{
+    event_begin("i", name, tid, ns);
+    printf(",\"s\":\"t\"");
+    end_args(args);
+}
+
+static void thread_name(uint8_t tid, const char * name)
+{
+    printf("%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", separator, (unsigned)tid, name);
+    printf(",\n{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}", (unsigned)tid, (unsigned)tid);
+    separator = ",";
+}
+
+static void emit_message(const PD_trace_record_t * r, uint64_t ns)
+{
+    PD_msg_info_t info;
+    char name[32], args[160];
+    int n;
+    PD_protocol_get_msg_info(r->header, &info);
+    snprintf(name, sizeof(name), "%s %s", r->type == PD_TRACE_RX ? "RX" : "TX", info.name);
+    n = snprintf(args, sizeof(args), "\"header\":\"%04X\",\"id\":%u,\"obj\":\"", (unsigned)r->header,
+        (unsigned)((r->header >> 9) & 0x7));
+    for (uint8_t i = 0; i < r->num_of_obj && n < (int)sizeof(args) - 12; i++) {
+        n += snprintf(args + n, sizeof(args) - n, "%s%08X", i ? " " : "", (unsigned)r->obj[i]);
+    }
+    snprintf(args + n, sizeof(args) - n, "\"");
+    instant(name, TID_PD_UFP, ns, args);
+}
+
+/* Turn the records PD_UFP_c wrote since the last call into events at time ns */
+static void drain_trace(uint64_t ns)
+{
+    static uint8_t image[PD_TRACE_IMAGE_HEADER_SIZE + TRACE_BUFFER_SIZE];
+    static const char * const timer_name[] = {"tTypeCSinkWaitCap", "tRequestToPSReady", "tPPSRequest"};
+    PD_trace_record_t r;
+    uint32_t offset = 0;
+    char args[80];
+    if (trace.used == 0) {
+        return;
+    }
+    uint16_t size = PD_trace_copy(&trace, image, sizeof(image));
+    PD_trace_clear(&trace);
+    while (PD_trace_next(image, size, &offset, &r)) {
+        switch (r.type) {
+        case PD_TRACE_CONFIG:
+            snprintf(args, sizeof(args), "\"power_option\":%u,\"PPS_mV\":%u,\"PPS_mA\":%u", (unsigned)r.power_option,
+                (unsigned)r.PPS_voltage * 20, (unsigned)r.PPS_current * 50);
+            instant("config", TID_PD_UFP, ns, args);
+            break;
+        case PD_TRACE_EVENT:
+            if ((r.events & FUSB302_EVENT_ATTACHED) && !attached) {
+                event_begin("B", "FUSB302_STATE_ATTACHED", TID_PD_UFP, ns);
+                printf("}");
+                attached = true;
+            }
+            if ((r.events & FUSB302_EVENT_DETACHED) && attached) {
+                event_begin("E", "FUSB302_STATE_ATTACHED", TID_PD_UFP, ns);
+                printf("}");
+                attached = false;
+            }
+            if (r.events & FUSB302_EVENT_TX_FAILED) {
+                instant("TX failed", TID_PD_UFP, ns, 0);
+            }
+            break;
+        case PD_TRACE_RX:
+        case PD_TRACE_TX:
+            emit_message(&r, ns);
+            break;
+        case PD_TRACE_HARD_RESET:
+            instant("TX Hard_Reset", TID_PD_UFP, ns, 0);
+            break;
+        case PD_TRACE_TIMER:
+            instant(r.timer <= PD_TRACE_TIMER_PPS_REQUEST ? timer_name[r.timer] : "timer", TID_PD_UFP, ns, 0);
+            break;
+        }
+    }
+}
+
+static void flush_pointer(void)
+{
+    if (pointer.active) {
+        char name[24];
+        snprintf(name, sizeof(name), "W %s", reg_name(pointer.reg));
+        span(name, TID_I2C, pointer.start_ns, pointer.end_ns, 0);
+        pointer.active = false;
+    }
+}
+
+static void i2c_observer(void * ctx, uint8_t address, bool read, const uint8_t * data, uint8_t count,
+    bool ack, uint64_t start_ns, uint64_t end_ns)
+{
+    char name[24], args[48];
+    drain_trace(start_ns);
+    if (!read && count == 1) {
+        /* Register pointer, the read that follows is the same access */
+        flush_pointer();
+        pointer.active = true;
+        pointer.reg = data[0];
+        pointer.start_ns = start_ns;
+        pointer.end_ns = end_ns;
+        return;
+    }
+    if (read) {
+        uint8_t reg = pointer.active ? pointer.reg : 0;
+        uint64_t start = pointer.active ? pointer.start_ns : start_ns;
+        pointer.active = false;
+        snprintf(name, sizeof(name), "R %s", reg_name(reg));
+        snprintf(args, sizeof(args), "\"bytes\":%u,\"ack\":%s", (unsigned)count, ack ? "true" : "false");
+        span(name, TID_I2C, start, end_ns, args);
+        return;
+    }
+    flush_pointer();
+    snprintf(name, sizeof(name), "W %s", count ? reg_name(data[0]) : "?");
+    snprintf(args, sizeof(args), "\"bytes\":%u,\"ack\":%s", count ? (unsigned)count - 1 : 0, ack ? "true" : "false");
+    span(name, TID_I2C, start_ns, end_ns, args);
+}
+
+/* delay_ms of the library, as a span on its own track */
+static void trace_delay_ms(uint32_t ms)
+{
+    uint64_t start = sim_time_ns();
+    drain_trace(start);
+    sim_delay_ms(ms);
+    span("delay_ms", TID_DELAY, start, sim_time_ns(), 0);
+}
+
+int main(int argc, char * argv[])
+{
+    const char * charger = argc > 1 ? argv[1] : "pps_45w";
+    uint32_t duration_ms = argc > 2 ? strtoul(argv[2], 0, 0) : DEFAULT_DURATION_MS;
+    const PD_source_profile_t * profile = PD_source_profile_find(charger);
+    PD_UFP_c sink;
+
+    if (profile == 0) {
+        fprintf(stderr, "unknown charger %s\n", charger);
+        return 1;
+    }
+    Sim_port_c port(profile);
+    PD_UFP_c::clock_source_set(sim_clock_ms, trace_delay_ms);
+    PD_trace_init(&trace, trace_buffer, sizeof(trace_buffer));
+    sink.trace_set(&trace);
+    port.connect();
+    Wire.set_observer(i2c_observer, 0);
+
+    printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"charger\":\"%s\",\"duration_ms\":%u},\"traceEvents\":[",
+        profile->name, (unsigned)duration_ms);
+    printf("\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"PD_UFP vs %s\"}}", profile->name);
+    separator = ",";
+    thread_name(TID_PD_UFP, "PD_UFP");
+    thread_name(TID_RUN, "run()");
+    thread_name(TID_DELAY, "delay_ms");
+    thread_name(TID_I2C, "I2C");
+
+    port.init(sink);
+    while (sim_clock_ms() < duration_ms) {
+        if (sim_clock_ms() == ATTACH_AT_MS) {
+            instant("VBUS attach", TID_PD_UFP, sim_time_ns(), 0);
+            port.source.attach();
+        }
+        port.source.run();
+        uint64_t start = sim_time_ns();
+        sink.run();
+        flush_pointer();
+        drain_trace(sim_time_ns());
+        if (sim_time_ns() != start) {
+            span("run", TID_RUN, start, sim_time_ns(), 0);
+        }
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+    if (attached) {
+        event_begin("E", "FUSB302_STATE_ATTACHED", TID_PD_UFP, sim_time_ns());
+        printf("}");
+    }
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+   -- PD Message Decode Benchmark --
+
+   Pushes captured and random message header / data object pairs through the protocol engine
+   in PD_UFP_Protocol and reports the host cost per call in ns:
+
+   - handle_msg         PD_protocol_handle_msg(), captured traffic and random headers
+   - get_msg_info       PD_protocol_get_msg_info(), random headers including reserved types
+   - get_power_info     PD_protocol_get_power_info() over every PDO of a Source_Capabilities
+   - evaluate_src_cap   PDO selection, through PD_protocol_set_power_option() and set_PPS()
+
+   Host numbers do not translate to the ESP32-C3 one to one, track them relative to the
+   previous release. The checksum only keeps the compiler from dropping the calls.
+
+   Build and run:
+     pio run -e decode -t exec
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <PD_UFP_Protocol.h>
+#include <PD_Source_Sim.h>
+
+#define DECODE_ITERATIONS   4000000UL
+
+typedef struct {
+    uint16_t header;
+    uint32_t obj[PD_PROTOCOL_MAX_NUM_OF_PDO];
+} decode_msg_t;
+
+/* Source to sink traffic captured from a PPS negotiation and keepalive, GoodCRC included */
+static const decode_msg_t captured[] = {
+    {0x51A1, {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 2250), PDO_PPS(3300, 21000, 2100)}},
+    {0x0041, {0}},      /* GoodCRC */
+    {0x0263, {0}},      /* Accept */
+    {0x0466, {0}},      /* PS_RDY */
+    {0x0241, {0}},      /* GoodCRC */
+    {0x61A1, {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 3000), PDO_FIXED(12000, 3000), PDO_FIXED(15000, 3000), PDO_FIXED(20000, 5000), PDO_PPS(3300, 21000, 5000)}},
+    {0x0A63, {0}},      /* Accept */
+    {0x0C66, {0}},      /* PS_RDY */
+    {0x0E64, {0}},      /* Reject */
+    {0x006C, {0}},      /* Wait */
+    {0xA28C, {0x8004, 0x0FFFF00}},  /* PPS_Status, extended */
+    {0x244F, {0xFF008001, 0x00000000}}, /* VDM Discover Identity */
+    {0x0687, {0}},      /* Get_Source_Cap */
+    {0x0848, {0}},      /* Get_Sink_Cap */
+    {0x0A4D, {0}},      /* Soft_Reset */
+    {0x31A1, {PDO_FIXED(5000, 3000), PDO_FIXED(9000, 2220), PDO_FIXED(12000, 1670)}},
+};
+
+#define NUM_OF_CAPTURED     (sizeof(captured) / sizeof(captured[0]))
+
+static uint32_t random_state = 0x12345678;
+
+static uint32_t random32(void)
+{
+    /* xorshift32, the same sequence on every run */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void init_protocol(PD_protocol_t * p)
+{
+    PD_protocol_init(p);
+    PD_protocol_set_power_option(p, PD_POWER_OPTION_MAX_20V);
+    PD_protocol_set_PPS(p, PPS_V(9.0), PPS_A(2.0), false);
+}
+
+static void report(const char * name, std::chrono::steady_clock::time_point start, unsigned long calls)
+{
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-28s %10lu calls %8.2f ns/call\n", name, calls, ns / calls);
+}
+
+int main(void)
+{
+    static decode_msg_t random_msg[4096];
+    PD_protocol_t p;
+    PD_protocol_event_t events;
+    uint32_t checksum = 0;
+
+    for (uint16_t i = 0; i < sizeof(random_msg) / sizeof(random_msg[0]); i++) {
+        random_msg[i].header = (uint16_t)random32();
+        for (uint8_t n = 0; n < PD_PROTOCOL_MAX_NUM_OF_PDO; n++) {
+            random_msg[i].obj[n] = random32();
+        }
+    }
+
+    init_protocol(&p);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < DECODE_ITERATIONS; i++) {
+        decode_msg_t m = captured[i % NUM_OF_CAPTURED];
+        events = 0;
+        PD_protocol_handle_msg(&p, m.header, m.obj, &events);
+        checksum += events + p.power_data_obj_selected;
+    }
+    report("handle_msg (captured)", start, DECODE_ITERATIONS);
+
+    init_protocol(&p);
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < DECODE_ITERATIONS; i++) {
+        decode_msg_t m = random_msg[i & 4095];
+        events = 0;
+        PD_protocol_handle_msg(&p, m.header, m.obj, &events);
+        checksum += events + p.power_data_obj_selected;
+    }
+    report("handle_msg (random)", start, DECODE_ITERATIONS);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < DECODE_ITERATIONS; i++) {
+        PD_msg_info_t info;
+        PD_protocol_get_msg_info(random_msg[i & 4095].header, &info);
+        checksum += info.name[0] + info.num_of_obj;
+    }
+    report("get_msg_info (random)", start, DECODE_ITERATIONS);
+
+    init_protocol(&p);
+    PD_protocol_handle_msg(&p, captured[5].header, (uint32_t *)captured[5].obj, 0);
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < DECODE_ITERATIONS; i++) {
+        PD_power_info_t info;
+        PD_protocol_get_power_info(&p, i % p.power_data_obj_count, &info);
+        checksum += info.max_v + info.max_i;
+    }
+    report("get_power_info", start, DECODE_ITERATIONS);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < DECODE_ITERATIONS / 2; i++) {
+        PD_protocol_set_power_option(&p, (enum PD_power_option_t)(i & 7));
+        checksum += p.power_data_obj_selected;
+        PD_protocol_set_PPS(&p, PPS_V(3.3) + (i & 511), PPS_A(1.0), false);
+        checksum += p.power_data_obj_selected;
+    }
+    report("evaluate_src_cap", start, DECODE_ITERATIONS);
+
+    printf("checksum %08x\n", (unsigned)checksum);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+   -- Rotating Fixture --
+
+   One port with chargers plugged in turn, the way a test fixture cycles them: each round
+   attaches every charger, waits until the sink is ready and detaches it. A new PD_UFP_c is made
+   for every attach, as after a reset of the controller, only the source capability cache
+   (PD_UFP_c::set_src_cache()) is kept from one attach to the next, as RTC memory would be.
+
+   The rounds run without and with the cache, per charger:
+
+   - cold      VBUS attach to ready in the first round, ms
+   - warm      Longest VBUS attach to ready of the later rounds, ms
+   - hrst      Hard Resets sent by the sink, all rounds
+   - hits      Attaches with the selection taken from the cache
+
+   A hit only saves the policy evaluation, warm equals cold for a source that advertises on its
+   own. Only the dock that needs a Hard Reset gets ready sooner, see PD_UFP_c::set_src_cache().
+
+   Then the controller restarts under a charger in a PPS contract, a new PD_UFP_c on the same
+   port, after the cache has learnt the dock that needs a Hard Reset: the sink must not send a
+   Hard Reset (power cycle the DUT) with the cache when it does not without.
+
+   Build and run:
+     pio run -e fixture -t exec
+
+   Exit code is 1 if a charger ends in another contract with the cache, or the restart sends
+   more Hard Resets with the cache.
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define ATTACH_TIMEOUT_MS   10000
+#define ROUNDS              5
+#define RESTART_RUN_MS      3000
+
+/* On the fixture in this order, fits the cache */
+static const char * const chargers[] = {
+    "pps_45w",
+    "pd3_65w_laptop",
+    "dock_late_pd",
+    "pps_25w",
+};
+#define NUM_OF_CHARGERS     (sizeof(chargers) / sizeof(chargers[0]))
+
+typedef struct {
+    uint32_t cold_ms;
+    uint32_t warm_ms;
+    uint32_t hard_resets;
+    uint32_t hits;
+    uint16_t mv;
+    uint16_t ma;
+} fixture_result_t;
+
+/* One attach until ready, return the time it took, 0 if never ready */
+static uint32_t attach_once(const char * charger, PD_src_cache_t * cache, fixture_result_t * result)
+{
+    Sim_port_c port(PD_source_profile_find(charger));
+    PD_UFP_c sink;
+    uint32_t time_attach, time_ready = 0;
+
+    sim_reset_time();
+    port.connect();
+    sink.set_src_cache(cache);
+    port.init(sink);
+
+    sim_advance_ns(10 * SIM_NS_PER_MS);
+    time_attach = sim_clock_ms();
+    port.source.attach();
+    while (sim_clock_ms() - time_attach < ATTACH_TIMEOUT_MS) {
+        port.run(sink);
+        if (port.source.get_contract().active && (sink.is_power_ready() || sink.is_PPS_ready())) {
+            time_ready = sim_clock_ms() - time_attach;
+            break;
+        }
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+    result->hard_resets += port.phy.get_stats().hard_reset_sent;
+    result->hits += sink.is_src_cached();
+    result->mv = port.source.get_contract().mv;
+    result->ma = port.source.get_contract().ma;
+    port.source.detach();
+    return time_ready;
+}
+
+/* Dock learnt, then a restart of the controller under a PPS contract, return the Hard Resets sent */
+static uint32_t restart_attached(PD_src_cache_t * cache)
+{
+    fixture_result_t dock;
+    Sim_port_c port(PD_source_profile_find("pps_45w"));
+    uint32_t hard_resets = 0;
+
+    memset(&dock, 0, sizeof(dock));
+    attach_once("dock_late_pd", cache, &dock);
+    sim_reset_time();
+    port.connect();
+    port.source.attach();
+    for (uint8_t boot = 0; boot < 2; boot++) {
+        PD_UFP_c sink;
+        sink.set_src_cache(cache);
+        port.init(sink);
+        if (boot == 1) {
+            hard_resets = port.phy.get_stats().hard_reset_sent;
+        }
+        port.run_for(sink, RESTART_RUN_MS);
+    }
+    hard_resets = port.phy.get_stats().hard_reset_sent - hard_resets;
+    port.source.detach();
+    return hard_resets;
+}
+
+static void run_fixture(PD_src_cache_t * cache, fixture_result_t * result)
+{
+    memset(result, 0, NUM_OF_CHARGERS * sizeof(fixture_result_t));
+    for (uint8_t round = 0; round < ROUNDS; round++) {
+        for (uint8_t i = 0; i < NUM_OF_CHARGERS; i++) {
+            uint32_t t = attach_once(chargers[i], cache, &result[i]);
+            if (round == 0) {
+                result[i].cold_ms = t;
+            } else if (t > result[i].warm_ms) {
+                result[i].warm_ms = t;
+            }
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    static PD_src_cache_t cache;    /* RTC_NOINIT_ATTR on ESP32, random at power on */
+    fixture_result_t none[NUM_OF_CHARGERS], cached[NUM_OF_CHARGERS];
+    uint8_t failed = 0;
+
+    memset(&cache, 0xA5, sizeof(cache));
+    PD_UFP_c::clock_source_set(sim_clock_ms, sim_delay_ms);
+    run_fixture(0, none);
+    run_fixture(&cache, cached);
+    uint32_t restart_none = restart_attached(0), restart_cached = restart_attached(&cache);
+
+    printf("%-16s %6s %6s %5s   %6s %6s %5s %5s %6s %6s %5s\n",
+        "charger", "cold", "warm", "hrst", "cold", "warm", "hrst", "hits", "mV", "mA", "same");
+    printf("%-16s %19s   %31s\n", "", "-- no cache --", "-- cache --");
+    for (uint8_t i = 0; i < NUM_OF_CHARGERS; i++) {
+        const fixture_result_t * n = &none[i], * c = &cached[i];
+        bool same = n->mv == c->mv && n->ma == c->ma;
+        failed |= !same;
+        printf("%-16s %6u %6u %5u   %6u %6u %5u %5u %6u %6u %5s\n", chargers[i],
+            (unsigned)n->cold_ms, (unsigned)n->warm_ms, (unsigned)n->hard_resets,
+            (unsigned)c->cold_ms, (unsigned)c->warm_ms, (unsigned)c->hard_resets, (unsigned)c->hits,
+            (unsigned)c->mv, (unsigned)c->ma, same ? "yes" : "NO");
+    }
+    failed |= restart_cached > restart_none;
+    printf("\nrestart under pps_45w: %u hard resets without the cache, %u with it %s\n",
+        (unsigned)restart_none, (unsigned)restart_cached, restart_cached > restart_none ? "NO" : "yes");
+    return failed;
+}
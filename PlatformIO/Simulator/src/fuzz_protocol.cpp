@@ -0,0 +1,143 @@
+/*
+   -- PD Protocol Fuzz Target --
+
+   libFuzzer entry point over the same protocol engine calls as decode.cpp. Each input is a
+   power option, a PPS setting, and a sequence of messages: a 16-bit header followed by as many
+   32-bit data objects as the header declares. Every message goes through
+   PD_protocol_handle_msg(), PD_protocol_get_msg_info() and PD_protocol_respond(), then every
+   PDO of the last Source_Capabilities is decoded, a Request is built and the extended messages
+   reassembled so far are decoded. The source capability cache is kept from one input to the
+   next, as RTC memory over resets.
+
+   libFuzzer (clang):
+     clang++ -g -O1 -fsanitize=fuzzer,address,undefined -I ../../src \
+       src/fuzz_protocol.cpp ../../src/PD_UFP_Protocol.cpp -o fuzz_protocol
+     ./fuzz_protocol -max_total_time=600
+
+   Without clang, PD_FUZZ_STANDALONE builds a driver that replays the files given on the
+   command line, or runs random inputs when there are none:
+     pio run -e fuzz -t exec
+   or with the sanitizers:
+     g++ -g -O1 -fsanitize=address,undefined -D PD_FUZZ_STANDALONE -I ../../src \
+       src/fuzz_protocol.cpp ../../src/PD_UFP_Protocol.cpp -o fuzz_protocol
+
+   License: MIT
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <PD_UFP_Protocol.h>
+
+static uint16_t read16(const uint8_t * data)
+{
+    return (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+}
+
+static uint32_t read32(const uint8_t * data)
+{
+    return (uint32_t)read16(data) | ((uint32_t)read16(data + 2) << 16);
+}
+
+static PD_src_cache_t src_cache;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+    PD_protocol_t p;
+    if (size < 4) {
+        return 0;
+    }
+    PD_protocol_init(&p);
+    PD_protocol_set_power_option(&p, (enum PD_power_option_t)(data[0] & 0x7));
+    PD_protocol_set_PPS(&p, read16(data + 1) & 0x7FF, data[3] & 0x7F, data[0] & 0x80);
+    PD_protocol_set_src_cache(&p, &src_cache);
+    data += 4;
+    size -= 4;
+
+    while (size >= 2) {
+        uint16_t header = read16(data), tx_header;
+        uint32_t obj[PD_PROTOCOL_MAX_NUM_OF_PDO], tx_obj[PD_PROTOCOL_MAX_NUM_OF_PDO];
+        uint8_t num_of_obj = (header >> 12) & 0x7;
+        PD_protocol_event_t events = 0;
+        PD_msg_info_t info;
+        data += 2;
+        size -= 2;
+        memset(obj, 0, sizeof(obj));
+        for (uint8_t i = 0; i < num_of_obj && size >= 4; i++) {
+            obj[i] = read32(data);
+            data += 4;
+            size -= 4;
+        }
+        PD_protocol_handle_msg(&p, header, obj, &events);
+        PD_protocol_get_msg_info(header, &info);
+        if (info.name == 0 || info.num_of_obj != num_of_obj) {
+            __builtin_trap();
+        }
+        memset(tx_obj, 0, sizeof(tx_obj));
+        PD_protocol_respond(&p, &tx_header, tx_obj);
+    }
+
+    for (uint8_t i = 0; i <= PD_PROTOCOL_MAX_NUM_OF_PDO; i++) {
+        PD_power_info_t info;
+        PD_protocol_get_power_info(&p, i, &info);
+    }
+    if (p.power_data_obj_count) {
+        uint16_t header;
+        if (PD_protocol_get_selected_power(&p) >= p.power_data_obj_count) {
+            __builtin_trap();
+        }
+        uint32_t obj[PD_PROTOCOL_MAX_NUM_OF_PDO];
+        PD_protocol_create_request(&p, &header, obj);
+    }
+    PPS_status_t PPS_status;
+    PD_src_cap_ext_t src_cap_ext;
+    PD_status_t status;
+    PD_mfg_info_t mfg_info;
+    PD_protocol_get_PPS_status(&p, &PPS_status);
+    PD_protocol_get_src_cap_ext(&p, &src_cap_ext);
+    PD_protocol_get_status(&p, &status);
+    if (PD_protocol_get_mfg_info(&p, &mfg_info) && strlen(mfg_info.name) >= sizeof(mfg_info.name)) {
+        __builtin_trap();
+    }
+    return 0;
+}
+
+#ifdef PD_FUZZ_STANDALONE
+#include <stdlib.h>
+
+#define FUZZ_RANDOM_RUNS    1000000UL
+
+int main(int argc, char * argv[])
+{
+    static uint8_t buf[4096];
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            FILE * f = fopen(argv[i], "rb");
+            if (f == 0) {
+                perror(argv[i]);
+                return 1;
+            }
+            size_t size = fread(buf, 1, sizeof(buf), f);
+            fclose(f);
+            LLVMFuzzerTestOneInput(buf, size);
+        }
+        printf("%d inputs replayed\n", argc - 1);
+        return 0;
+    }
+    uint32_t state = 0x2545F491;
+    for (unsigned long run = 0; run < FUZZ_RANDOM_RUNS; run++) {
+        size_t size = 4 + (run % 128);
+        for (size_t i = 0; i < size; i++) {
+            /* xorshift32 */
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            buf[i] = (uint8_t)state;
+        }
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    printf("%lu random inputs\n", FUZZ_RANDOM_RUNS);
+    return 0;
+}
+#endif
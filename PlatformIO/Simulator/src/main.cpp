@@ -0,0 +1,79 @@
+/*
+   -- PD Simulator --
+
+   Host (Linux) build of the PD sink library in /src against a register model of the FUSB302.
+   Nothing here runs on the Spark Analyzer: the Arduino core, Wire and the FUSB302 are replaced
+   by the stand-ins in lib/, and time is virtual, so a negotiation that takes seconds on the
+   board finishes in microseconds.
+
+   This example attaches a source that advertises Rp 3.0A on CC1 and 5V on VBUS but never
+   talks PD. The sink detects the attach, asks for source capabilities and finally hard
+   resets the port. The status log, the I2C cost of each phase and the per register I2C
+   profile of the whole run are printed.
+
+   Build and run:
+     pio run -e native -t exec
+
+   License: MIT
+*/
+
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <FUSB302_Sim.h>
+
+#define FUSB302_INT_PIN     10
+#define FUSB302_ADDRESS     0x22
+#define SIMULATION_TIME_MS  2000
+
+FUSB302_Sim_c FUSB302_sim;
+PD_UFP_Log_c PD_UFP(PD_LOG_LEVEL_VERBOSE);
+PD_UFP_i2c_profile_t i2c_profile;
+
+static void print_status_log(void)
+{
+    char buf[128];
+    /* status_log_readline() returns 0 on the call that formats a timestamp, keep pulling */
+    for (uint8_t i = 0; i < 32; i++) {
+        if (PD_UFP.status_log_readline(buf, sizeof(buf) - 1) > 0) {
+            fputs(buf, stdout);
+        }
+    }
+}
+
+static void print_bus_stats(const char * phase)
+{
+    const TwoWire_stats_t & bus = Wire.get_stats();
+    const FUSB302_sim_stats_t & dev = FUSB302_sim.get_stats();
+    printf("[%s] %u I2C transactions, %u bytes, %llu us on the bus, %u register reads, %u register writes\n",
+        phase, (unsigned)bus.transactions, (unsigned)bus.bytes, (unsigned long long)(bus.bus_time_ns / 1000),
+        (unsigned)dev.reg_reads, (unsigned)dev.reg_writes);
+    Wire.reset_stats();
+    FUSB302_sim.reset_stats();
+}
+
+int main(void)
+{
+    Wire.begin(1, 0);
+    Wire.setClock(400000);
+    Wire.attach(FUSB302_ADDRESS, &FUSB302_sim);
+    sim_attach_pin(FUSB302_INT_PIN, FUSB302_Sim_c::int_n_read, &FUSB302_sim);
+    PD_UFP_c::i2c_profile_set(&i2c_profile);
+
+    PD_UFP.init(FUSB302_INT_PIN, PD_POWER_OPTION_MAX_20V);
+    print_status_log();
+    print_bus_stats("init");
+
+    FUSB302_sim.set_cc(FUSB302_SIM_RP_3A0, FUSB302_SIM_RP_OPEN);
+    FUSB302_sim.set_vbus(5000);
+    while (millis() < SIMULATION_TIME_MS) {
+        PD_UFP.run();
+        print_status_log();
+        delay(1);
+    }
+    print_bus_stats("attach");
+    PD_UFP_c::i2c_profile_print(Serial);
+    return 0;
+}
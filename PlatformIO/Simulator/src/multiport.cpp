@@ -0,0 +1,123 @@
+/*
+   -- Multi-Port Rig --
+
+   Several PD sinks on one controller, the way a test rig runs N ports per MCU: each PD_UFP_c
+   has its own FUSB302, INT_N pin, charger and time source, set per instance with
+   set_i2c_transport() and set_clock_source().
+
+   Two I2C buses with two FUSB302 each, at 0x22 and 0x23, one transport per bus. All ports run
+   from the same loop for a minute, then every charger is run again on a port of its own and
+   the contract, power status and hard resets must be the same. Ready times differ by the time
+   the other ports hold the controller.
+
+   Build and run:
+     pio run -e multiport -t exec
+
+   Exit code is 1 if a port ends differently from its single-port run.
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_UFP_I2C.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define NUM_OF_PORTS        4
+#define RUN_TIME_MS         60000
+
+typedef struct {
+    const char * charger;
+    uint8_t bus;
+    uint8_t i2c_address;
+} port_config_t;
+
+typedef struct {
+    uint32_t time_ready_ms;
+    uint8_t ps_status;
+    uint16_t mv;
+    uint16_t ma;
+    uint32_t requests;
+    uint32_t hard_resets;
+} port_result_t;
+
+static const port_config_t ports[NUM_OF_PORTS] = {
+    {"pps_45w", 0, 0x22},
+    {"pd3_65w_laptop", 0, 0x23},
+    {"pd2_5v_3a", 1, 0x22},
+    {"pps_25w", 1, 0x23},
+};
+
+static TwoWire Wire1;
+
+/* Ports [first, first + count) from one loop, each on the bus and address of its config */
+static void run_ports(uint8_t first, uint8_t count, port_result_t * result)
+{
+    TwoWire * bus[] = {&Wire, &Wire1};
+    PD_UFP_I2C_Wire_c transport[] = {PD_UFP_I2C_Wire_c(Wire), PD_UFP_I2C_Wire_c(Wire1)};
+    Sim_port_c * port[NUM_OF_PORTS];
+    PD_UFP_c sink[NUM_OF_PORTS];
+
+    sim_reset_time();
+    for (uint8_t i = first; i < first + count; i++) {
+        const port_config_t * config = &ports[i];
+        /* One INT_N pin per port */
+        port[i] = new Sim_port_c(PD_source_profile_find(config->charger), SIM_PORT_INT_PIN + i,
+            config->i2c_address, *bus[config->bus]);
+        port[i]->connect();
+        sink[i].set_i2c_transport(&transport[config->bus], config->i2c_address);
+        sink[i].set_clock_source(sim_clock_ms, sim_delay_ms);
+        port[i]->init(sink[i]);
+        port[i]->source.attach();
+        memset(&result[i], 0, sizeof(port_result_t));
+    }
+    while (sim_clock_ms() < RUN_TIME_MS) {
+        for (uint8_t i = first; i < first + count; i++) {
+            port[i]->run(sink[i]);
+            if (result[i].time_ready_ms == 0 && (sink[i].is_power_ready() || sink[i].is_PPS_ready())) {
+                result[i].time_ready_ms = sim_clock_ms();
+            }
+        }
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+    for (uint8_t i = first; i < first + count; i++) {
+        const PD_source_contract_t & c = port[i]->source.get_contract();
+        result[i].ps_status = sink[i].get_ps_status();
+        result[i].mv = c.active ? c.mv : 0;
+        result[i].ma = c.active ? c.ma : 0;
+        result[i].requests = port[i]->source.get_stats().requests;
+        result[i].hard_resets = port[i]->source.get_stats().hard_resets;
+        delete port[i];
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    port_result_t rig[NUM_OF_PORTS], alone[NUM_OF_PORTS];
+    uint8_t failed = 0;
+
+    run_ports(0, NUM_OF_PORTS, rig);
+    for (uint8_t i = 0; i < NUM_OF_PORTS; i++) {
+        run_ports(i, 1, alone);
+    }
+
+    printf("%-4s %-16s %4s %5s %8s %8s %4s %6s %6s %5s %5s %5s\n",
+        "port", "charger", "bus", "addr", "ready", "alone", "pwr", "mV", "mA", "req", "hrst", "same");
+    for (uint8_t i = 0; i < NUM_OF_PORTS; i++) {
+        const port_result_t * r = &rig[i], * a = &alone[i];
+        bool same = r->ps_status == a->ps_status && r->mv == a->mv && r->ma == a->ma &&
+            r->hard_resets == a->hard_resets;
+        failed |= !same;
+        printf("%-4u %-16s %4u  0x%02X %8u %8u %4u %6u %6u %5u %5u %5s\n",
+            (unsigned)i, ports[i].charger, (unsigned)ports[i].bus, (unsigned)ports[i].i2c_address,
+            (unsigned)r->time_ready_ms, (unsigned)a->time_ready_ms, (unsigned)r->ps_status,
+            (unsigned)r->mv, (unsigned)r->ma, (unsigned)r->requests, (unsigned)r->hard_resets,
+            same ? "yes" : "NO");
+    }
+    return failed;
+}
@@ -0,0 +1,241 @@
+/*
+   -- PD Trace Replay --
+
+   Replays a binary trace recorded by PD_UFP_c (see src/PD_UFP_Trace.h) through a fresh
+   PD_protocol_t at full speed. Every message the engine would send is compared with the one
+   recorded on the device, so a field negotiation failure can be stepped through offline, and
+   the protocol engine cost is measured on real traffic.
+
+   The trace can come from a device, through PD_trace_copy(), or be recorded here from the
+   simulator against a charger profile.
+
+   Build and run:
+     pio run -e replay
+     .pio/build/replay/program -c pps_45w pps_45w.pdtr     record 20s against a charger profile
+     .pio/build/replay/program pps_45w.pdtr -v             replay, print every record
+
+   Exit code is 1 if the trace cannot be read or a message does not match.
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_UFP_Trace.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define RECORD_TIME_MS      20000
+#define TRACE_BUFFER_SIZE   16384
+#define REPLAY_MESSAGES     1000000UL
+
+typedef struct {
+    uint32_t records;
+    uint32_t messages;      /* RX and TX */
+    uint32_t mismatches;
+    uint32_t unexpected;    /* TX the engine would not have sent */
+} replay_stats_t;
+
+static int record(const char * charger, const char * path)
+{
+    static uint8_t buffer[TRACE_BUFFER_SIZE];
+    static uint8_t image[PD_TRACE_IMAGE_HEADER_SIZE + TRACE_BUFFER_SIZE];
+    const PD_source_profile_t * profile = PD_source_profile_find(charger);
+    PD_UFP_c sink;
+    PD_trace_t trace;
+
+    if (profile == 0) {
+        fprintf(stderr, "unknown charger %s\n", charger);
+        return 1;
+    }
+    Sim_port_c port(profile);
+    port.connect();
+    PD_trace_init(&trace, buffer, sizeof(buffer));
+    sink.trace_set(&trace);
+    port.init(sink);
+    port.source.attach();
+    port.run_for(sink, RECORD_TIME_MS);
+
+    uint16_t size = PD_trace_copy(&trace, image, sizeof(image));
+    FILE * f = fopen(path, "wb");
+    if (f == 0 || fwrite(image, 1, size, f) != size) {
+        perror(path);
+        return 1;
+    }
+    fclose(f);
+    printf("%s: %u bytes, %u records dropped\n", path, (unsigned)size, (unsigned)trace.dropped);
+    return 0;
+}
+
+static void print_record(const PD_trace_record_t * r, const char * note)
+{
+    static const char * const type_name[] = {"?", "CONFIG", "EVENT", "RX", "TX", "HRST", "TIMER"};
+    static const char * const timer_name[] = {"tTypeCSinkWaitCap", "tRequestToPSReady", "tPPSRequest"};
+    printf("%5u %-6s ", (unsigned)r->time, type_name[r->type <= PD_TRACE_TIMER ? r->type : 0]);
+    if (r->type == PD_TRACE_RX || r->type == PD_TRACE_TX) {
+        PD_msg_info_t info;
+        PD_protocol_get_msg_info(r->header, &info);
+        printf("%-12s %04X", info.name, (unsigned)r->header);
+        for (uint8_t i = 0; i < r->num_of_obj; i++) {
+            printf(" %08X", (unsigned)r->obj[i]);
+        }
+    } else if (r->type == PD_TRACE_EVENT) {
+        printf("%s%s%s%s%s%s%s%s", r->events & FUSB302_EVENT_ATTACHED ? "ATTACHED " : "",
+            r->events & FUSB302_EVENT_DETACHED ? "DETACHED " : "", r->events & FUSB302_EVENT_RX_SOP ? "RX_SOP " : "",
+            r->events & FUSB302_EVENT_GOOD_CRC_SENT ? "GOOD_CRC_SENT " : "", r->events & FUSB302_EVENT_TX_SENT ? "TX_SENT " : "",
+            r->events & FUSB302_EVENT_TX_FAILED ? "TX_FAILED " : "", r->events & FUSB302_EVENT_HARD_RESET_SENT ? "HARD_RESET_SENT " : "",
+            r->events & FUSB302_EVENT_HARD_RESET ? "HARD_RESET" : "");
+    } else if (r->type == PD_TRACE_CONFIG) {
+        printf("option %u PPS %umV %umA", (unsigned)r->power_option, (unsigned)r->PPS_voltage * 20, (unsigned)r->PPS_current * 50);
+    } else if (r->type == PD_TRACE_TIMER) {
+        printf("%s", r->timer <= PD_TRACE_TIMER_PPS_REQUEST ? timer_name[r->timer] : "?");
+    }
+    printf("%s\n", note);
+}
+
+static bool same_message(const PD_trace_record_t * r, uint16_t header, const uint32_t * obj)
+{
+    uint8_t num_of_obj = (header >> 12) & 0x7;
+    return r->header == header && memcmp(r->obj, obj, num_of_obj * sizeof(uint32_t)) == 0;
+}
+
+/* One pass over the trace, the way PD_UFP_c drives the protocol engine */
+static void replay(const uint8_t * image, uint32_t size, bool verbose, replay_stats_t * stats)
+{
+    PD_protocol_t p;
+    PD_trace_record_t r;
+    uint32_t offset = 0;
+    uint8_t events = 0;
+    uint16_t tx_header = 0;
+    uint32_t tx_obj[7];
+    bool tx_pending = false;
+    bool respond = false;
+
+    memset(stats, 0, sizeof(replay_stats_t));
+    PD_protocol_init(&p);
+    while (PD_trace_next(image, size, &offset, &r)) {
+        const char * note = "";
+        bool differs = false;
+        stats->records++;
+        if (respond && r.type != PD_TRACE_RX) {
+            /* One alert can drain several packets, GoodCRC sent answers the last one */
+            tx_pending = PD_protocol_respond(&p, &tx_header, tx_obj);
+            respond = false;
+        }
+        switch (r.type) {
+        case PD_TRACE_CONFIG:
+            PD_protocol_set_power_option(&p, (enum PD_power_option_t)r.power_option);
+            if (r.PPS_voltage) {
+                PD_protocol_set_PPS(&p, r.PPS_voltage, r.PPS_current, false);
+            }
+            break;
+        case PD_TRACE_EVENT:
+            events = r.events;
+            if (events & (FUSB302_EVENT_ATTACHED | FUSB302_EVENT_DETACHED | FUSB302_EVENT_HARD_RESET)) {
+                PD_protocol_reset(&p);
+            }
+            if (events & FUSB302_EVENT_TX_FAILED) {
+                PD_protocol_tx_failed(&p);
+            }
+            if ((events & FUSB302_EVENT_GOOD_CRC_SENT) && !(events & FUSB302_EVENT_RX_SOP)) {
+                tx_pending = PD_protocol_respond(&p, &tx_header, tx_obj);
+                events = 0;
+            }
+            break;
+        case PD_TRACE_RX:
+            stats->messages++;
+            PD_protocol_handle_msg(&p, r.header, r.obj, 0);
+            if (events & FUSB302_EVENT_GOOD_CRC_SENT) {
+                respond = true;
+            }
+            break;
+        case PD_TRACE_TX:
+            stats->messages++;
+            if (!tx_pending) {
+                /* Sent from the timer: Get_Source_Cap retry or Request */
+                if ((r.header & 0x801F) == 0x0007 && ((r.header >> 12) & 0x7) == 0) {
+                    PD_protocol_create_get_src_cap(&p, &tx_header);
+                    tx_pending = true;
+                } else if ((r.header & 0x801F) == 0x0002 && ((r.header >> 12) & 0x7) == 1) {
+                    PD_protocol_create_request(&p, &tx_header, tx_obj);
+                    tx_pending = true;
+                }
+            }
+            if (!tx_pending) {
+                stats->unexpected++;
+                note = "  <- not expected";
+            } else if (!same_message(&r, tx_header, tx_obj)) {
+                stats->mismatches++;
+                differs = true;
+                note = "  <- engine differs";
+            }
+            tx_pending = false;
+            break;
+        case PD_TRACE_HARD_RESET:
+            PD_protocol_reset(&p);
+            break;
+        case PD_TRACE_TIMER:
+            /* The message the timer sends, if any, follows as a TX record */
+            break;
+        }
+        if (verbose) {
+            print_record(&r, note);
+            if (differs) {
+                printf("      engine              %04X", (unsigned)tx_header);
+                for (uint8_t i = 0; i < ((tx_header >> 12) & 0x7); i++) {
+                    printf(" %08X", (unsigned)tx_obj[i]);
+                }
+                printf("\n");
+            }
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    static uint8_t image[1 << 20];
+    replay_stats_t stats;
+
+    if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+        return record(argv[2], argv[3]);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [-v]\n       %s -c <charger> <trace>\n", argv[0], argv[0]);
+        return 1;
+    }
+    FILE * f = fopen(argv[1], "rb");
+    if (f == 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint32_t size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    uint32_t offset = 0;
+    PD_trace_record_t r;
+    if (!PD_trace_next(image, size, &offset, &r)) {
+        fprintf(stderr, "%s: not a PD trace\n", argv[1]);
+        return 1;
+    }
+    replay(image, size, argc > 2 && strcmp(argv[2], "-v") == 0, &stats);
+    printf("%u records, %u messages, %u dropped on the device, %u mismatches, %u not expected\n",
+        (unsigned)stats.records, (unsigned)stats.messages, (unsigned)(image[6] | image[7] << 8),
+        (unsigned)stats.mismatches, (unsigned)stats.unexpected);
+
+    if (stats.messages) {
+        replay_stats_t s;
+        unsigned long passes = REPLAY_MESSAGES / stats.messages + 1;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < passes; i++) {
+            replay(image, size, false, &s);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("replay %.2f ns/message over %lu passes\n", ns / (passes * stats.messages), passes);
+    }
+    return stats.mismatches || stats.unexpected ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+   -- Timer Soak --
+
+   Drives the PD sink library from the simulation clock through PD_UFP_c::clock_source_set(),
+   so the long protocol timers run in virtual time and every run is reproducible:
+
+   - pps_keepalive      PPS contract held for 10 minutes, t_PPSRequest against tPPSTimeout
+   - src_cap_timeout    Type-C only source, t_TypeCSinkWaitCap expiry and Get_Source_Cap retries
+   - ps_rdy_timeout     Source answers Wait, t_RequestToPSReady expiry
+   - marginal_bus       PPS contract held for 10 minutes over an I2C bus with NACKs and a held
+                        SDA now and then, recovered in place without a hard reset
+   - reset_recovery     PPS contract held for 10 minutes while the source sends a Hard Reset or a
+                        Soft_Reset every 15s, the contract is restored after each (rcv, rcv_ms)
+   - pps_status         PPS contract held for 10 minutes with PPS_Status polled every second, the
+                        load goes over the PPS current at 5 minutes: PPS_Status received (psts)
+                        and the time until the sink sees current limit (cl_ms)
+   - pps_ramp           PPS contract held for 10 minutes, set_PPS() called on every loop pass the
+                        way a sketch does, the setting swings between 5V and 20V every 10s: the
+                        longest time from a new setting to is_PPS_settled() (ramp_ms)
+   - pps_ramp_apdo      As pps_ramp between 9V 2A and 5V 3A, the two ends on different APDOs:
+                        every step stays in a PPS contract
+   - tx_line_time       PPS contract held for 10 minutes with Get_Status sent by the sketch every
+                        97ms and 1.5ms from TX start to GoodCRC, so a keepalive Request now and
+                        then waits for the message on the line: none may reach the source with
+                        the MessageID of the previous one (retry)
+   - held_bus           PPS contract held for 10 minutes, the I2C bus held for 75ms from just
+                        before every keepalive Request, longer than a recovery takes to retry:
+                        the Request waits for the bus, the sink sends no Hard Reset (shrst)
+   - lost_request       PPS contract held for 10 minutes, every keepalive Request gets no GoodCRC
+                        after all retries: the sink sends a Soft_Reset (ssrst), the contract is
+                        restored without a Hard Reset
+   - lost_soft_reset    As lost_request, the Soft_Reset gets no GoodCRC either: a Hard Reset
+                        follows each one
+
+   Each scenario runs twice, the second run must match the first one exactly. A ramp must end
+   in the PPS contract, no scenario may have a retry, an I2C fault must not make the sink send a
+   Hard Reset. A Request without GoodCRC is followed by a Soft_Reset, a Hard Reset only if the
+   Soft_Reset is lost too.
+
+   Build and run:
+     pio run -e soak -t exec
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <PD_UFP.h>
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define KEEPALIVE_MS        5000    /* t_PPSRequest of the sink */
+#define TX_ATTEMPTS         4       /* N_RETRIES(3) of the sink FUSB302 */
+
+typedef struct {
+    const char * name;
+    const char * profile;
+    uint32_t duration_ms;
+    uint32_t nack_every;            /* I2C faults, in transactions, see TwoWire::set_faults() */
+    uint32_t stuck_every;
+    uint32_t reset_every_ms;        /* Source resets, hard and soft in turn, 0 for none */
+    uint16_t PPS_status_ms;         /* PPS_Status polling, 0 for none */
+    uint32_t overload_at_ms;        /* Load over the PPS current from then on, 0 for none */
+    uint32_t ramp_every_ms;         /* PPS setting between ramp[0] and ramp[1], 0 for none */
+    struct {
+        uint16_t voltage;
+        uint8_t current;
+    } ramp[2];
+    uint32_t status_every_ms;       /* request_status() from the sketch, 0 for none */
+    uint32_t tx_time_us;            /* FUSB302 TX start to GoodCRC, 0 at once, see FUSB302_Sim_c::set_tx_time() */
+    uint32_t hold_ms;               /* I2C bus held from 10ms before every keepalive Request, see TwoWire::hold() */
+    uint8_t drop_messages;          /* Sink messages without GoodCRC from every keepalive Request on */
+} soak_scenario_t;
+
+typedef struct {
+    uint32_t time_ready_ms;         /* Sink reports power ready, 0 if never */
+    uint8_t ps_status;
+    uint32_t requests;
+    uint32_t waits;
+    uint32_t max_request_interval_ms;
+    uint32_t pps_timeouts;
+    uint32_t hard_resets;
+    uint32_t sink_hard_resets;      /* Sent by the sink */
+    uint32_t sink_soft_resets;
+    uint32_t sink_tx;
+    uint32_t sink_tx_fail;
+    uint32_t i2c_transactions;
+    uint64_t i2c_bytes;
+    uint32_t i2c_errors;            /* Reads and writes failed as seen by the driver */
+    uint32_t bus_recoveries;
+    uint32_t reset_recoveries;      /* Contract back after a reset */
+    uint32_t max_reset_recovery_ms;
+    uint32_t PPS_status_sent;
+    uint32_t current_limit_ms;      /* Overload to OMF current limit seen by the sink, 0 if never */
+    uint32_t max_ramp_ms;           /* New PPS setting to is_PPS_settled() */
+    uint32_t retries;               /* Sink messages dropped by the source as a retry, same MessageID */
+} soak_result_t;
+
+static const soak_scenario_t scenarios[] = {
+    {"pps_keepalive", "pps_45w", 600000, 0, 0, 0},
+    {"src_cap_timeout", "typec_only_3a", 10000, 0, 0, 0},
+    {"ps_rdy_timeout", "wait_twice", 10000, 0, 0, 0},
+    {"marginal_bus", "pps_45w", 600000, 97, 1009, 0},
+    {"reset_recovery", "pps_45w", 600000, 0, 0, 15000},
+    {"pps_status", "pps_45w", 600000, 0, 0, 0, 1000, 300000},
+    {"pps_ramp", "pps_45w", 600000, 0, 0, 0, 0, 0, 10000, {{PPS_V(5.0), PPS_A(2.0)}, {PPS_V(20.0), PPS_A(2.0)}}},
+    {"pps_ramp_apdo", "pps_25w", 600000, 0, 0, 0, 0, 0, 10000, {{PPS_V(5.0), PPS_A(3.0)}, {PPS_V(9.0), PPS_A(2.0)}}},
+    {"tx_line_time", "pps_45w", 600000, 0, 0, 0, 0, 0, 0, {{0, 0}, {0, 0}}, 97, 1500},
+    {"held_bus", "pps_45w", 600000, 0, 0, 0, 0, 0, 0, {{0, 0}, {0, 0}}, 0, 0, 75},
+    {"lost_request", "pps_45w", 600000, 0, 0, 0, 0, 0, 0, {{0, 0}, {0, 0}}, 0, 0, 0, 1},
+    {"lost_soft_reset", "pps_45w", 600000, 0, 0, 0, 0, 0, 0, {{0, 0}, {0, 0}}, 0, 0, 0, 2},
+};
+
+/* Sink that keeps the time it is told about current limit */
+class Soak_sink_c : public PD_UFP_c
+{
+    public:
+        uint32_t time_current_limit_ms = 0;
+
+    protected:
+        virtual void status_PPS_changed(const PPS_status_t * status)
+        {
+            if (status->flag_OMF == PPS_OMF_CURRENT_LIMIT_MODE && time_current_limit_ms == 0) {
+                time_current_limit_ms = sim_clock_ms();
+            }
+        }
+};
+
+static void run_scenario(const soak_scenario_t * scenario, soak_result_t * result)
+{
+    Sim_port_c port(PD_source_profile_find(scenario->profile));
+    PD_Source_Sim_c & source = port.source;
+    Soak_sink_c sink;
+
+    memset(result, 0, sizeof(soak_result_t));
+    sim_reset_time();
+    port.connect();
+    Wire.set_faults(scenario->nack_every, scenario->stuck_every);
+    port.phy.set_tx_time(scenario->tx_time_us);
+    port.init(sink);
+    sink.set_PPS_status_polling(scenario->PPS_status_ms);
+
+    uint32_t time_reset = scenario->reset_every_ms, reset_count = 0;
+    uint32_t time_ramp = scenario->ramp_every_ms, ramp_count = 0, time_ramp_start = 0;
+    uint16_t PPS_voltage = PPS_V(9.0);
+    uint8_t PPS_current = PPS_A(2.0);
+    uint64_t time_hold = 0;
+    source.attach();
+    while (sim_clock_ms() < scenario->duration_ms) {
+        if (scenario->reset_every_ms && sim_clock_ms() >= time_reset) {
+            time_reset += scenario->reset_every_ms;
+            if (++reset_count & 1) {
+                source.inject_hard_reset();
+            } else {
+                source.inject_soft_reset();
+            }
+        }
+        if ((scenario->hold_ms || scenario->drop_messages) && source.get_contract().pps) {
+            uint64_t hold_ns = source.get_time_last_request() + (KEEPALIVE_MS - 10) * SIM_NS_PER_MS;
+            if (sim_time_ns() >= hold_ns && time_hold != hold_ns) {
+                time_hold = hold_ns;
+                if (scenario->hold_ms) {
+                    Wire.hold(scenario->hold_ms);
+                }
+                source.drop_rx(scenario->drop_messages * TX_ATTEMPTS);
+            }
+        }
+        if (scenario->overload_at_ms && sim_clock_ms() >= scenario->overload_at_ms) {
+            source.set_load(2500);      /* The sink asks for 2A */
+        }
+        if (scenario->ramp_every_ms && sim_clock_ms() >= time_ramp) {
+            time_ramp += scenario->ramp_every_ms;
+            time_ramp_start = sim_clock_ms();
+            ramp_count++;
+            PPS_voltage = scenario->ramp[ramp_count & 1].voltage;
+            PPS_current = scenario->ramp[ramp_count & 1].current;
+        }
+        if (scenario->status_every_ms && sim_clock_ms() % scenario->status_every_ms == 0) {
+            sink.request_status();
+        }
+        if (scenario->ramp_every_ms) {
+            sink.set_PPS(PPS_voltage, PPS_current);
+            if (time_ramp_start && sink.is_PPS_settled()) {
+                uint32_t ramp_ms = sim_clock_ms() - time_ramp_start;
+                if (ramp_ms > result->max_ramp_ms) {
+                    result->max_ramp_ms = ramp_ms;
+                }
+                time_ramp_start = 0;
+            }
+        }
+        port.run(sink);
+        if (result->time_ready_ms == 0 && (sink.is_power_ready() || sink.is_PPS_ready())) {
+            result->time_ready_ms = sim_clock_ms();
+        }
+        sim_advance_ns(SIM_NS_PER_MS);
+    }
+
+    const PD_source_stats_t & s = source.get_stats();
+    const FUSB302_sim_stats_t & p = port.phy.get_stats();
+    PD_UFP_health_t health;
+    PD_UFP_reset_stats_t resets;
+    sink.get_health(&health);
+    sink.get_reset_stats(&resets);
+    result->ps_status = sink.get_ps_status();
+    result->requests = s.requests;
+    result->waits = s.waits;
+    result->max_request_interval_ms = s.max_request_interval_ms;
+    result->pps_timeouts = s.pps_timeouts;
+    result->hard_resets = s.hard_resets;
+    result->sink_hard_resets = resets.hard_resets_sent;
+    result->sink_soft_resets = resets.soft_resets_sent;
+    result->sink_tx = p.tx_messages;
+    result->sink_tx_fail = p.tx_retry_fail;
+    result->i2c_transactions = Wire.get_stats().transactions;
+    result->i2c_bytes = Wire.get_stats().bytes;
+    result->i2c_errors = health.read_errors + health.write_errors;
+    result->bus_recoveries = health.bus_recoveries;
+    result->reset_recoveries = resets.recoveries;
+    result->max_reset_recovery_ms = resets.time_max_recovery;
+    result->PPS_status_sent = s.pps_status_sent;
+    result->retries = s.retries;
+    if (sink.time_current_limit_ms) {
+        result->current_limit_ms = sink.time_current_limit_ms - scenario->overload_at_ms;
+    }
+    Wire.set_faults(0, 0);
+}
+
+int main(int argc, char * argv[])
+{
+    uint8_t failed = 0;
+    PD_UFP_c::clock_source_set(sim_clock_ms, sim_delay_ms);
+
+    printf("%-16s %8s %6s %5s %5s %6s %7s %5s %6s %5s %5s %6s %6s %9s %6s %6s %5s %6s %5s %5s %7s %5s %8s %5s\n",
+        "scenario", "sim_ms", "ready", "pwr", "req", "wait", "max_ka", "ptmo", "hrst", "shrst", "ssrst",
+        "tx", "txfail", "i2c", "i2cerr", "recov", "rcv", "rcv_ms", "psts", "cl_ms", "ramp_ms", "retry", "wall_ms", "same");
+    for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const soak_scenario_t * scenario = &scenarios[i];
+        soak_result_t first, second;
+        if (argc > 1 && strcmp(argv[1], scenario->name) != 0) {
+            continue;
+        }
+        auto wall_start = std::chrono::steady_clock::now();
+        run_scenario(scenario, &first);
+        auto wall_end = std::chrono::steady_clock::now();
+        run_scenario(scenario, &second);
+        bool same = memcmp(&first, &second, sizeof(soak_result_t)) == 0;
+        failed |= !same;
+        /* A ramp ends in the PPS contract */
+        failed |= scenario->ramp_every_ms && (first.ps_status != STATUS_POWER_PPS || first.max_ramp_ms == 0);
+        /* Every sink message with a new MessageID, the phy retries only without GoodCRC */
+        failed |= first.retries != 0;
+        /* A bus fault is recovered in place, it does not power cycle the DUT */
+        failed |= (scenario->nack_every || scenario->stuck_every || scenario->hold_ms) && first.sink_hard_resets != 0;
+        /* A lost Request is a Soft_Reset, a Hard Reset only with the Soft_Reset lost too */
+        failed |= scenario->drop_messages && (first.sink_soft_resets == 0 ||
+            first.sink_hard_resets != (scenario->drop_messages > 1 ? first.sink_soft_resets : 0));
+        printf("%-16s %8u %6u %5u %5u %6u %7u %5u %6u %5u %5u %6u %6u %9u %6u %6u %5u %6u %5u %5u %7u %5u %8u %5s\n",
+            scenario->name, (unsigned)scenario->duration_ms, (unsigned)first.time_ready_ms,
+            (unsigned)first.ps_status, (unsigned)first.requests, (unsigned)first.waits,
+            (unsigned)first.max_request_interval_ms, (unsigned)first.pps_timeouts,
+            (unsigned)first.hard_resets, (unsigned)first.sink_hard_resets, (unsigned)first.sink_soft_resets,
+            (unsigned)first.sink_tx,
+            (unsigned)first.sink_tx_fail, (unsigned)first.i2c_transactions,
+            (unsigned)first.i2c_errors, (unsigned)first.bus_recoveries,
+            (unsigned)first.reset_recoveries, (unsigned)first.max_reset_recovery_ms,
+            (unsigned)first.PPS_status_sent, (unsigned)first.current_limit_ms, (unsigned)first.max_ramp_ms,
+            (unsigned)first.retries,
+            (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(wall_end - wall_start).count(),
+            same ? "yes" : "NO");
+    }
+    return failed;
+}
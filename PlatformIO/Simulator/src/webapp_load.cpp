@@ -0,0 +1,302 @@
+/*
+   -- Web App Load Test --
+
+   Builds the Web App firmware (../WebApp_PPS/src/main.cpp) unchanged against the host
+   stand-ins in lib/WebApp_Sim, with the PD sink library talking to a simulated PPS charger,
+   and drives its HTTP handlers with generated load in virtual time:
+
+   - endpoint flood     LOAD_FLOOD_CLIENTS clients on one endpoint, each sending its next
+                        request one round trip after the previous response
+   - dashboard sweep    1 to 128 open dashboards polling like data/index.html: /current every
+                        500ms, /get_voltage and /get_current every second, and a set action
+                        about every 30s
+
+   For every run it reports requests/s, p50/p99 latency from arrival to response, the longest
+   gap between two loop() calls, the longest gap between PPS Requests seen by the charger
+   (keepalive, tPPSTimeout is 15s) and the number of PPS timeouts (hard resets), so it shows
+   whether web load starves PD_UFP.run() into missing PPS keepalives.
+
+   Scheduling model of the ESP32-C3, single core: the async_tcp task runs at a higher priority
+   than loopTask, so a pending request is always served before loop() runs again. A request
+   costs the time given on the command line (network stack, parsing and response, not measured
+   here, default LOAD_REQUEST_COST_US), taken when its handler sends the response. loop() costs
+   its I2C time and ADC_READ_US per analogRead(). A request arriving during loop() waits for
+   loop() to return, the firmware would preempt it.
+
+   The env builds the firmware with LOOP_PROFILE, its /loop_profile table over the dashboard
+   sweep is printed at the end, in virtual time: http holds the request cost, current and adc
+   the ADC reads, loop also the I2C time of PD_UFP.run().
+
+   Build and run:
+     pio run -e webapp_load -t exec
+     .pio/build/webapp_load/program [request_cost_us]
+
+   License: MIT
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "../../WebApp_PPS/src/main.cpp"
+#ifdef LOOP_PROFILE
+#include "../../WebApp_PPS/src/loop_profile.cpp"
+#endif
+
+#include <PD_Source_Profiles.h>
+#include <Sim_Port.h>
+
+#define NS_PER_US               1000ULL
+#define NS_PER_MS               1000000ULL
+#define LOAD_CHARGER            "pps_45w"
+#define LOAD_REQUEST_COST_US    1500
+#define ADC_READ_US             30      /* analogRead() on the ESP32-C3, assumed */
+#define CLIENT_RTT_US           3000
+#define LOAD_FLOOD_CLIENTS      8
+#define LOAD_FLOOD_MS           20000
+#define LOAD_SWEEP_MS           60000
+#define LOAD_SWEEP_MAX          128
+#define LOAD_RECOVERY_MS        5000
+
+enum {
+    EP_CURRENT = 0,
+    EP_GET_VOLTAGE,
+    EP_GET_CURRENT,
+    EP_SET_VOLTAGE,
+    EP_SET_CURRENT,
+    EP_SET_OUTPUT,
+    NUM_OF_EP
+};
+
+static const char * const ep_path[NUM_OF_EP] = {
+    "/current", "/get_voltage", "/get_current", "/set_voltage", "/set_current", "/set_output"
+};
+
+/* A client timer: periodic (browser setInterval) or closed loop when period_ns is 0 */
+typedef struct {
+    uint64_t next_ns;
+    uint64_t period_ns;
+    uint8_t ep;
+    uint32_t seq;
+} load_timer_t;
+
+typedef struct {
+    uint64_t arrival_ns;
+    uint16_t timer;
+    uint8_t ep;
+    uint32_t seq;
+} load_request_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t double_sends;      /* Handler called send() more than once */
+    uint32_t errors;            /* Status other than 200 */
+    uint64_t max_loop_gap_ns;
+    uint64_t busy_ns;           /* Serving requests */
+    std::vector<uint32_t> latency_us;
+} load_result_t;
+
+static PD_Source_Sim_c * source;
+static uint64_t request_cost_ns = LOAD_REQUEST_COST_US * NS_PER_US;
+static uint32_t random_state = 0x2F6B1D35;
+
+static uint32_t random32(void)
+{
+    /* xorshift32, the same load on every run */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void make_url(char * url, int maxlen, uint8_t ep, uint32_t seq)
+{
+    /* Set values change every other request, so half of them repeat the current setting */
+    static const char * const volts[] = {"5.0", "5.4"};
+    static const char * const amps[] = {"2.0", "1.5"};
+    switch (ep) {
+    case EP_SET_VOLTAGE:    snprintf(url, maxlen, "%s?voltage=%s", ep_path[ep], volts[(seq >> 1) & 1]); break;
+    case EP_SET_CURRENT:    snprintf(url, maxlen, "%s?current=%s", ep_path[ep], amps[(seq >> 1) & 1]); break;
+    case EP_SET_OUTPUT:     snprintf(url, maxlen, "%s?output=%u", ep_path[ep], (unsigned)((seq >> 1) & 1)); break;
+    default:                snprintf(url, maxlen, "%s", ep_path[ep]); break;
+    }
+}
+
+static uint64_t next_timer_ns(const std::vector<load_timer_t> & timers)
+{
+    uint64_t next = UINT64_MAX;
+    for (const load_timer_t & t : timers) {
+        next = std::min(next, t.next_ns);
+    }
+    return next;
+}
+
+/* Run the firmware and the clients for duration_ms of virtual time */
+static void run_load(std::vector<load_timer_t> & timers, uint32_t duration_ms, load_result_t * result)
+{
+    std::deque<load_request_t> queue;
+    uint64_t end_ns = sim_time_ns() + duration_ms * NS_PER_MS;
+    uint64_t last_loop_ns = sim_time_ns();
+    uint64_t next_ns = next_timer_ns(timers);
+
+    while (sim_time_ns() < end_ns) {
+        uint64_t now = sim_time_ns();
+        source->run();
+        if (next_ns <= now) {
+            for (uint16_t i = 0; i < timers.size(); i++) {
+                load_timer_t & t = timers[i];
+                if (t.next_ns <= now) {
+                    queue.push_back({t.next_ns, i, t.ep, t.seq++});
+                    t.next_ns = t.period_ns ? t.next_ns + t.period_ns : UINT64_MAX;
+                }
+            }
+            next_ns = next_timer_ns(timers);
+        }
+
+        if (!queue.empty()) {
+            load_request_t r = queue.front();
+            char url[64];
+            queue.pop_front();
+            make_url(url, sizeof(url), r.ep, r.seq);
+            AsyncWebServerRequest request(url);
+            request.sim_set_cost(request_cost_ns);
+            server.sim_request(&request);
+            result->requests++;
+            result->busy_ns += request_cost_ns;
+            result->double_sends += request.sim_responses() > 1;
+            result->errors += request.sim_code() != 200;
+            result->latency_us.push_back((uint32_t)((sim_time_ns() - r.arrival_ns) / NS_PER_US));
+            if (timers[r.timer].period_ns == 0) {
+                timers[r.timer].next_ns = sim_time_ns() + CLIENT_RTT_US * NS_PER_US;
+                next_ns = std::min(next_ns, timers[r.timer].next_ns);
+            }
+        } else {
+            result->max_loop_gap_ns = std::max(result->max_loop_gap_ns, now - last_loop_ns);
+            last_loop_ns = now;
+            loop();
+        }
+    }
+    result->max_loop_gap_ns = std::max(result->max_loop_gap_ns, sim_time_ns() - last_loop_ns);
+}
+
+/* Replug the charger and idle until the PPS contract is back, so every run starts from the
+   same state. A sink starved through a Hard Reset can hold a stale contract until the next
+   tPPSTimeout, which would be charged to the following run */
+static void recover(void)
+{
+    std::vector<load_timer_t> none;
+    load_result_t idle = {};
+    source->detach();
+    run_load(none, 100, &idle);
+    source->attach();
+    run_load(none, LOAD_RECOVERY_MS, &idle);
+    source->reset_stats();
+}
+
+static uint32_t percentile_us(std::vector<uint32_t> & v, uint8_t p)
+{
+    if (v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(v.size() - 1) * p / 100];
+}
+
+static void print_header(const char * first)
+{
+    printf("%-14s %8s %8s %8s %6s %12s %12s %8s %6s %6s\n", first, "req/s", "p50 ms", "p99 ms",
+        "busy %", "loop gap ms", "keepalive ms", "timeouts", "double", "PPS");
+}
+
+static bool contract_is_PPS(void)
+{
+    const PD_source_contract_t & c = source->get_contract();
+    return c.active && c.pps;
+}
+
+static void print_result(const char * name, load_result_t * r, uint32_t duration_ms)
+{
+    const PD_source_stats_t & s = source->get_stats();
+    printf("%-14s %8.1f %8.2f %8.2f %6.1f %12.2f %12u %8u %6u %6s\n", name,
+        r->requests * 1000.0 / duration_ms,
+        percentile_us(r->latency_us, 50) / 1000.0, percentile_us(r->latency_us, 99) / 1000.0,
+        r->busy_ns * 100.0 / (duration_ms * NS_PER_MS), r->max_loop_gap_ns / 1e6,
+        (unsigned)s.max_request_interval_ms, (unsigned)s.pps_timeouts, (unsigned)r->double_sends,
+        contract_is_PPS() ? "yes" : "lost");
+}
+
+static void endpoint_flood(uint8_t ep)
+{
+    std::vector<load_timer_t> timers;
+    load_result_t result = {};
+    for (uint8_t i = 0; i < LOAD_FLOOD_CLIENTS; i++) {
+        timers.push_back({sim_time_ns() + random32() % (CLIENT_RTT_US * NS_PER_US), 0, ep, 0});
+    }
+    run_load(timers, LOAD_FLOOD_MS, &result);
+    print_result(ep_path[ep], &result, LOAD_FLOOD_MS);
+    recover();
+}
+
+static void dashboard_sweep(uint16_t dashboards)
+{
+    std::vector<load_timer_t> timers;
+    load_result_t result = {};
+    char name[16];
+    for (uint16_t i = 0; i < dashboards; i++) {
+        /* Browser timers start at page load, spread the page loads over the first second */
+        uint64_t start = sim_time_ns() + random32() % (1000 * NS_PER_MS);
+        timers.push_back({start + 500 * NS_PER_MS, 500 * NS_PER_MS, EP_CURRENT, 0});
+        timers.push_back({start + 1000 * NS_PER_MS, 1000 * NS_PER_MS, EP_GET_VOLTAGE, 0});
+        timers.push_back({start + 1000 * NS_PER_MS, 1000 * NS_PER_MS, EP_GET_CURRENT, 0});
+        timers.push_back({start + random32() % (30000 * NS_PER_MS), 30000 * NS_PER_MS,
+            (uint8_t)(EP_SET_VOLTAGE + i % 3), i});
+    }
+    run_load(timers, LOAD_SWEEP_MS, &result);
+    snprintf(name, sizeof(name), "%u", (unsigned)dashboards);
+    print_result(name, &result, LOAD_SWEEP_MS);
+    recover();
+}
+
+int main(int argc, char * argv[])
+{
+    const PD_source_profile_t * profile = PD_source_profile_find(LOAD_CHARGER);
+    if (argc > 1) {
+        request_cost_ns = strtoul(argv[1], 0, 0) * NS_PER_US;
+    }
+    Sim_port_c port(profile, usb_pd_int_pin);
+    source = &port.source;
+    port.connect();
+    sim_set_analog_read_ns(ADC_READ_US * NS_PER_US);
+
+    /* The firmware prints on every set request, keep the report readable */
+    Serial.sim_set_output(0);
+    setup();
+    source->attach();
+    recover();
+
+    printf("charger %s, request cost %u us, analogRead %u us, client round trip %u us\n",
+        profile->name, (unsigned)(request_cost_ns / NS_PER_US), ADC_READ_US, CLIENT_RTT_US);
+    printf("keepalive: longest gap between PPS Requests seen by the charger, tPPSTimeout is 15000ms\n\n");
+    printf("endpoint flood, %d clients, %ds each\n", LOAD_FLOOD_CLIENTS, LOAD_FLOOD_MS / 1000);
+    print_header("endpoint");
+    for (uint8_t ep = 0; ep < NUM_OF_EP; ep++) {
+        endpoint_flood(ep);
+    }
+    printf("\ndashboard sweep, %ds each\n", LOAD_SWEEP_MS / 1000);
+    print_header("dashboards");
+#ifdef LOOP_PROFILE
+    loop_profile_reset();
+#endif
+    for (uint16_t n = 1; n <= LOAD_SWEEP_MAX; n *= 2) {
+        dashboard_sweep(n);
+    }
+#ifdef LOOP_PROFILE
+    AsyncWebServerRequest request("/loop_profile");
+    server.sim_request(&request);
+    printf("\nloop profile over the dashboard sweep\n%s", request.sim_body().c_str());
+#endif
+    return 0;
+}
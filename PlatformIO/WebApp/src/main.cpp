@@ -101,7 +101,6 @@ void handleVoltageChange(AsyncWebServerRequest *request) {
     } else {
       request->send(200, "text/plain", "Voltage unchanged");
     }
-    request->send(200, "text/plain", String(voltage));
   } else {
     request->send(400, "text/plain", "Voltage parameter missing");
   }
@@ -39,6 +39,8 @@
 
 /* Measure : 04h */
 #define MEAS_VBUS       (0x01 << 6)
+#define MDAC_MASK       (0x3F << 0)
+#define MDAC_CC_2V1     49              /* power-on value, comparator on the measured CC at 2.1V */
 
 /* Control0 : 06h */
 #define TX_FLUSH        (0x01 << 6)
@@ -59,6 +61,7 @@
 #define ENSOP1          (0x01 << 0)
 
 /* Control2 : 08h */
+#define TOG_RD_ONLY     (0x01 << 5)
 #define WAKE_EN         (0x01 << 3)
 #define MODE_MASK       (0x03 << 1)
 #define MODE_DFP        (0x03 << 1)
@@ -185,6 +188,7 @@
 #define ADDRESS_MASK        0x0A
 #define ADDRESS_POWER       0x0B
 #define ADDRESS_RESET       0x0C
+#define ADDRESS_RESERVED    0x0D
 #define ADDRESS_MASKA       0x0E
 #define ADDRESS_MASKB       0x0F
 #define ADDRESS_STATUS0A    0x3C
@@ -231,11 +235,47 @@ enum FUSB302_transmit_data_tokens_t {
     TX_TOKEN_TXOFF   = 0xFE,
 };
 
+#define RX_TOKEN_MASK   0xE0
+#define RX_TOKEN_SOP    0xE0
+
 enum FUSB302_state_t {
     FUSB302_STATE_UNATTACHED = 0,
-    FUSB302_STATE_ATTACHED
+    FUSB302_STATE_ATTACHED,
+    FUSB302_STATE_ATTACH_WAIT_CC1,
+    FUSB302_STATE_ATTACH_WAIT_CC2,
+    FUSB302_STATE_TOGGLE
+};
+
+/* Attach detection, one STATUS0 read per sample. Rp must stay at the same level for
+   tCCDebounce, an open CC line for tPDDebounce (USB Type-C 2.0 Table 4-30) */
+#define t_CCSample      5
+#define t_CCDebounce    100
+#define t_PDDebounce    10
+#define CC_SAMPLE_NONE  0xFF
+
+enum FUSB302_tx_state_t {
+    FUSB302_TX_IDLE = 0,
+    FUSB302_TX_SOP,
+    FUSB302_TX_HARD_RESET
+};
+
+/* A 7 object message with 3 retries is on the line for about 8ms, later the interrupt was lost */
+#define t_TxTimeout     20
+
+enum FUSB302_hard_reset_t {
+    FUSB302_HARD_RESET_NONE = 0,
+    FUSB302_HARD_RESET_VBUS_ON,     /* VBUS not seen low yet */
+    FUSB302_HARD_RESET_VBUS_OFF     /* VBUS seen low, waiting for vSafe5V */
 };
 
+/* Reference: 7.1.5 Response to Hard Resets, tSafe0V (650ms) + tSrcRecover (1s) + tSrcTurnOn (275ms) */
+#define t_HardResetVbus 2000
+
+/* VBUS measurement, MDAC steps of 420mV with MEAS_VBUS, one successive approximation bit per
+   comparison, compared no earlier than t_MDACSettle after the MDAC write */
+#define MDAC_VBUS_STEP_MV   420
+#define t_MDACSettle        1
+
 #define FUSB302_ERR_MSG(s)  s
 
 #define REG_READ(addr, data, count) do { \
@@ -246,51 +286,132 @@ enum FUSB302_state_t {
     if (reg_write(dev, addr, data, count) != FUSB302_SUCCESS) { return FUSB302_ERR_WRITE_DEVICE; } \
 } while(0)
 
+/* Write every control register changed in reg_control since the last flush */
+#define REG_FLUSH() do { \
+    if (reg_flush(dev) != FUSB302_SUCCESS) { return FUSB302_ERR_WRITE_DEVICE; } \
+} while(0)
+
+/* A burst continues over up to this many unchanged registers, cheaper than a new transaction */
+#define REG_FLUSH_MAX_GAP   2
+
 static inline FUSB302_ret_t reg_read(FUSB302_dev_t *dev, uint8_t address, uint8_t *data, uint8_t count)
 {
-    FUSB302_ret_t ret = dev->i2c_read(dev->i2c_address, address, data, count);
+    FUSB302_ret_t ret = dev->i2c_read(dev->ctx, dev->i2c_address, address, data, count);
     if (ret != FUSB302_SUCCESS) {
         dev->err_msg = FUSB302_ERR_MSG("Fail to read register");
+        dev->errors.read++;
     }
     return ret;
 }
 
 static inline FUSB302_ret_t reg_write(FUSB302_dev_t *dev, uint8_t address, uint8_t *data, uint8_t count)
 {
-    FUSB302_ret_t ret = dev->i2c_write(dev->i2c_address, address, data, count);
+    FUSB302_ret_t ret = dev->i2c_write(dev->ctx, dev->i2c_address, address, data, count);
     if (ret != FUSB302_SUCCESS) {
         dev->err_msg = FUSB302_ERR_MSG("Fail to write register");
+        dev->errors.write++;
     }
     return ret;
 }
 
-static FUSB302_ret_t FUSB302_read_cc_lvl(FUSB302_dev_t *dev, uint8_t * cc_value)
+static FUSB302_ret_t reg_flush(FUSB302_dev_t *dev)
 {
-    /*  00: < 200 mV          : vRa
-        01: >200 mV, <660 mV  : vRd-USB
-        10: >660 mV, <1.23 V  : vRd-1.5
-        11: >1.23 V           : vRd-3.0  */
-    uint8_t cc, cc_verify;
-    REG_READ(ADDRESS_STATUS0, &REG_STATUS0, 1);
-    cc = REG_STATUS0 & BC_LVL_MASK;
-    for (uint8_t i = 0; i < 5; i++) {
-        REG_READ(ADDRESS_STATUS0, &REG_STATUS0, 1);
-        cc_verify = REG_STATUS0 & BC_LVL_MASK;
-        if (cc != cc_verify) {
-            return FUSB302_BUSY;
+    const uint8_t reset = ADDRESS_RESET - ADDRESS_DEVICE_ID;
+    uint8_t i = 0;
+    while (i < sizeof(dev->reg_control)) {
+        if (dev->reg_control[i] == dev->reg_written[i]) {
+            i++;
+            continue;
         }
+        /* merge the changed registers that follow into one burst, never rewrite RESET */
+        uint8_t last = i;
+        for (uint8_t j = i + 1; j < sizeof(dev->reg_control) && j - last <= REG_FLUSH_MAX_GAP + 1 && j != reset; j++) {
+            if (dev->reg_control[j] != dev->reg_written[j]) {
+                last = j;
+            }
+        }
+        uint8_t count = last - i + 1;
+        if (reg_write(dev, ADDRESS_DEVICE_ID + i, &dev->reg_control[i], count) != FUSB302_SUCCESS) {
+            return FUSB302_ERR_WRITE_DEVICE;
+        }
+        memcpy(&dev->reg_written[i], &dev->reg_control[i], count);
+        i = last + 1;
     }
-    *cc_value = cc;
-	return FUSB302_SUCCESS;
+    return FUSB302_SUCCESS;
+}
+
+static uint32_t FUSB302_clock_ms(FUSB302_dev_t *dev)
+{
+    /* Without a clock every call is one sample interval */
+    return dev->clock_ms ? dev->clock_ms(dev->ctx) : dev->time_cc_sample + t_CCSample;
+}
+
+static void FUSB302_debounce_cc(FUSB302_dev_t *dev, uint8_t state)
+{
+    /* The first sample is taken t_CCSample after switching, the comparator has settled */
+    dev->cc_sample = CC_SAMPLE_NONE;
+    dev->time_cc_sample = FUSB302_clock_ms(dev);
+    dev->state = state;
+}
+
+static uint32_t FUSB302_crc32(uint32_t crc, const uint8_t *data, uint8_t count)
+{
+    /* USB PD CRC-32, reflected, only for packets read after a FIFO read failed */
+    while (count--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+static FUSB302_ret_t FUSB302_rx_flush(FUSB302_dev_t *dev)
+{
+    /* packet boundary lost, drop what is left, the packets already queued are kept */
+    uint8_t rx_flush = REG_CONTROL1 | RX_FLUSH;
+    dev->errors.rx_sync++;
+    dev->rx_check = 0;
+    REG_STATUS1 |= RX_EMPTY;
+    REG_WRITE(ADDRESS_CONTROL1, &rx_flush, 1);
+    return FUSB302_SUCCESS;
 }
 
 static FUSB302_ret_t FUSB302_read_incoming_packet(FUSB302_dev_t *dev, FUSB302_event_t * events)
 {
-    uint8_t len, b[3];
-    REG_READ(ADDRESS_FIFOS, b, 3);
-    dev->rx_header = ((uint16_t)b[2] << 8) | b[1];
-    len = (dev->rx_header >> 12) & 0x7;
-    REG_READ(ADDRESS_FIFOS, dev->rx_buffer, len * 4 + 4);  /* add 4 to len to read CRC out */
+    /* token, header and the next 4 bytes, every packet has at least its CRC after the header,
+       so a control message is read in one transaction */
+    FUSB302_rx_msg_t * msg = &dev->rx_queue[(dev->rx_head + dev->rx_count) & (FUSB302_RX_QUEUE_SIZE - 1)];
+    uint8_t len, b[7];
+    /* A failed FIFO read is tried again. A NACK left the FIFO as it was, a transfer cut short
+       did not: the next packet is then checked against its CRC, also when the retry fails and
+       the FIFO is read again by the next alert */
+    if (reg_read(dev, ADDRESS_FIFOS, b, 7) != FUSB302_SUCCESS) {
+        dev->rx_check = 1;
+        REG_READ(ADDRESS_FIFOS, b, 7);
+    }
+    if ((b[0] & RX_TOKEN_MASK) != RX_TOKEN_SOP) {
+        dev->err_msg = FUSB302_ERR_MSG("RX FIFO out of sync");
+        return FUSB302_rx_flush(dev);
+    }
+    msg->header = ((uint16_t)b[2] << 8) | b[1];
+    len = (msg->header >> 12) & 0x7;
+    memcpy(msg->obj, &b[3], 4);
+    if (len && reg_read(dev, ADDRESS_FIFOS, (uint8_t *)msg->obj + 4, len * 4) != FUSB302_SUCCESS) {
+        dev->rx_check = 1;
+        REG_READ(ADDRESS_FIFOS, (uint8_t *)msg->obj + 4, len * 4);  /* rest of data and CRC */
+    }
+    if (dev->rx_check) {
+        const uint8_t * crc_rx = (const uint8_t *)msg->obj + len * 4;
+        uint32_t crc = ~FUSB302_crc32(FUSB302_crc32(0xFFFFFFFF, &b[1], 2), (const uint8_t *)msg->obj, len * 4);
+        dev->rx_check = 0;
+        if (crc_rx[0] != (uint8_t)crc || crc_rx[1] != (uint8_t)(crc >> 8) ||
+            crc_rx[2] != (uint8_t)(crc >> 16) || crc_rx[3] != (uint8_t)(crc >> 24)) {
+            dev->err_msg = FUSB302_ERR_MSG("RX packet CRC error");
+            return FUSB302_rx_flush(dev);
+        }
+    }
+    dev->rx_count++;
 
     if (events) {
         *events |= FUSB302_EVENT_RX_SOP;
@@ -298,58 +419,194 @@ static FUSB302_ret_t FUSB302_read_incoming_packet(FUSB302_dev_t *dev, FUSB302_ev
     return FUSB302_SUCCESS;
 }
 
+static void FUSB302_unattached(FUSB302_dev_t *dev)
+{
+    REG_SWITCHES1 = SPECREV0;
+    REG_MEASURE = MDAC_CC_2V1;
+    if (dev->toggle) {
+        /* the toggle logic drives the CC switches from the internal oscillator, Rd only */
+        REG_SWITCHES0 = 0;
+        REG_CONTROL2 = (REG_CONTROL2 & ~MODE_MASK) | MODE_UFP | TOG_RD_ONLY | TOGGLE;
+        REG_POWER = PWR_BANDGAP | PWR_RECEIVER | PWR_MEASURE | PWR_INT_OSC;
+        dev->state = FUSB302_STATE_TOGGLE;
+    } else {
+        /* reset cc pins to pull down, turn off internal oscillator */
+        REG_SWITCHES0 = PDWN1 | PDWN2;
+        REG_POWER = PWR_BANDGAP | PWR_RECEIVER | PWR_MEASURE;
+        dev->state = FUSB302_STATE_UNATTACHED;
+    }
+}
+
+static FUSB302_ret_t FUSB302_attach(FUSB302_dev_t *dev, FUSB302_event_t * events)
+{
+    dev->interrupta = 0;
+    dev->interruptb = 0;
+    dev->tx_state = FUSB302_TX_IDLE;
+    dev->rx_count = 0;
+    dev->rx_check = 0;
+    dev->hard_reset = FUSB302_HARD_RESET_NONE;
+    REG_STATUS1 |= RX_EMPTY;
+
+    /* enable tx on cc pin */
+    if (dev->cc1 > 0) {
+        REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC1;
+        REG_SWITCHES1 = SPECREV0 | AUTO_CRC | TXCC1;
+        //REG_SWITCHES1 = SPECREV0 | TXCC1;
+    } else if (dev->cc2 > 0) {
+        REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC2;
+        REG_SWITCHES1 = SPECREV0 | AUTO_CRC | TXCC2;
+        //REG_SWITCHES1 = SPECREV0 | TXCC2;
+    } else {
+        REG_SWITCHES0 = PDWN1 | PDWN2;
+        REG_SWITCHES1 = SPECREV0;
+    }
+    REG_FLUSH();
+
+    /* update state */
+    dev->state = FUSB302_STATE_ATTACHED;
+    if (events) {
+        *events |= FUSB302_EVENT_ATTACHED;
+    }
+    return FUSB302_SUCCESS;
+}
+
 static FUSB302_ret_t FUSB302_state_unattached(FUSB302_dev_t *dev, FUSB302_event_t * events)
 {
     REG_READ(ADDRESS_STATUS0, &REG_STATUS0, 1);
     if (REG_STATUS0 & VBUSOK) {
-        /* enable internal oscillator */
+        /* enable internal oscillator, measure cc1 */
         REG_POWER = PWR_BANDGAP | PWR_RECEIVER | PWR_MEASURE | PWR_INT_OSC;
-        REG_WRITE(ADDRESS_POWER, &REG_POWER, 1);
-        dev->delay_ms(1);
-
-        /* read cc1 */
         REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC1;
         REG_SWITCHES1 = SPECREV0;
-        REG_MEASURE = 49;
-        REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 3);
-        dev->delay_ms(1);
-        while (FUSB302_read_cc_lvl(dev, &dev->cc1) != FUSB302_SUCCESS) {
-            dev->delay_ms(1);
-        }
-
-        /* read cc2 */
-        REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC2;
-        REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 1);
-        dev->delay_ms(1);
-        while (FUSB302_read_cc_lvl(dev, &dev->cc2) != FUSB302_SUCCESS) {
-            dev->delay_ms(1);
-        }
+        REG_MEASURE = MDAC_CC_2V1;
+        REG_FLUSH();
+        FUSB302_debounce_cc(dev, FUSB302_STATE_ATTACH_WAIT_CC1);
+    }
+    return FUSB302_SUCCESS;
+}
 
-        /* clear interrupt */
-        REG_READ(ADDRESS_INTERRUPTA, &REG_INTERRUPTA, 2);
-        dev->interrupta = 0;
-        dev->interruptb = 0;        
-
-        /* enable tx on cc pin */
-        if (dev->cc1 > 0) {
-            REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC1;
-            REG_SWITCHES1 = SPECREV0 | AUTO_CRC | TXCC1;
-            //REG_SWITCHES1 = SPECREV0 | TXCC1;
-        } else if (dev->cc2 > 0) {
+static FUSB302_ret_t FUSB302_state_attach_wait(FUSB302_dev_t *dev, FUSB302_event_t * events)
+{
+    /*  00: < 200 mV          : vRa
+        01: >200 mV, <660 mV  : vRd-USB
+        10: >660 mV, <1.23 V  : vRd-1.5
+        11: >1.23 V           : vRd-3.0  */
+    uint32_t t = FUSB302_clock_ms(dev);
+    uint8_t cc;
+    if (t - dev->time_cc_sample < t_CCSample) {
+        return FUSB302_SUCCESS;
+    }
+    REG_READ(ADDRESS_STATUS0, &REG_STATUS0, 1);
+    dev->time_cc_sample = t;    /* a failed read is sampled again on the next call */
+    if ((REG_STATUS0 & VBUSOK) == 0 && dev->toggle == 0) {
+        /* VBUS gone before cc settled */
+        FUSB302_unattached(dev);
+        REG_FLUSH();
+        return FUSB302_SUCCESS;
+    }
+    cc = REG_STATUS0 & BC_LVL_MASK;
+    if (cc != dev->cc_sample) {
+        dev->cc_sample = cc;
+        dev->time_cc_change = t;
+        return FUSB302_SUCCESS;
+    }
+    if (t - dev->time_cc_change < (cc ? t_CCDebounce : t_PDDebounce)) {
+        return FUSB302_SUCCESS;
+    }
+    if (dev->state == FUSB302_STATE_ATTACH_WAIT_CC1) {
+        dev->cc1 = cc;
+        if (dev->toggle == 0) {
+            /* measure cc2 */
             REG_SWITCHES0 = PDWN1 | PDWN2 | MEAS_CC2;
-            REG_SWITCHES1 = SPECREV0 | AUTO_CRC | TXCC2;
-            //REG_SWITCHES1 = SPECREV0 | TXCC2;
-        } else {
-            REG_SWITCHES0 = PDWN1 | PDWN2;
-            REG_SWITCHES1 = SPECREV0;
+            REG_FLUSH();
+            FUSB302_debounce_cc(dev, FUSB302_STATE_ATTACH_WAIT_CC2);
+            return FUSB302_SUCCESS;
         }
-        REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 2);
-
-        /* update state */
-        dev->state = FUSB302_STATE_ATTACHED;
-        if (events) {
-            *events |= FUSB302_EVENT_ATTACHED;
+    } else {
+        dev->cc2 = cc;
+    }
+    if (dev->toggle) {
+        /* only the line the toggle logic found Rp on is measured */
+        if (cc == 0) {
+            /* Rp gone before VBUS, toggle again */
+            FUSB302_unattached(dev);
+            REG_FLUSH();
+            return FUSB302_SUCCESS;
         }
+        if ((REG_STATUS0 & VBUSOK) == 0) {
+            return FUSB302_SUCCESS;     /* the source turns VBUS on once it has seen Rd */
+        }
+    }
+
+    /* clear interrupt */
+    REG_READ(ADDRESS_INTERRUPTA, &REG_INTERRUPTA, 2);
+    return FUSB302_attach(dev, events);
+}
+
+static FUSB302_ret_t FUSB302_state_toggle(FUSB302_dev_t *dev, FUSB302_event_t * events)
+{
+    /* One read for the toggle result, it also clears every interrupt */
+    REG_READ(ADDRESS_STATUS0A, &REG_STATUS0A, 7);
+    uint8_t togss = REG_STATUS1A & TOGSS_MASK;
+    if (togss != TOGSS_SNK1 && togss != TOGSS_SNK2) {
+        return FUSB302_SUCCESS;     /* still toggling */
+    }
+    /* Rp found, the toggle logic only gives the orientation. Stop toggling, keep Rd on both
+       lines and debounce the one with Rp as the polled attach does */
+    REG_CONTROL2 &= ~TOGGLE;
+    REG_SWITCHES0 = PDWN1 | PDWN2 | (togss == TOGSS_SNK1 ? MEAS_CC1 : MEAS_CC2);
+    REG_FLUSH();
+    dev->cc1 = 0;
+    dev->cc2 = 0;
+    FUSB302_debounce_cc(dev, togss == TOGSS_SNK1 ? FUSB302_STATE_ATTACH_WAIT_CC1 : FUSB302_STATE_ATTACH_WAIT_CC2);
+    return FUSB302_SUCCESS;
+}
+
+static void FUSB302_hard_reset_start(FUSB302_dev_t *dev)
+{
+    if (dev->clock_ms) {
+        dev->hard_reset = FUSB302_HARD_RESET_VBUS_ON;
+        dev->time_hard_reset = dev->clock_ms(dev->ctx);
+    }
+}
+
+static void FUSB302_hard_reset_vbus(FUSB302_dev_t *dev)
+{
+    if ((REG_STATUS0 & VBUSOK) == 0) {
+        dev->hard_reset = FUSB302_HARD_RESET_VBUS_OFF;
+    } else if (dev->hard_reset == FUSB302_HARD_RESET_VBUS_OFF) {
+        dev->hard_reset = FUSB302_HARD_RESET_NONE;     /* back at vSafe5V */
+        return;
+    }
+    if (dev->clock_ms(dev->ctx) - dev->time_hard_reset > t_HardResetVbus) {
+        dev->hard_reset = FUSB302_HARD_RESET_NONE;     /* VBUS not back, a detach with vbus_sense */
+    }
+}
+
+static FUSB302_ret_t FUSB302_tx_complete(FUSB302_dev_t *dev, FUSB302_event_t * events)
+{
+    FUSB302_event_t event = 0;
+    if (dev->interrupta & I_HARDSENT) {
+        event = FUSB302_EVENT_HARD_RESET_SENT;
+    } else if (dev->interrupta & I_TXSENT) {
+        event = FUSB302_EVENT_TX_SENT;
+    } else if (dev->interrupta & I_RETRYFAIL) {
+        event = FUSB302_EVENT_TX_FAILED;
+    } else if (dev->clock_ms && dev->clock_ms(dev->ctx) - dev->time_tx > t_TxTimeout) {
+        event = FUSB302_EVENT_TX_FAILED;
+    } else {
+        return FUSB302_SUCCESS;
+    }
+    dev->interrupta &= ~(I_HARDSENT | I_TXSENT | I_RETRYFAIL);
+    if (dev->tx_state == FUSB302_TX_HARD_RESET) {
+        /* hard reset is on the line, reset the PD logic */
+        uint8_t reg_control = PD_RESET;
+        REG_WRITE(ADDRESS_RESET, &reg_control, 1);
+        FUSB302_hard_reset_start(dev);
+    }
+    dev->tx_state = FUSB302_TX_IDLE;
+    if (events) {
+        *events |= event;
     }
     return FUSB302_SUCCESS;
 }
@@ -359,27 +616,37 @@ static FUSB302_ret_t FUSB302_state_attached(FUSB302_dev_t *dev, FUSB302_event_t
     REG_READ(ADDRESS_STATUS0A, &REG_STATUS0A, 7);
     dev->interrupta |= REG_INTERRUPTA;
     dev->interruptb |= REG_INTERRUPTB;    
-    if (dev->vbus_sense && ((REG_STATUS0 & VBUSOK) == 0)) {
-        /* reset cc pins to pull down */
-        REG_SWITCHES0 = PDWN1 | PDWN2;
-        REG_SWITCHES1 = SPECREV0;
-        REG_MEASURE = 49;
-        REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 3);
-
-        /* turn off internal oscillator */
-        REG_POWER = PWR_BANDGAP | PWR_RECEIVER | PWR_MEASURE;
-        REG_WRITE(ADDRESS_POWER, &REG_POWER, 1);
+    if (dev->tx_state != FUSB302_TX_IDLE) {
+        if (FUSB302_tx_complete(dev, events) != FUSB302_SUCCESS) {
+            return FUSB302_ERR_WRITE_DEVICE;
+        }
+    }
+    if (dev->hard_reset) {
+        FUSB302_hard_reset_vbus(dev);
+    }
+    if (dev->vbus_sense && dev->hard_reset == FUSB302_HARD_RESET_NONE && ((REG_STATUS0 & VBUSOK) == 0)) {
+        FUSB302_unattached(dev);
+        REG_FLUSH();
 
         /* update state */
-        dev->state = FUSB302_STATE_UNATTACHED;
+        dev->tx_state = FUSB302_TX_IDLE;
+        dev->rx_count = 0;
+        dev->rx_check = 0;
+        dev->vbus_bit = 0;
         if (events) {
             *events |= FUSB302_EVENT_DETACHED;
         }
         return FUSB302_SUCCESS;
     }
     if (REG_STATUS0A & HARDRST) {
+        /* the source reset, a transmission in progress is dropped */
         uint8_t reg_control = PD_RESET;
         REG_WRITE(ADDRESS_RESET, &reg_control, 1);
+        dev->tx_state = FUSB302_TX_IDLE;
+        FUSB302_hard_reset_start(dev);
+        if (events) {
+            *events |= FUSB302_EVENT_HARD_RESET;
+        }
         return FUSB302_SUCCESS;
     }
     if (dev->interruptb & I_GCRCSENT) {
@@ -388,11 +655,14 @@ static FUSB302_ret_t FUSB302_state_attached(FUSB302_dev_t *dev, FUSB302_event_t
             *events |= FUSB302_EVENT_GOOD_CRC_SENT;
         }
     }
-    if ((REG_STATUS1 & RX_EMPTY) == 0) {
+    /* drain back-to-back packets now, they raise no further interrupt. With the queue full
+       the rest stays in the FIFO for the next alert, see FUSB302_alert_pending(). A FIFO out of
+       sync is flushed */
+    while ((REG_STATUS1 & RX_EMPTY) == 0 && dev->rx_count < FUSB302_RX_QUEUE_SIZE) {
         if (FUSB302_read_incoming_packet(dev, events) != FUSB302_SUCCESS) {
-            uint8_t rx_flush = REG_CONTROL1 | RX_FLUSH;
-            reg_write(dev, ADDRESS_CONTROL1, &rx_flush, 1);
+            return FUSB302_ERR_READ_DEVICE;
         }
+        REG_READ(ADDRESS_STATUS1, &REG_STATUS1, 1);
     }
     return FUSB302_SUCCESS;
 }
@@ -423,47 +693,46 @@ FUSB302_ret_t FUSB302_init(FUSB302_dev_t *dev)
     }
 
     dev->state = FUSB302_STATE_UNATTACHED;
-    dev->rx_header = 0;
-    memset(dev->rx_buffer, 0, sizeof(dev->rx_buffer));
+    dev->rx_head = 0;
+    dev->rx_count = 0;
+    dev->rx_check = 0;
+    dev->hard_reset = FUSB302_HARD_RESET_NONE;
+    dev->vbus_bit = 0;
+    dev->vbus_mv = 0;
 
     /* restore default settings */
-    REG_RESET = SW_RES;
-    REG_WRITE(ADDRESS_RESET, &REG_RESET, 1);
+    uint8_t reg_control = SW_RES;
+    REG_WRITE(ADDRESS_RESET, &reg_control, 1);
     
     /* fetch all R/W registers */
     REG_READ(ADDRESS_DEVICE_ID, &REG_DEVICE_ID, 15);
+    memcpy(dev->reg_written, dev->reg_control, sizeof(dev->reg_written));
 
-    /* configure switchs and comparators */
-    REG_SWITCHES0 = PDWN1 | PDWN2;
-    REG_SWITCHES1 = SPECREV0;
-    REG_MEASURE = 49;
-	REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 3);
+    /* configured below, written together by REG_FLUSH() */
 
     /* configure auto retries */
     REG_CONTROL3 &= ~N_RETRIES_MASK;
     REG_CONTROL3 |= N_RETRIES(3) | AUTO_RETRY;
-    REG_WRITE(ADDRESS_CONTROL3, &REG_CONTROL3, 1);
 
     /* configure interrupt mask */
     REG_MASK = 0xFF;
     REG_MASK &= ~(M_VBUSOK | M_ACTIVITY | M_COLLISION | M_ALERT | M_CRC_CHK);
-    REG_WRITE(ADDRESS_MASK, &REG_MASK, 1);
     
     /* configure interrupt maska/maskb */
     REG_MASKA = 0xFF;
     REG_MASKA &= ~(M_RETRYFAIL | M_HARDSENT | M_TXSENT | M_HARDRST);
-    REG_WRITE(ADDRESS_MASKA, &REG_MASKA, 1);
+    if (dev->toggle) {
+        REG_MASKA &= ~M_TOGDONE;
+    }
     REG_MASKB = 0xFF;
     REG_MASKB &= ~(M_GCRCSENT);
-    REG_WRITE(ADDRESS_MASKB, &REG_MASKB, 1);
     
     /* enable interrupt */
     REG_CONTROL0 &= ~INT_MASK;
-    REG_WRITE(ADDRESS_CONTROL0, &REG_CONTROL0, 1);
 
-    /* Power on, enable VUSB detection */
-    REG_POWER = PWR_BANDGAP | PWR_RECEIVER | PWR_MEASURE;
-    REG_WRITE(ADDRESS_POWER, &REG_POWER, 1);
+    /* configure switchs and comparators, power on, enable VUSB detection or start toggling */
+    FUSB302_unattached(dev);
+    REG_FLUSH();
     
     dev->vbus_sense = 1;
     dev->err_msg = FUSB302_ERR_MSG("");
@@ -480,7 +749,7 @@ FUSB302_ret_t FUSB302_pd_reset(FUSB302_dev_t *dev)
 FUSB302_ret_t FUSB302_pdwn_cc(FUSB302_dev_t *dev, uint8_t enable)
 {
     REG_SWITCHES0 = enable ? (PDWN1 | PDWN2) : 0;
-	REG_WRITE(ADDRESS_SWITCHES0, &REG_SWITCHES0, 1);
+    REG_FLUSH();
     return FUSB302_SUCCESS;
 }
 
@@ -492,7 +761,7 @@ FUSB302_ret_t FUSB302_set_vbus_sense(FUSB302_dev_t *dev, uint8_t enable)
         } else { 
             REG_MASK |= M_VBUSOK;   /* disable VBUSOK interrupt */
         }
-        REG_WRITE(ADDRESS_MASK, &REG_MASK, 1);
+        REG_FLUSH();
         dev->vbus_sense = enable;
     }
     return FUSB302_SUCCESS;
@@ -533,13 +802,19 @@ FUSB302_ret_t FUSB302_get_vbus_level(FUSB302_dev_t *dev, uint8_t *vbus)
 
 FUSB302_ret_t FUSB302_get_message(FUSB302_dev_t *dev, uint16_t * header, uint32_t * data)
 {
+    const FUSB302_rx_msg_t * msg = FUSB302_rx_peek(dev);
+    if (msg == 0) {
+        dev->err_msg = FUSB302_ERR_MSG("No message received");
+        return FUSB302_ERR_PARAM;
+    }
     if (header) {
-        *header = dev->rx_header;
+        *header = msg->header;
     }
     if (data) {
-        uint8_t len = (dev->rx_header >> 12) & 0x7;
-        memcpy(data, dev->rx_buffer, len * 4);
+        uint8_t len = (msg->header >> 12) & 0x7;
+        memcpy(data, msg->obj, len * 4);
     }
+    FUSB302_rx_pop(dev);
 	return FUSB302_SUCCESS;
 }
 
@@ -548,6 +823,13 @@ FUSB302_ret_t FUSB302_tx_sop(FUSB302_dev_t *dev, uint16_t header, const uint32_t
     uint8_t buf[40];
     uint8_t * pbuf = buf;
     uint8_t obj_count = ((header >> 12) & 7);
+    if (dev->state != FUSB302_STATE_ATTACHED) {
+        dev->err_msg = FUSB302_ERR_MSG("Not attached");
+        return FUSB302_ERR_PARAM;
+    }
+    if (dev->tx_state != FUSB302_TX_IDLE) {
+        return FUSB302_BUSY;
+    }
     *pbuf++ = (uint8_t)TX_TOKEN_SOP1;
     *pbuf++ = (uint8_t)TX_TOKEN_SOP1;
     *pbuf++ = (uint8_t)TX_TOKEN_SOP1;
@@ -567,7 +849,8 @@ FUSB302_ret_t FUSB302_tx_sop(FUSB302_dev_t *dev, uint16_t header, const uint32_t
     *pbuf++ = (uint8_t)TX_TOKEN_TXOFF;
     *pbuf++ = (uint8_t)TX_TOKEN_TXON;
     REG_WRITE(ADDRESS_FIFOS, buf, pbuf - buf);
-    dev->delay_ms(1);
+    dev->tx_state = FUSB302_TX_SOP;
+    dev->time_tx = dev->clock_ms ? dev->clock_ms(dev->ctx) : 0;
 	return FUSB302_SUCCESS;
 }
 
@@ -576,9 +859,94 @@ FUSB302_ret_t FUSB302_tx_hard_reset(FUSB302_dev_t *dev)
     uint8_t reg_control = REG_CONTROL3;
     reg_control |= SEND_HARDRESET;
     REG_WRITE(ADDRESS_CONTROL3, &reg_control, 1);
-    dev->delay_ms(5);
-    reg_control = PD_RESET;
-    REG_WRITE(ADDRESS_RESET, &reg_control, 1);
+    /* PD logic is reset on HARDSENT, see FUSB302_tx_complete() */
+    dev->tx_state = FUSB302_TX_HARD_RESET;
+    dev->time_tx = dev->clock_ms ? dev->clock_ms(dev->ctx) : 0;
+    return FUSB302_SUCCESS;
+}
+
+static FUSB302_ret_t FUSB302_vbus_compare(FUSB302_dev_t *dev)
+{
+    REG_MEASURE = MEAS_VBUS | dev->vbus_mdac | dev->vbus_bit;
+    REG_FLUSH();
+    dev->time_vbus = dev->clock_ms ? dev->clock_ms(dev->ctx) : 0;
+    return FUSB302_SUCCESS;
+}
+
+static FUSB302_ret_t FUSB302_vbus_step(FUSB302_dev_t *dev)
+{
+    /* COMP: VBUS above (MDAC + 1) steps */
+    REG_READ(ADDRESS_STATUS0, &REG_STATUS0, 1);
+    if (REG_STATUS0 & COMP) {
+        dev->vbus_mdac |= dev->vbus_bit;
+    }
+    dev->vbus_bit >>= 1;
+    if (dev->vbus_bit) {
+        return FUSB302_vbus_compare(dev);
+    }
+    /* MEASURE is left on VBUS, nothing else reads COMP while attached */
+    dev->vbus_mv = (uint16_t)((dev->vbus_mdac + 1) * MDAC_VBUS_STEP_MV + MDAC_VBUS_STEP_MV / 2);
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t FUSB302_vbus_measure_start(FUSB302_dev_t *dev)
+{
+    if (dev->state != FUSB302_STATE_ATTACHED) {
+        dev->err_msg = FUSB302_ERR_MSG("Not attached");
+        return FUSB302_ERR_PARAM;
+    }
+    if (dev->vbus_bit) {
+        return FUSB302_BUSY;
+    }
+    dev->vbus_mdac = 0;
+    dev->vbus_bit = (MDAC_MASK + 1) >> 1;
+    FUSB302_ret_t ret = FUSB302_vbus_compare(dev);
+    if (ret != FUSB302_SUCCESS) {
+        dev->vbus_bit = 0;
+    }
+    return ret;
+}
+
+FUSB302_ret_t FUSB302_vbus_measure_run(FUSB302_dev_t *dev, uint16_t *mv)
+{
+    if (dev->vbus_bit) {
+        if (dev->clock_ms && dev->clock_ms(dev->ctx) - dev->time_vbus < t_MDACSettle) {
+            return FUSB302_BUSY;
+        }
+        FUSB302_ret_t ret = FUSB302_vbus_step(dev);
+        if (ret != FUSB302_SUCCESS) {
+            dev->vbus_bit = 0;
+            return ret;
+        }
+        if (dev->vbus_bit) {
+            return FUSB302_BUSY;
+        }
+    }
+    if (mv) {
+        *mv = dev->vbus_mv;
+    }
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t FUSB302_restore(FUSB302_dev_t *dev)
+{
+    const uint8_t reset = ADDRESS_RESET - ADDRESS_DEVICE_ID;
+    const uint8_t reserved = ADDRESS_RESERVED - ADDRESS_DEVICE_ID;
+    uint8_t reg[sizeof(dev->reg_written)];
+    REG_READ(ADDRESS_DEVICE_ID, reg, sizeof(reg));
+    if ((reg[0] & 0x80) == 0) {
+        dev->err_msg = FUSB302_ERR_MSG("Invalid device version");
+        return FUSB302_ERR_DEVICE_ID;
+    }
+    /* RESET is write only, the reserved register is never written */
+    reg[reset] = dev->reg_written[reset];
+    reg[reserved] = dev->reg_written[reserved];
+    if (memcmp(reg, dev->reg_written, sizeof(reg)) != 0) {
+        dev->errors.restore++;
+        memcpy(dev->reg_written, reg, sizeof(reg));
+    }
+    /* also writes what a failed flush left in reg_control */
+    REG_FLUSH();
     return FUSB302_SUCCESS;
 }
 
@@ -586,7 +954,10 @@ FUSB302_ret_t FUSB302_alert(FUSB302_dev_t *dev, FUSB302_event_t * events)
 {
     FUSB302_ret_t (* const handler[]) (FUSB302_dev_t *, FUSB302_event_t *) = {
         FUSB302_state_unattached,
-        FUSB302_state_attached
+        FUSB302_state_attached,
+        FUSB302_state_attach_wait,
+        FUSB302_state_attach_wait,
+        FUSB302_state_toggle
     };
     if (dev->state < sizeof(handler) / sizeof(handler[0])) {
         return handler[dev->state](dev, events);
@@ -594,3 +965,11 @@ FUSB302_ret_t FUSB302_alert(FUSB302_dev_t *dev, FUSB302_event_t * events)
     dev->state = FUSB302_STATE_UNATTACHED;
     return FUSB302_SUCCESS;
 }
+
+uint8_t FUSB302_alert_pending(FUSB302_dev_t *dev)
+{
+    if (dev->state == FUSB302_STATE_ATTACHED) {
+        return (REG_STATUS1 & RX_EMPTY) == 0;
+    }
+    return dev->state == FUSB302_STATE_ATTACH_WAIT_CC1 || dev->state == FUSB302_STATE_ATTACH_WAIT_CC2;
+}
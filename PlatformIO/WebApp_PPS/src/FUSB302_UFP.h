@@ -34,20 +34,50 @@ typedef uint8_t FUSB302_ret_t;
 #define FUSB302_EVENT_DETACHED          (1 << 1)
 #define FUSB302_EVENT_RX_SOP            (1 << 2)
 #define FUSB302_EVENT_GOOD_CRC_SENT     (1 << 3)
+#define FUSB302_EVENT_TX_SENT           (1 << 4)    /* GoodCRC received, the PHY can transmit again */
+#define FUSB302_EVENT_TX_FAILED         (1 << 5)    /* No GoodCRC after all retries, or no interrupt in time */
+#define FUSB302_EVENT_HARD_RESET_SENT   (1 << 6)
+#define FUSB302_EVENT_HARD_RESET        (1 << 7)    /* Hard Reset received, the PD logic is reset */
 typedef uint8_t FUSB302_event_t;
 
+#define FUSB302_RX_QUEUE_SIZE           4           /* power of 2 */
+
+typedef struct {
+    uint16_t header;
+    uint32_t obj[8];                /* data objects and the CRC, read from the FIFO in place (little-endian) */
+} FUSB302_rx_msg_t;
+
+/* Error counters, kept by the driver and never cleared by it. A posted write that fails is
+   counted on the transaction that reports it */
 typedef struct {
-    /* setup by user */
+    uint32_t read;                  /* failed register and FIFO reads */
+    uint32_t write;                 /* failed register and FIFO writes */
+    uint32_t rx_sync;               /* RX FIFO out of sync, flushed */
+    uint32_t restore;               /* control registers found not as written by FUSB302_restore() */
+} FUSB302_errors_t;
+
+/* FUSB302BMPX, the B01, B10 and B11 variants answer at 0x23, 0x24 and 0x25 */
+#define FUSB302_I2C_ADDRESS             0x22
+
+typedef struct {
+    /* setup by user, ctx is passed to every callback so several FUSB302 can share them */
     uint8_t i2c_address;
-    FUSB302_ret_t (*i2c_read)(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
-    FUSB302_ret_t (*i2c_write)(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
-    FUSB302_ret_t (*delay_ms)(uint32_t t);
+    void *ctx;
+    FUSB302_ret_t (*i2c_read)(void *ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
+    FUSB302_ret_t (*i2c_write)(void *ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
+    FUSB302_ret_t (*delay_ms)(void *ctx, uint32_t t);
+    uint32_t (*clock_ms)(void *ctx); /* optional, without it attach debounce counts FUSB302_alert() calls */
+    uint8_t toggle;                 /* optional, the toggle logic (I_TOGDONE) finds the CC line with Rp
+                                       instead of polling VBUS, only that line is then debounced */
 
     /* used by this library */
     const char * err_msg;
-    uint16_t rx_header;
-    uint8_t rx_buffer[32];
+    FUSB302_rx_msg_t rx_queue[FUSB302_RX_QUEUE_SIZE];   /* every packet in the RX FIFO, drained on each alert */
+    uint8_t rx_head;
+    uint8_t rx_count;
+    uint8_t rx_check;               /* a FIFO read failed, the next packet is checked against its CRC */
     uint8_t reg_control[15];
+    uint8_t reg_written[15];        /* reg_control as last written, unchanged registers are not rewritten */
     uint8_t reg_status[7];
     
     uint8_t interrupta;
@@ -56,10 +86,45 @@ typedef struct {
     uint8_t cc2;
     uint8_t state;
     uint8_t vbus_sense;
+
+    /* hard reset, sent or received: VBUS going to vSafe0V and back is not a detach */
+    uint8_t hard_reset;
+    uint32_t time_hard_reset;
+
+    /* attach detection */
+    uint8_t cc_sample;
+    uint32_t time_cc_sample;
+    uint32_t time_cc_change;
+
+    /* transmitter, busy from FUSB302_tx_sop() or FUSB302_tx_hard_reset() until TXSENT, RETRYFAIL or HARDSENT */
+    uint8_t tx_state;
+    uint32_t time_tx;
+
+    /* VBUS measurement, successive approximation on the MDAC comparator */
+    uint8_t vbus_mdac;              /* bits decided so far */
+    uint8_t vbus_bit;               /* bit under test, 0 when no measurement is running */
+    uint32_t time_vbus;
+    uint16_t vbus_mv;               /* last result, 0 before the first */
+
+    FUSB302_errors_t errors;
 } FUSB302_dev_t;
 
 static inline const char * FUSB302_get_last_err_msg(FUSB302_dev_t *dev) { return dev->err_msg; }
 
+/* Oldest received message, 0 when the queue is empty, valid until FUSB302_rx_pop() */
+static inline FUSB302_rx_msg_t * FUSB302_rx_peek(FUSB302_dev_t *dev)
+{
+    return dev->rx_count ? &dev->rx_queue[dev->rx_head] : 0;
+}
+
+static inline void FUSB302_rx_pop(FUSB302_dev_t *dev)
+{
+    if (dev->rx_count) {
+        dev->rx_head = (dev->rx_head + 1) & (FUSB302_RX_QUEUE_SIZE - 1);
+        dev->rx_count--;
+    }
+}
+
 FUSB302_ret_t FUSB302_init            (FUSB302_dev_t *dev);
 FUSB302_ret_t FUSB302_pd_reset        (FUSB302_dev_t *dev);
 FUSB302_ret_t FUSB302_pdwn_cc         (FUSB302_dev_t *dev, uint8_t enable);
@@ -67,10 +132,28 @@ FUSB302_ret_t FUSB302_set_vbus_sense  (FUSB302_dev_t *dev, uint8_t enable);
 FUSB302_ret_t FUSB302_get_ID          (FUSB302_dev_t *dev, uint8_t *version_ID, uint8_t *revision_ID);
 FUSB302_ret_t FUSB302_get_cc          (FUSB302_dev_t *dev, uint8_t *cc1, uint8_t *cc2);
 FUSB302_ret_t FUSB302_get_vbus_level  (FUSB302_dev_t *dev, uint8_t *vbus);
+/* Copy the oldest received message and remove it from the queue, FUSB302_rx_peek() avoids the copy */
 FUSB302_ret_t FUSB302_get_message     (FUSB302_dev_t *dev, uint16_t *header, uint32_t *data);
+/* Return FUSB302_BUSY without sending while the previous transmission has not completed */
 FUSB302_ret_t FUSB302_tx_sop          (FUSB302_dev_t *dev, uint16_t header, const uint32_t *data);
 FUSB302_ret_t FUSB302_tx_hard_reset   (FUSB302_dev_t *dev);
 FUSB302_ret_t FUSB302_alert           (FUSB302_dev_t *dev, FUSB302_event_t *events);
+/* After an I2C bus recovery: read the control registers back and rewrite the ones that differ
+   from the driver copy (FUSB302 reset or a lost write). Attach state and queues are kept */
+FUSB302_ret_t FUSB302_restore         (FUSB302_dev_t *dev);
+/* VBUS measurement with the MDAC comparator, attached only. Resolution is 420mV, the result is
+   the middle of the step. FUSB302_vbus_measure_run() makes one comparison per call, at most one
+   per ms with clock_ms, and returns FUSB302_BUSY until the 6 comparisons are done, then the
+   result in mv. Detach cancels the measurement */
+FUSB302_ret_t FUSB302_vbus_measure_start(FUSB302_dev_t *dev);
+FUSB302_ret_t FUSB302_vbus_measure_run  (FUSB302_dev_t *dev, uint16_t *mv);
+static inline uint8_t FUSB302_vbus_measure_busy(FUSB302_dev_t *dev) { return dev->vbus_bit != 0; }
+/* From a hard reset until VBUS is back at vSafe5V, or for at most tSafe0V + tSrcRecover +
+   tSrcTurnOn. Needs clock_ms, without it VBUS going low during a hard reset is a detach */
+static inline uint8_t FUSB302_hard_reset_busy(FUSB302_dev_t *dev) { return dev->hard_reset != 0; }
+/* Attach detection in progress or packets left in the RX FIFO, FUSB302_alert() must be called
+   without waiting for INT_N */
+uint8_t       FUSB302_alert_pending   (FUSB302_dev_t *dev);
 
 #endif /* FUSB302_H */
 
@@ -11,6 +11,8 @@
  * Requires FUSB302_UFP.h, PD_UFP_Protocol.h and Standard Arduino Library
  *
  * Support PD3.0 PPS
+ *
+ * On ESP32 the FUSB302 can be serviced from its own FreeRTOS task woken by INT_N, see start_task()
  * 
  */
 
@@ -25,6 +27,19 @@
 
 #include "FUSB302_UFP.h"
 #include "PD_UFP_Protocol.h"
+#include "PD_UFP_Trace.h"
+#include "PD_UFP_I2C.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#define PD_UFP_TASK
+#endif
+
+/* PD task, above the Arduino loop (1) and async_tcp (3), below lwIP tcpip (18) and WiFi (23) */
+#define PD_UFP_TASK_PRIORITY        8
+#define PD_UFP_TASK_STACK_SIZE      3072
 
 enum {
     STATUS_POWER_NA = 0,
@@ -33,6 +48,55 @@ enum {
 };
 typedef uint8_t status_power_t;
 
+/* Time source, default to Arduino millis() and delay() */
+typedef uint32_t (*PD_UFP_clock_ms_t)(void);
+typedef void (*PD_UFP_delay_ms_t)(uint32_t ms);
+
+/* PD task timing, see PD_UFP_c::set_task_hook(). run_us: the run() calls of one wake up, wake_us:
+   INT_N edge to the task running, 0 for a wake up in time for the protocol timers */
+typedef void (*PD_UFP_task_hook_t)(void * ctx, uint32_t run_us, uint32_t wake_us);
+
+/* Optional I2C accounting, per FUSB302 start register */
+#define PD_UFP_I2C_PROFILE_NUM_OF_REG   0x44
+typedef struct {
+    uint32_t reads;         /* Read transactions */
+    uint32_t writes;        /* Write transactions */
+    uint32_t bytes_read;    /* Data bytes, register address not included */
+    uint32_t bytes_written;
+    uint32_t time_us;       /* Time spent in the transport */
+} PD_UFP_i2c_reg_stats_t;
+
+typedef struct {
+    PD_UFP_i2c_reg_stats_t reg[PD_UFP_I2C_PROFILE_NUM_OF_REG];
+    uint32_t errors;
+} PD_UFP_i2c_profile_t;
+
+/* I2C link to the FUSB302, see PD_UFP_c::get_health() */
+typedef struct {
+    uint32_t read_errors;           /* Failed FUSB302 register and FIFO reads */
+    uint32_t write_errors;          /* Failed FUSB302 register and FIFO writes */
+    uint32_t rx_sync_errors;        /* RX FIFO out of sync and flushed, packets lost */
+    uint32_t tx_write_errors;       /* Messages not written to the TX FIFO, sent once the bus is recovered */
+    uint32_t alert_errors;          /* FUSB302 alert still failing after 3 tries */
+    uint32_t bus_recoveries;        /* Bus clear and FUSB302 register check */
+    uint32_t recover_errors;        /* Bus still held or FUSB302 not answering after a recovery */
+    uint32_t config_restores;       /* FUSB302 registers found lost and written again */
+    uint16_t time_last_error;       /* clock_ms() of the last alert or TX FIFO write error */
+    uint8_t bus_ok;                 /* 0 from an alert or TX FIFO write error until a recovery succeeds,
+                                       retried by run(), nothing is sent meanwhile */
+} PD_UFP_health_t;
+
+/* Resets and the time back to a contract, see PD_UFP_c::get_reset_stats() */
+typedef struct {
+    uint32_t hard_resets_received;
+    uint32_t hard_resets_sent;
+    uint32_t soft_resets;           /* Soft_Reset received */
+    uint32_t soft_resets_sent;      /* A message without GoodCRC, a Hard Reset follows if not accepted */
+    uint32_t recoveries;            /* Contract back after a reset, PS_RDY of the new Request */
+    uint16_t time_last_recovery;    /* ms from the reset to PS_RDY */
+    uint16_t time_max_recovery;
+} PD_UFP_reset_stats_t;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // PD_UFP_c
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -45,28 +109,123 @@ class PD_UFP_c
         void init_PPS(uint8_t int_pin, uint16_t PPS_voltage, uint8_t PPS_current, enum PD_power_option_t power_option = PD_POWER_OPTION_MAX_5V);
         // Task
         void run(void);
+        // Service the FUSB302 from a task woken by INT_N, run() from the sketch then does nothing.
+        // Returns false where there is no FreeRTOS (keep calling run()) or the task cannot start
+        bool start_task(uint8_t priority = PD_UFP_TASK_PRIORITY, uint16_t stack_size = PD_UFP_TASK_STACK_SIZE);
+        // Called by the PD task after every wake up, outside its lock, NULL to disable (default).
+        // For profiling, keep it short. Set before start_task()
+        void set_task_hook(PD_UFP_task_hook_t hook, void * ctx = 0) { task_hook = hook; task_hook_ctx = ctx; }
         // Status
         bool is_power_ready(void) { return status_power == STATUS_POWER_TYP; }
         bool is_PPS_ready(void)   { return status_power == STATUS_POWER_PPS; }
         bool is_ps_transition(void) { return send_request || wait_ps_rdy; }
+        bool is_reset_recovery(void) { return reset_recovery; }    // Reset, no new contract yet
+        // PPS output at the last set_PPS() setting, every step Requested and PS_RDY received
+        bool is_PPS_settled(void) { return status_power == STATUS_POWER_PPS && !PPS_target_pending && !is_ps_transition(); }
         // Get
         uint16_t get_voltage(void) { return ready_voltage; }    // Voltage in 50mV units, 20mV(PPS)
         uint16_t get_current(void) { return ready_current; }    // Current in 10mA units, 50mA(PPS)
         status_power_t get_ps_status(void) { return status_power; }
+        // VBUS measured by the FUSB302 in mV, 420mV resolution, 0 before the first measurement
+        uint16_t get_vbus_mv(void) { return FUSB302.vbus_mv; }
+        bool is_vbus_measuring(void) { return FUSB302_vbus_measure_busy(&FUSB302); }
+        // I2C error counters and recovery state, the FUSB302 is recovered in place by run()
+        void get_health(PD_UFP_health_t * health);
+        void reset_health(void);
+        // Hard and soft resets, the contract is requested again and the time it takes is kept
+        void get_reset_stats(PD_UFP_reset_stats_t * stats);
+        // Source information (PD3.0), received after a request_*() below. False until received,
+        // cleared by a detach or hard reset
+        bool get_src_cap_ext(PD_src_cap_ext_t * src_cap_ext);   // PDP, peak current, holdup time
+        bool get_status(PD_status_t * status);                  // Temperature, events, power limits
+        bool get_manufacturer_info(PD_mfg_info_t * mfg_info);
+        // Output reported by the source in a PPS contract, see set_PPS_status_polling(). False
+        // until the first PPS_Status of the contract. status_PPS_changed() is called on a change
+        bool get_PPS_status(PPS_status_t * status);
         // Set
+        // New PPS setting, returns false if no PPS APDO of the source covers it or a step toward
+        // it. Only the latest setting is kept while a Request is in flight, run() moves the
+        // voltage toward it in steps of at most set_PPS_slew(), the next one after PS_RDY of the
+        // previous one. A lower current is Requested with the first step, a higher one with the last
         bool set_PPS(uint16_t PPS_voltage, uint8_t PPS_current);
+        // Largest voltage change of one PPS Request in 20mV units, default vPpsSmallStep (500mV)
+        // so every transition is a small one. 0 to Request the setting in one step
+        void set_PPS_slew(uint16_t step) { PPS_slew_step = step; }
         void set_power_option(enum PD_power_option_t power_option);
-        // Clock
+        // Start a VBUS measurement, stepped by run() between PD traffic, done in about 6 calls.
+        // Returns false if not attached
+        bool measure_vbus(void);
+        // Ask the source for its information, the reply is reassembled from chunks by run().
+        // Returns false without a contract, during a power transition or while a request waits
+        bool request_src_cap_ext(void);
+        bool request_status(void);
+        bool request_manufacturer_info(void);
+        // Send Get_PPS_Status every interval_ms in a PPS contract, between the keepalive Requests.
+        // 0 to stop (default)
+        void set_PPS_status_polling(uint16_t interval_ms);
+        // Source capability cache, NULL to disable (default). Sources are known by their power
+        // data objects: the PDO selected for the power option and PPS setting is kept, and whether
+        // Source_Capabilities came only after a Hard Reset. A hit only saves the policy evaluation
+        // (well under a microsecond), attach to ready is paced by the source and stays the same.
+        // Time is saved only for a source that needs a Hard Reset: while one with the Rp level of
+        // the source attached is in the cache, a Get_Source_Cap without GoodCRC after attach is
+        // followed by the Hard Reset, not by two more retries. Keep the cache in RTC_NOINIT_ATTR
+        // memory on ESP32 so it survives resets and deep sleep, or save it to NVS
+        void set_src_cache(PD_src_cache_t * cache);
+        bool is_src_cached(void) { return protocol.src_cap_cached; }   // Last selection from the cache
+        // Clock, default of every instance
         static void clock_prescale_set(uint8_t prescaler);
+        static void clock_source_set(PD_UFP_clock_ms_t clock_ms, PD_UFP_delay_ms_t delay_ms);
+        // I2C transport of the FUSB302, default of every instance, NULL for Arduino Wire. Set before init()
+        static void i2c_transport_set(PD_UFP_I2C_c * transport);
+        // Per instance, for several FUSB302 on one controller: each on a transport of its own (a
+        // separate bus or another address on the same one) and its own time source. Set before
+        // init(), NULL or 0 for the defaults above
+        void set_i2c_transport(PD_UFP_I2C_c * transport, uint8_t i2c_address = FUSB302_I2C_ADDRESS);
+        void set_clock_source(PD_UFP_clock_ms_t clock_ms, PD_UFP_delay_ms_t delay_ms, uint8_t prescaler = 0);
+        // Attach found by the FUSB302 toggle logic: no polling while unattached, then only the CC
+        // line with Rp is debounced from run(), same tCCDebounce as polling. Set before init()
+        void set_toggle_attach(bool enable) { FUSB302.toggle = enable; }
+        // I2C profiler, disabled until a profile buffer is set, NULL to disable. Counts every instance
+        static void i2c_profile_set(PD_UFP_i2c_profile_t * profile);
+        static const PD_UFP_i2c_profile_t * i2c_profile_get(void) { return i2c_profile; }
+        static void i2c_profile_reset(void);
+        static int i2c_profile_dump(char * buffer, int maxlen);
+        static void i2c_profile_print(HardwareSerial & serial);
+        // Trace, record PD traffic into a PD_trace_t ring buffer, NULL to stop
+        void trace_set(PD_trace_t * trace) { this->trace = trace; }
 
     protected:
-        static FUSB302_ret_t FUSB302_i2c_read(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
-        static FUSB302_ret_t FUSB302_i2c_write(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
-        static FUSB302_ret_t FUSB302_delay_ms(uint32_t t);
+        static FUSB302_ret_t FUSB302_i2c_read(void * ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
+        static FUSB302_ret_t FUSB302_i2c_write(void * ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count);
+        static FUSB302_ret_t FUSB302_delay_ms(void * ctx, uint32_t t);
+        static uint32_t FUSB302_clock_ms(void * ctx);
+        static void i2c_profile_account(uint8_t reg_addr, uint8_t count, bool write, uint32_t time_start, FUSB302_ret_t ret);
+        static int i2c_profile_readline(char * buffer, int maxlen, uint8_t line);
         void handle_protocol_event(PD_protocol_event_t events);
         void handle_FUSB302_event(FUSB302_event_t events);
+        void handle_tx_complete(FUSB302_event_t events);
+        void handle_reset(bool hard);
+        void reset_recovered(void);
         bool timer(void);
         void set_default_power(void);
+        void trace_config(void);
+        void tx_sop(uint16_t header, uint32_t * obj);
+        void tx_send_queued(void);
+        void tx_soft_reset(void);
+        void tx_hard_reset(void);
+        bool request_info(PD_protocol_event_t info);
+        void PPS_next(uint16_t * voltage, uint8_t * current, uint16_t target_voltage, uint8_t target_current);
+        bool PPS_ramp_check(uint16_t voltage, uint8_t current);
+        void PPS_step(void);
+        void i2c_error(void);
+        bool i2c_recover(void);
+        void lock(void);
+        void unlock(void);
+#ifdef PD_UFP_TASK
+        static void task(void * arg);
+        static void isr(void * arg);
+#endif
         // Device
         FUSB302_dev_t FUSB302;
         PD_protocol_t protocol;
@@ -77,8 +236,15 @@ class PD_UFP_c
         // PPS setup
         uint16_t PPS_voltage_next;
         uint8_t PPS_current_next;
+        // PPS setting of set_PPS(), Requested in steps
+        uint16_t PPS_target_voltage;
+        uint8_t PPS_target_current;
+        uint8_t PPS_target_pending;
+        uint16_t PPS_slew_step;
         // Status
         virtual void status_power_ready(status_power_t status, uint16_t voltage, uint16_t current);
+        // Output voltage, current, PTF or OMF (current limit) changed, from run()
+        virtual void status_PPS_changed(const PPS_status_t * status) {}
         uint8_t status_initialized;
         uint8_t status_src_cap_received;
         status_power_t status_power;
@@ -87,11 +253,54 @@ class PD_UFP_c
         uint16_t time_wait_src_cap;
         uint16_t time_wait_ps_rdy;
         uint16_t time_PPS_request;
+        uint16_t time_wait_response;
+        uint16_t time_PPS_status;
+        uint16_t PPS_status_interval;
         uint8_t get_src_cap_retry_count;
         uint8_t wait_src_cap;
         uint8_t wait_ps_rdy;
         uint8_t send_request;
-        static uint8_t clock_prescaler;
+        uint8_t wait_response;
+        uint8_t PPS_status_valid;
+        PPS_status_t PPS_status;
+        // Source capability cache
+        PD_src_cache_t * src_cache;
+        uint8_t src_cap_first;          /* First Source_Capabilities since attach not received yet */
+        uint8_t src_cap_flags;          /* PD_SRC_CACHE_ flags of how they came */
+        uint8_t src_cap_rp;             /* Rp level at attach, cached with them */
+        uint8_t src_cap_silent;         /* A cached source with this Rp level needed a Hard Reset,
+                                           Get_Source_Cap not answered yet */
+        uint8_t wait_soft_reset;        /* Soft_Reset sent, Accept not received yet */
+        // Reset recovery
+        PD_UFP_reset_stats_t reset_stats;
+        uint16_t time_reset;
+        uint8_t reset_recovery;
+        // Message waiting for the PHY or the bus
+        uint8_t tx_queued;
+        uint16_t tx_queued_header;  /* Type and number of data objects, MessageID set when sent */
+        uint32_t tx_queued_obj[7];
+        // I2C recovery
+        PD_UFP_health_t health;
+        uint16_t time_i2c_recover;
+        PD_trace_t * trace;
+#ifdef PD_UFP_TASK
+        TaskHandle_t task_handle;
+        SemaphoreHandle_t task_lock;        /* Recursive, held by the task while it runs */
+        volatile uint32_t time_isr;         /* micros() of the last INT_N edge */
+#endif
+        PD_UFP_task_hook_t task_hook;
+        void * task_hook_ctx;
+        // Transport and time source of this instance, from the defaults unless set
+        PD_UFP_I2C_c * i2c_transport;
+        uint8_t i2c_address;
+        uint8_t clock_prescaler;
+        PD_UFP_clock_ms_t clock_source;
+        PD_UFP_delay_ms_t delay_source;
+        static uint8_t default_clock_prescaler;
+        static PD_UFP_clock_ms_t default_clock_source;
+        static PD_UFP_delay_ms_t default_delay_source;
+        static PD_UFP_I2C_c * default_i2c_transport;
+        static PD_UFP_i2c_profile_t * i2c_profile;
         // Time functions        
         void delay_ms(uint16_t ms);
         uint16_t clock_ms(void);
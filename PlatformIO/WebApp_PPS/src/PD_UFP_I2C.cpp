@@ -0,0 +1,359 @@
+/**
+ * PD_UFP_I2C.cpp
+ *
+ * I2C transport of the FUSB302, see PD_UFP_I2C.h
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "PD_UFP_I2C.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PD_UFP_I2C_c::PD_UFP_I2C_c():
+    posted(0),
+    posted_size(0),
+    posted_next(0),
+    posted_error(FUSB302_SUCCESS)
+{
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::prepare(PD_UFP_i2c_txn_t * txn, uint8_t dev_addr, uint8_t reg_addr, bool read,
+    uint8_t * data, uint8_t count)
+{
+    if (!read && count > PD_UFP_I2C_WRITE_MAX) {
+        return FUSB302_ERR_PARAM;
+    }
+    txn->dev_addr = dev_addr;
+    txn->read = read ? 1 : 0;
+    txn->count = count;
+    txn->buffer[0] = reg_addr;
+    if (read) {
+        txn->data = data;
+    } else {
+        memcpy(txn->buffer + 1, data, count);
+        txn->data = txn->buffer + 1;
+    }
+    txn->ret = FUSB302_BUSY;
+    txn->done = 0;
+    txn->ctx = 0;
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::read(uint8_t dev_addr, uint8_t reg_addr, uint8_t * data, uint8_t count)
+{
+    PD_UFP_i2c_txn_t txn;
+    FUSB302_ret_t ret = prepare(&txn, dev_addr, reg_addr, true, data, count);
+    if (ret == FUSB302_SUCCESS) {
+        ret = submit(&txn);
+    }
+    if (ret == FUSB302_SUCCESS) {
+        ret = wait(&txn);
+    }
+    /* Posted writes before this read have completed, report theirs first */
+    FUSB302_ret_t posted_ret = posted_error_take();
+    return posted_ret != FUSB302_SUCCESS ? posted_ret : ret;
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::write(uint8_t dev_addr, uint8_t reg_addr, const uint8_t * data, uint8_t count)
+{
+    FUSB302_ret_t ret;
+    if (posted_size == 0) {
+        PD_UFP_i2c_txn_t txn;
+        ret = prepare(&txn, dev_addr, reg_addr, false, (uint8_t *)data, count);
+        if (ret == FUSB302_SUCCESS) {
+            ret = submit(&txn);
+        }
+        return ret == FUSB302_SUCCESS ? wait(&txn) : ret;
+    }
+    PD_UFP_i2c_txn_t * txn = &posted[posted_next];
+    if (txn->ret == FUSB302_BUSY) {
+        wait(txn);      /* All posted writes in flight, an error is kept by posted_done() */
+    }
+    ret = prepare(txn, dev_addr, reg_addr, false, (uint8_t *)data, count);
+    if (ret == FUSB302_SUCCESS) {
+        txn->done = posted_done;
+        txn->ctx = this;
+        ret = submit(txn);
+    }
+    if (ret != FUSB302_SUCCESS) {
+        txn->ret = ret;
+        return ret;
+    }
+    posted_next = (posted_next + 1) % posted_size;
+    return posted_error_take();
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::flush(void)
+{
+    for (uint8_t i = 0; i < posted_size; i++) {
+        PD_UFP_i2c_txn_t * txn = &posted[(posted_next + i) % posted_size];
+        if (txn->ret == FUSB302_BUSY) {
+            wait(txn);
+        }
+    }
+    return posted_error_take();
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::recover(void)
+{
+    /* No control over the bus, the failed posted writes are already counted by the driver */
+    flush();
+    return FUSB302_SUCCESS;
+}
+
+void PD_UFP_I2C_c::posted_init(PD_UFP_i2c_txn_t * txn, uint8_t size)
+{
+    memset(txn, 0, size * sizeof(PD_UFP_i2c_txn_t));
+    posted = txn;
+    posted_size = size;
+    posted_next = 0;
+}
+
+FUSB302_ret_t PD_UFP_I2C_c::posted_error_take(void)
+{
+    FUSB302_ret_t ret = posted_error;
+    posted_error = FUSB302_SUCCESS;
+    return ret;
+}
+
+void PD_UFP_I2C_c::posted_done(PD_UFP_i2c_txn_t * txn)
+{
+    PD_UFP_I2C_c * self = (PD_UFP_I2C_c *)txn->ctx;
+    if (txn->ret != FUSB302_SUCCESS && self->posted_error == FUSB302_SUCCESS) {
+        self->posted_error = txn->ret;
+    }
+}
+
+void PD_UFP_I2C_c::complete(PD_UFP_i2c_txn_t * txn, FUSB302_ret_t ret)
+{
+    txn->ret = ret;
+    if (txn->done) {
+        txn->done(txn);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_Wire_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PD_UFP_I2C_Wire_c::PD_UFP_I2C_Wire_c(TwoWire & wire, int sda, int scl, uint32_t frequency):
+    wire(&wire),
+    sda(sda),
+    scl(scl),
+    frequency(frequency)
+{
+}
+
+FUSB302_ret_t PD_UFP_I2C_Wire_c::submit(PD_UFP_i2c_txn_t * txn)
+{
+    FUSB302_ret_t ret;
+    wire->beginTransmission(txn->dev_addr);
+    if (txn->read) {
+        uint8_t * data = txn->data;
+        uint8_t remain = txn->count;
+        wire->write(txn->buffer[0]);
+        if (wire->endTransmission() == 0) {
+            wire->requestFrom(txn->dev_addr, txn->count);
+            while (wire->available() && remain > 0) {
+                *data++ = wire->read();
+                remain--;
+            }
+        }
+        ret = remain == 0 ? FUSB302_SUCCESS : FUSB302_ERR_READ_DEVICE;
+    } else {
+        wire->write(txn->buffer, 1 + txn->count);
+        ret = wire->endTransmission() == 0 ? FUSB302_SUCCESS : FUSB302_ERR_WRITE_DEVICE;
+    }
+    complete(txn, ret);
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t PD_UFP_I2C_Wire_c::recover(void)
+{
+    bool idle = true;
+    uint32_t clock = frequency;
+#if defined(ARDUINO_ARCH_ESP32)
+    if (clock == 0) {
+        clock = wire->getClock();   /* end() forgets it */
+    }
+#endif
+    wire->end();
+    if (sda >= 0 && scl >= 0) {
+        idle = bus_clear();
+    }
+#if defined(ARDUINO_ARCH_ESP32)
+    wire->begin(sda, scl, clock);
+#else
+    wire->begin();
+    if (clock) {
+        wire->setClock(clock);
+    }
+#endif
+    return idle ? FUSB302_SUCCESS : FUSB302_BUSY;
+}
+
+/* Open drain by hand, a pin is driven low or released to its pull-up */
+static void bus_pin_low(int pin)
+{
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+    delayMicroseconds(PD_UFP_I2C_CLEAR_US);
+}
+
+static void bus_pin_release(int pin)
+{
+    pinMode(pin, INPUT_PULLUP);
+    delayMicroseconds(PD_UFP_I2C_CLEAR_US);
+}
+
+bool PD_UFP_I2C_Wire_c::bus_clear(void)
+{
+    /* A slave stopped mid-byte holds SDA low: up to 9 clocks until it lets go, then a STOP
+       (I2C-bus specification UM10204, 3.1.16) */
+    bus_pin_release(sda);
+    bus_pin_release(scl);
+    for (uint8_t i = 0; i < 9 && digitalRead(sda) == LOW; i++) {
+        bus_pin_low(scl);
+        bus_pin_release(scl);
+    }
+    bus_pin_low(scl);
+    bus_pin_low(sda);
+    bus_pin_release(scl);
+    bus_pin_release(sda);
+    return digitalRead(sda) == HIGH && digitalRead(scl) == HIGH;
+}
+
+#ifdef PD_UFP_I2C_IDF
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_IDF_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PD_UFP_I2C_IDF_c::PD_UFP_I2C_IDF_c(i2c_master_bus_handle_t bus, uint32_t scl_speed_hz):
+    bus(bus),
+    dev(0),
+    dev_addr(0),
+    scl_speed_hz(scl_speed_hz),
+    done_sem(xSemaphoreCreateBinary()),
+    queue_head(0),
+    queue_count(0)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    queue_lock = unlocked;
+    posted_init(posted_txn, PD_UFP_I2C_POSTED);
+}
+
+PD_UFP_I2C_IDF_c::~PD_UFP_I2C_IDF_c()
+{
+    flush();
+    if (dev) {
+        i2c_master_bus_rm_device(dev);
+    }
+    if (done_sem) {
+        vSemaphoreDelete(done_sem);
+    }
+}
+
+FUSB302_ret_t PD_UFP_I2C_IDF_c::device(uint8_t dev_addr)
+{
+    if (dev && dev_addr == this->dev_addr) {
+        return FUSB302_SUCCESS;
+    }
+    if (dev) {
+        /* One device at a time, the queue is in flight to the previous one */
+        flush();
+        i2c_master_bus_rm_device(dev);
+        dev = 0;
+    }
+    i2c_device_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    config.device_address = dev_addr;
+    config.scl_speed_hz = scl_speed_hz;
+    if (i2c_master_bus_add_device(bus, &config, &dev) != ESP_OK) {
+        dev = 0;
+        return FUSB302_ERR_PARAM;
+    }
+    i2c_master_event_callbacks_t callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_trans_done = trans_done;
+    if (i2c_master_register_event_callbacks(dev, &callbacks, this) != ESP_OK) {
+        /* Synchronous bus, trans_queue_depth is 0 */
+        i2c_master_bus_rm_device(dev);
+        dev = 0;
+        return FUSB302_ERR_PARAM;
+    }
+    this->dev_addr = dev_addr;
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t PD_UFP_I2C_IDF_c::submit(PD_UFP_i2c_txn_t * txn)
+{
+    esp_err_t err;
+    if (done_sem == 0 || device(txn->dev_addr) != FUSB302_SUCCESS) {
+        return FUSB302_ERR_PARAM;
+    }
+    /* Queued before the driver can complete it, trans_done() takes the head */
+    portENTER_CRITICAL(&queue_lock);
+    if (queue_count >= PD_UFP_I2C_IDF_QUEUE) {
+        portEXIT_CRITICAL(&queue_lock);
+        return FUSB302_BUSY;
+    }
+    queue[(queue_head + queue_count) % PD_UFP_I2C_IDF_QUEUE] = txn;
+    queue_count++;
+    portEXIT_CRITICAL(&queue_lock);
+    if (txn->read) {
+        err = i2c_master_transmit_receive(dev, txn->buffer, 1, txn->data, txn->count, PD_UFP_I2C_TIMEOUT_MS);
+    } else {
+        err = i2c_master_transmit(dev, txn->buffer, 1 + txn->count, PD_UFP_I2C_TIMEOUT_MS);
+    }
+    if (err != ESP_OK) {
+        /* Not queued by the driver, it is still the last one */
+        portENTER_CRITICAL(&queue_lock);
+        queue_count--;
+        portEXIT_CRITICAL(&queue_lock);
+        return txn->read ? FUSB302_ERR_READ_DEVICE : FUSB302_ERR_WRITE_DEVICE;
+    }
+    return FUSB302_SUCCESS;
+}
+
+FUSB302_ret_t PD_UFP_I2C_IDF_c::wait(PD_UFP_i2c_txn_t * txn)
+{
+    /* The driver completes every queued transaction, with an error after its timeout */
+    while (txn->ret == FUSB302_BUSY) {
+        xSemaphoreTake(done_sem, portMAX_DELAY);
+    }
+    return txn->ret;
+}
+
+FUSB302_ret_t PD_UFP_I2C_IDF_c::recover(void)
+{
+    /* The driver clocks out a held SDA and resets the controller */
+    flush();
+    return i2c_master_bus_reset(bus) == ESP_OK ? FUSB302_SUCCESS : FUSB302_BUSY;
+}
+
+bool IRAM_ATTR PD_UFP_I2C_IDF_c::trans_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t * event, void * arg)
+{
+    PD_UFP_I2C_IDF_c * self = (PD_UFP_I2C_IDF_c *)arg;
+    PD_UFP_i2c_txn_t * txn = 0;
+    BaseType_t woken = pdFALSE;
+    portENTER_CRITICAL_ISR(&self->queue_lock);
+    if (self->queue_count) {
+        txn = self->queue[self->queue_head];
+        self->queue_head = (self->queue_head + 1) % PD_UFP_I2C_IDF_QUEUE;
+        self->queue_count--;
+    }
+    portEXIT_CRITICAL_ISR(&self->queue_lock);
+    if (txn) {
+        complete(txn, event->event == I2C_EVENT_DONE ? FUSB302_SUCCESS :
+            txn->read ? FUSB302_ERR_READ_DEVICE : FUSB302_ERR_WRITE_DEVICE);
+    }
+    xSemaphoreGiveFromISR(self->done_sem, &woken);
+    return woken == pdTRUE;
+}
+#endif
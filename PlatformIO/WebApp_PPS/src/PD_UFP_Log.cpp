@@ -30,6 +30,16 @@ enum {
     STATUS_LOG_POWER_REJECT,
     STATUS_LOG_LOAD_SW_ON,
     STATUS_LOG_LOAD_SW_OFF,
+    STATUS_LOG_MSG_TX_FAILED,
+    STATUS_LOG_I2C_ERROR,
+    STATUS_LOG_I2C_RECOVERED,
+    STATUS_LOG_HARD_RESET,
+    STATUS_LOG_SOFT_RESET,
+    STATUS_LOG_RESET_RECOVERED,
+    STATUS_LOG_SRC_CAP_EXT,
+    STATUS_LOG_STATUS,
+    STATUS_LOG_MFG_INFO,
+    STATUS_LOG_PPS_STATUS,
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -220,6 +230,52 @@ int PD_UFP_Log_c::status_log_readline(char * buffer, int maxlen)
     case STATUS_LOG_LOAD_SW_OFF:
         LOG("%sLoad SW OFF\n", t);
         break;
+    case STATUS_LOG_MSG_TX_FAILED:
+        LOG("%sTX failed, no GoodCRC\n", t);
+        break;
+    case STATUS_LOG_I2C_ERROR:
+        LOG("%sFUSB302 I2C error, recovering\n", t);
+        break;
+    case STATUS_LOG_I2C_RECOVERED:
+        LOG("%sFUSB302 I2C recovered\n", t);
+        break;
+    case STATUS_LOG_HARD_RESET:
+        LOG("%sHard reset\n", t);
+        break;
+    case STATUS_LOG_SOFT_RESET:
+        LOG("%sSoft reset\n", t);
+        break;
+    case STATUS_LOG_RESET_RECOVERED:
+        LOG("%sContract restored in %ums\n", t, (unsigned)reset_stats.time_last_recovery);
+        break;
+    case STATUS_LOG_SRC_CAP_EXT: {
+        PD_src_cap_ext_t c;
+        if (PD_protocol_get_src_cap_ext(&protocol, &c)) {
+            LOG("%sSource %uW, holdup %ums, peak %u%%/%u%%/%u%%\n", t, c.source_PDP, c.holdup_time,
+                c.peak_current[0].percent, c.peak_current[1].percent, c.peak_current[2].percent);
+        }
+        break; }
+    case STATUS_LOG_STATUS: {
+        const char * temperature_str[] = {"", "normal", "warning", "over temperature"};
+        PD_status_t s;
+        if (PD_protocol_get_status(&protocol, &s)) {
+            LOG("%sSource temp %uC %s, events 0x%02X\n", t, s.internal_temp,
+                temperature_str[s.temperature_status], s.event_flags);
+        }
+        break; }
+    case STATUS_LOG_PPS_STATUS: {
+        const char * temperature_str[] = {"", ", normal", ", warning", ", over temperature"};
+        uint16_t v = PPS_status.output_voltage;
+        uint8_t a = PPS_status.output_current;
+        LOG("%sPPS output %d.%02dV %d.%02dA %s%s\n", t, v / 50, (v * 2) % 100, a / 20, (a * 5) % 100,
+            PPS_status.flag_OMF == PPS_OMF_CURRENT_LIMIT_MODE ? "CL" : "CV", temperature_str[PPS_status.flag_PTF]);
+        break; }
+    case STATUS_LOG_MFG_INFO: {
+        PD_mfg_info_t m;
+        if (PD_protocol_get_mfg_info(&protocol, &m)) {
+            LOG("%sSource %04X:%04X %s\n", t, m.VID, m.PID, m.name);
+        }
+        break; }
     }
     if (status_log_counter == 0) {
         t[0] = 0;
@@ -11,7 +11,8 @@
  * No use of bit-field for better cross-platform compatibility
  *
  * Support PD3.0 PPS
- * Do not support extended message. Not necessary for PD trigger and PPS.
+ * Extended messages are chunked, received chunks are reassembled in a fixed size buffer and
+ * larger messages are dropped. Unchunked extended messages are not supported (FUSB302 FIFO).
  * 
  * Reference: USB_PD_R2_0 V1.3 - 20170112
  *            USB_PD_R3_0 V2.0 20190829 + ECNs 2020-12-10
@@ -35,13 +36,23 @@
 
 #define PD_PROTOCOL_MAX_NUM_OF_PDO      7
 
+/* Reference: 6.12.2.1.2 Chunking, MaxExtendedMsgChunkLen */
+#define PD_PROTOCOL_EXT_CHUNK_SIZE      26
+#ifndef PD_PROTOCOL_EXT_DATA_SIZE
+#define PD_PROTOCOL_EXT_DATA_SIZE       (2 * PD_PROTOCOL_EXT_CHUNK_SIZE)    /* Largest extended message received */
+#endif
+
 #define PD_PROTOCOL_EVENT_SRC_CAP       (1 << 0)
 #define PD_PROTOCOL_EVENT_PS_RDY        (1 << 1)
 #define PD_PROTOCOL_EVENT_ACCEPT        (1 << 2)
 #define PD_PROTOCOL_EVENT_REJECT        (1 << 3)
 #define PD_PROTOCOL_EVENT_PPS_STATUS    (1 << 4)
+#define PD_PROTOCOL_EVENT_SOFT_RESET    (1 << 5)
+#define PD_PROTOCOL_EVENT_SRC_CAP_EXT   (1 << 6)
+#define PD_PROTOCOL_EVENT_STATUS        (1 << 7)
+#define PD_PROTOCOL_EVENT_MFG_INFO      (1 << 8)
 
-typedef uint8_t PD_protocol_event_t;
+typedef uint16_t PD_protocol_event_t;
 
 enum PD_power_option_t {
     PD_POWER_OPTION_MAX_5V      = 0,
@@ -80,6 +91,45 @@ typedef struct {
     enum PPS_OMF_t flag_OMF;
 } PPS_status_t;
 
+typedef struct {
+    uint8_t percent;            /* Overload in percent of the PDO current, 0 if none */
+    uint16_t period_ms;         /* Overload period */
+    uint8_t duty_cycle;         /* Duty cycle in percent */
+    uint8_t vbus_droop;         /* 1 if VBUS droops during the overload */
+} PD_peak_current_t;
+
+typedef struct {
+    uint16_t VID;
+    uint16_t PID;
+    uint32_t XID;
+    uint8_t fw_version;
+    uint8_t hw_version;
+    uint8_t voltage_regulation; /* Bit 1...0 load step slew rate, bit 2 load step magnitude */
+    uint8_t holdup_time;        /* Holdup time in ms, 0 if not supported */
+    uint8_t compliance;         /* Bit 0 LPS, bit 1 PS1, bit 2 PS2 */
+    uint8_t touch_current;      /* Bit 0 low touch current EPS, bit 1 ground pin, bit 2 ground for protective earth */
+    PD_peak_current_t peak_current[3];
+    uint8_t touch_temp;         /* 0: IEC 60950-1, 1: IEC 62368-1 TS1, 2: IEC 62368-1 TS2 */
+    uint8_t source_inputs;      /* Bit 0 external supply, bit 1 external supply unconstrained, bit 2 internal battery */
+    uint8_t batteries;          /* Bit 3...0 fixed batteries, bit 7...4 hot swappable battery slots */
+    uint8_t source_PDP;         /* Source PD Power in W */
+} PD_src_cap_ext_t;
+
+typedef struct {
+    uint8_t internal_temp;      /* Temperature in degree C, 0 if not supported, 1 if below 2 */
+    uint8_t present_input;      /* Bit 1 external power, bit 2 external AC, bit 3 internal battery, bit 4 internal non-battery */
+    uint8_t present_battery_input;
+    uint8_t event_flags;        /* Bit 1 OCP, bit 2 OTP, bit 3 OVP, bit 4 CF mode */
+    enum PPS_PTF_t temperature_status;
+    uint8_t power_status;       /* Power limited by bit 1 cable, bit 2 other ports, bit 3 external power, bit 4 event flags, bit 5 temperature */
+} PD_status_t;
+
+typedef struct {
+    uint16_t VID;
+    uint16_t PID;
+    char name[23];              /* Manufacturer string, null terminated */
+} PD_mfg_info_t;
+
 typedef struct {
     const char * name;
     uint8_t id;
@@ -96,6 +146,37 @@ typedef struct {
     uint16_t max_p;     /* Power in 250mW units */
 } PD_power_info_t;
 
+/* Source capability cache, see PD_protocol_set_src_cache(). Kept by the caller, in RTC memory
+   or saved to NVS, so a source seen before gets its Request without a policy evaluation */
+#ifndef PD_SRC_CACHE_SIZE
+#define PD_SRC_CACHE_SIZE               4
+#endif
+#define PD_SRC_CACHE_MAGIC              0x50444332  /* "PDC2", layout version */
+#define PD_SRC_CACHE_HARD_RESET         (1 << 0)    /* Source_Capabilities came only after a Hard Reset */
+
+typedef struct {
+    uint32_t id;                /* Fingerprint of the power data objects, 0 if the entry is free */
+    uint16_t PPS_voltage;       /* Setting the selection was made for */
+    uint8_t PPS_current;
+    uint8_t power_option;
+    uint8_t selected;           /* Power data object selected */
+    uint8_t flags;              /* PD_SRC_CACHE_ */
+    uint8_t rp;                 /* Rp level on CC at attach, 1: default USB, 2: 1.5A, 3: 3.0A */
+    uint16_t hits;
+} PD_src_cache_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    PD_src_cache_entry_t entry[PD_SRC_CACHE_SIZE];  /* Most recent first */
+} PD_src_cache_t;
+
+typedef struct {
+    uint8_t type;               /* Extended message being reassembled, 0 if none */
+    uint8_t chunk;              /* Next chunk expected */
+    uint16_t size;              /* Data Size of the whole message */
+    uint8_t data[PD_PROTOCOL_EXT_DATA_SIZE];
+} PD_ext_rx_t;
+
 struct PD_msg_state_t;
 typedef struct {
     const struct PD_msg_state_t *msg_state;
@@ -106,21 +187,40 @@ typedef struct {
     uint16_t PPS_voltage;
     uint8_t PPS_current;
     uint8_t PPSSDB[4];  /* PPS Status Data Block */
+    uint8_t SCEDB[25];  /* Source Capabilities Extended Data Block */
+    uint8_t SDB[7];     /* Status Data Block */
+    uint8_t MIDB[27];   /* Manufacturer Info Data Block, null terminated */
+    PD_protocol_event_t ext_received;  /* PD_PROTOCOL_EVENT_ of the data blocks received */
+
+    /* Extended messages, chunked */
+    PD_ext_rx_t ext_rx;
+    uint8_t ext_tx_type;    /* Chunk Request received for this message type, 0 if none */
+    uint8_t ext_tx_chunk;
 
     enum PD_power_option_t power_option;
     uint32_t power_data_obj[PD_PROTOCOL_MAX_NUM_OF_PDO];
     uint8_t power_data_obj_count;
     uint8_t power_data_obj_selected;
+    PD_src_cache_t * src_cache;
+    uint8_t src_cap_cached;     /* Selection of the last Source_Capabilities taken from the cache */
 } PD_protocol_t;
 
 /* Message handler */
 void PD_protocol_handle_msg(PD_protocol_t *p, uint16_t header, uint32_t *obj, PD_protocol_event_t *events);
 bool PD_protocol_respond(PD_protocol_t *p, uint16_t *h, uint32_t *obj);
+/* Last message sent got no GoodCRC after all retries */
+void PD_protocol_tx_failed(PD_protocol_t *p);
 
 /* PD Message creation */
 void PD_protocol_create_get_src_cap(PD_protocol_t *p, uint16_t *header);
+void PD_protocol_create_soft_reset(PD_protocol_t *p, uint16_t *header);
 void PD_protocol_create_get_PPS_status(PD_protocol_t *p, uint16_t *header);
+void PD_protocol_create_get_src_cap_ext(PD_protocol_t *p, uint16_t *header);
+void PD_protocol_create_get_status(PD_protocol_t *p, uint16_t *header);
+void PD_protocol_create_get_mfg_info(PD_protocol_t *p, uint16_t *header, uint32_t *obj);
 void PD_protocol_create_request(PD_protocol_t *p, uint16_t *header, uint32_t *obj);
+/* Header of a message created earlier, with the MessageID of the time it is sent */
+uint16_t PD_protocol_tx_header(PD_protocol_t *p, uint16_t header);
 
 /* Get functions */
 static inline uint8_t  PD_protocol_get_selected_power(PD_protocol_t *p) { return p->power_data_obj_selected; }
@@ -133,7 +233,11 @@ static inline uint16_t PD_protocol_get_rx_msg_header(PD_protocol_t *p) { return
 bool PD_protocol_get_msg_info(uint16_t header, PD_msg_info_t * msg_info);
 
 bool PD_protocol_get_power_info(PD_protocol_t *p, uint8_t index, PD_power_info_t *power_info);
+/* Return false until the source has sent the message */
 bool PD_protocol_get_PPS_status(PD_protocol_t *p, PPS_status_t * PPS_status);
+bool PD_protocol_get_src_cap_ext(PD_protocol_t *p, PD_src_cap_ext_t * src_cap_ext);
+bool PD_protocol_get_status(PD_protocol_t *p, PD_status_t * status);
+bool PD_protocol_get_mfg_info(PD_protocol_t *p, PD_mfg_info_t * mfg_info);
 
 /* Set Fixed and Variable power option */
 bool PD_protocol_set_power_option(PD_protocol_t *p, enum PD_power_option_t option);
@@ -143,6 +247,15 @@ bool PD_protocol_select_power(PD_protocol_t *p, uint8_t index);
    strict=true, If PPS setting is not qualified, return false, nothing is changed.
    strict=false, if PPS setting is not qualified, fall back to regular power option */
 bool PD_protocol_set_PPS(PD_protocol_t * p, uint16_t PPS_voltage, uint8_t PPS_current, bool strict);  
+/* Return true if a PPS APDO of the source covers the setting, nothing is changed */
+bool PD_protocol_check_PPS(PD_protocol_t * p, uint16_t PPS_voltage, uint8_t PPS_current);
+
+/* Cache of the selection per source, NULL to evaluate every Source_Capabilities. A cache with
+   another layout version (or random RTC memory after power on) is cleared */
+void PD_protocol_set_src_cache(PD_protocol_t *p, PD_src_cache_t *cache);
+/* Entry of the source of the last Source_Capabilities, NULL without a cache or before them */
+PD_src_cache_entry_t * PD_protocol_get_src_cache_entry(PD_protocol_t *p);
+bool PD_protocol_src_cache_has(PD_protocol_t *p, uint8_t flags, uint8_t rp);  /* A cached source with Rp level rp has one of flags */
 
 void PD_protocol_reset(PD_protocol_t *p);
 void PD_protocol_init(PD_protocol_t *p);
@@ -0,0 +1,85 @@
+/**
+ * PD_UFP_Trace.h
+ *
+ * Compact binary trace of the PD traffic seen by PD_UFP_c, for record on the device and
+ * replay on a host. Requires only stdint.h, stdbool.h and string.h
+ *
+ * Records are kept in a ring buffer supplied by the user, the oldest records are dropped
+ * when it is full. PD_trace_copy() writes the trace as a file image:
+ *
+ *   Image header, 8 bytes:  'P' 'D' 'T' 'R', version, 0, dropped records (uint16)
+ *   Record:                 type (uint8), time in ms (uint16), payload
+ *     PD_TRACE_CONFIG       power option (uint8), PPS voltage (uint16), PPS current (uint8)
+ *     PD_TRACE_EVENT        FUSB302 events (uint8)
+ *     PD_TRACE_RX, _TX      message header (uint16), data objects (uint32 x Number of Data Objects)
+ *     PD_TRACE_HARD_RESET   none
+ *     PD_TRACE_TIMER        timer (uint8), see PD_trace_timer_t, version 2
+ *
+ * All values little endian. Time is the 16-bit clock of PD_UFP_c and wraps every 65.5s.
+ *
+ */
+
+#ifndef PD_UFP_TRACE_H
+#define PD_UFP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PD_TRACE_VERSION            2       /* Version 1 images, without PD_TRACE_TIMER, still parse */
+#define PD_TRACE_IMAGE_HEADER_SIZE  8
+#define PD_TRACE_MAX_RECORD_SIZE    33
+
+enum PD_trace_type_t {
+    PD_TRACE_CONFIG         = 1,    /* Power option or PPS setting applied to the protocol engine */
+    PD_TRACE_EVENT          = 2,    /* FUSB302 events handled by PD_UFP_c */
+    PD_TRACE_RX             = 3,    /* Message received, GoodCRC included */
+    PD_TRACE_TX             = 4,    /* Message sent */
+    PD_TRACE_HARD_RESET     = 5,    /* Hard Reset sent */
+    PD_TRACE_TIMER          = 6     /* Protocol timer expired in PD_UFP_c::timer() */
+};
+
+enum PD_trace_timer_t {
+    PD_TRACE_TIMER_SRC_CAP      = 0,    /* tTypeCSinkWaitCap, no Source_Capabilities */
+    PD_TRACE_TIMER_PS_RDY       = 1,    /* tRequestToPSReady, no PS_RDY */
+    PD_TRACE_TIMER_PPS_REQUEST  = 2     /* tPPSRequest, PPS keepalive Request due */
+};
+
+typedef struct {
+    uint8_t * buffer;
+    uint16_t size;
+    uint16_t head;      /* Next byte written */
+    uint16_t tail;      /* Oldest record */
+    uint16_t used;
+    uint16_t dropped;   /* Records overwritten by newer ones */
+} PD_trace_t;
+
+typedef struct {
+    enum PD_trace_type_t type;
+    uint16_t time;
+    uint8_t events;
+    uint16_t header;
+    uint8_t num_of_obj;
+    uint32_t obj[7];
+    uint8_t power_option;
+    uint16_t PPS_voltage;
+    uint8_t PPS_current;
+    uint8_t timer;
+} PD_trace_record_t;
+
+/* Record */
+void PD_trace_init(PD_trace_t * t, uint8_t * buffer, uint16_t size);
+void PD_trace_clear(PD_trace_t * t);
+void PD_trace_config(PD_trace_t * t, uint16_t time, uint8_t power_option, uint16_t PPS_voltage, uint8_t PPS_current);
+void PD_trace_event(PD_trace_t * t, uint16_t time, uint8_t events);
+void PD_trace_msg(PD_trace_t * t, uint16_t time, enum PD_trace_type_t type, uint16_t header, const uint32_t * obj);
+void PD_trace_hard_reset(PD_trace_t * t, uint16_t time);
+void PD_trace_timer(PD_trace_t * t, uint16_t time, enum PD_trace_timer_t timer);
+
+/* Export as a file image, oldest record first. Return the image size, 0 if maxlen is too small */
+uint16_t PD_trace_copy(const PD_trace_t * t, uint8_t * image, uint16_t maxlen);
+static inline uint16_t PD_trace_image_size(const PD_trace_t * t) { return PD_TRACE_IMAGE_HEADER_SIZE + t->used; }
+
+/* Parse a file image, start with *offset = 0. Return false at the end or on a malformed image */
+bool PD_trace_next(const uint8_t * image, uint32_t size, uint32_t * offset, PD_trace_record_t * r);
+
+#endif
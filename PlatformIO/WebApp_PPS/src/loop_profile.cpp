@@ -0,0 +1,168 @@
+/**
+ * loop_profile.cpp
+ *
+ * Compile-time loop and task timing profiler, see loop_profile.h
+ *
+ */
+
+#include "loop_profile.h"
+
+#ifdef LOOP_PROFILE
+
+#include <string.h>
+
+static const char * const loop_profile_name[LOOP_PROFILE_NUM_OF_ID] = {
+    "loop_period", "loop", "current", "adc", "http", "pd_task", "pd_wake"
+};
+
+static loop_profile_hist_t hist[LOOP_PROFILE_NUM_OF_ID];
+static uint32_t last_mark[LOOP_PROFILE_NUM_OF_ID];     /* 0 until the first mark after a reset */
+static uint32_t cycles_per_us = 1;
+static uint32_t time_print;
+
+static uint8_t bucket_index(uint32_t us)
+{
+    if (us < 8) {
+        return us;
+    }
+    uint8_t msb = 31 - __builtin_clz(us);
+    return (msb - 2) * 8 + ((us >> (msb - 3)) & 7);
+}
+
+/* Middle of the bucket, exact below 8us */
+static uint32_t bucket_value(uint8_t index)
+{
+    if (index < 8) {
+        return index;
+    }
+    uint8_t msb = index / 8 + 2;
+    uint32_t low = (uint32_t)(8 + index % 8) << (msb - 3);
+    return low + (((uint32_t)1 << (msb - 3)) >> 1);
+}
+
+void loop_profile_init(void)
+{
+#if defined(__riscv)
+    /* Count CPU cycles in PCCR: PCER selects cycles, PCMR enables counting */
+    __asm__ __volatile__("csrw 0x7E0, %0" :: "r"(1));
+    __asm__ __volatile__("csrw 0x7E1, %0" :: "r"(1));
+    cycles_per_us = getCpuFrequencyMhz();
+#endif
+    loop_profile_reset();
+}
+
+void loop_profile_reset(void)
+{
+    memset(hist, 0, sizeof(hist));
+    memset(last_mark, 0, sizeof(last_mark));
+    for (uint8_t i = 0; i < LOOP_PROFILE_NUM_OF_ID; i++) {
+        hist[i].min_us = UINT32_MAX;
+    }
+    time_print = millis();
+}
+
+void loop_profile_record(enum loop_profile_id_t id, uint32_t cycles)
+{
+    loop_profile_record_us(id, cycles / cycles_per_us);
+}
+
+void loop_profile_record_us(enum loop_profile_id_t id, uint32_t us)
+{
+    loop_profile_hist_t * h = &hist[id];
+    h->count++;
+    h->min_us = us < h->min_us ? us : h->min_us;
+    h->max_us = us > h->max_us ? us : h->max_us;
+    h->bucket[bucket_index(us)]++;
+}
+
+void loop_profile_pd_task(void * ctx, uint32_t run_us, uint32_t wake_us)
+{
+    loop_profile_record_us(LOOP_PROFILE_PD_TASK, run_us);
+    if (wake_us) {
+        loop_profile_record_us(LOOP_PROFILE_PD_WAKE, wake_us);
+    }
+}
+
+void loop_profile_mark(enum loop_profile_id_t id)
+{
+    uint32_t now = loop_profile_cycles();
+    if (last_mark[id]) {
+        loop_profile_record(id, now - last_mark[id]);
+    }
+    last_mark[id] = now ? now : 1;
+}
+
+const loop_profile_hist_t * loop_profile_get(enum loop_profile_id_t id)
+{
+    return &hist[id];
+}
+
+/* Value at or below which percent of the samples fall, 0 without samples */
+uint32_t loop_profile_percentile(enum loop_profile_id_t id, uint8_t percent)
+{
+    const loop_profile_hist_t * h = &hist[id];
+    uint32_t rank = (uint32_t)(((uint64_t)h->count * percent + 99) / 100), seen = 0;
+    if (h->count == 0) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < LOOP_PROFILE_NUM_OF_BUCKET; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            uint32_t us = bucket_value(i);
+            /* The bucket middle can fall outside the samples seen */
+            return us < h->min_us ? h->min_us : us > h->max_us ? h->max_us : us;
+        }
+    }
+    return h->max_us;
+}
+
+static int loop_profile_readline(char * buffer, int maxlen, uint8_t line)
+{
+    if (line == 0) {
+        return snprintf(buffer, maxlen, "section         count     min_us     p50_us     p99_us     max_us\n");
+    }
+    enum loop_profile_id_t id = (enum loop_profile_id_t)(line - 1);
+    const loop_profile_hist_t * h = &hist[id];
+    return snprintf(buffer, maxlen, "%-11s %9lu %10lu %10lu %10lu %10lu\n", loop_profile_name[id],
+        (unsigned long)h->count, (unsigned long)(h->count ? h->min_us : 0),
+        (unsigned long)loop_profile_percentile(id, 50), (unsigned long)loop_profile_percentile(id, 99),
+        (unsigned long)h->max_us);
+}
+
+int loop_profile_dump(char * buffer, int maxlen)
+{
+    char line[80];
+    int len = 0;
+    if (maxlen <= 0) {
+        return 0;
+    }
+    buffer[0] = 0;
+    for (uint8_t i = 0; i <= LOOP_PROFILE_NUM_OF_ID; i++) {
+        int n = loop_profile_readline(line, sizeof(line), i);
+        if (len + n >= maxlen) {
+            break;
+        }
+        memcpy(buffer + len, line, n + 1);
+        len += n;
+    }
+    return len;
+}
+
+void loop_profile_print(HardwareSerial & serial)
+{
+    char line[80];
+    for (uint8_t i = 0; i <= LOOP_PROFILE_NUM_OF_ID; i++) {
+        loop_profile_readline(line, sizeof(line), i);
+        serial.print(line);
+    }
+}
+
+void loop_profile_report(HardwareSerial & serial)
+{
+    if (LOOP_PROFILE_PRINT_MS && millis() - time_print >= LOOP_PROFILE_PRINT_MS) {
+        time_print = millis();
+        loop_profile_print(serial);
+    }
+}
+
+#endif
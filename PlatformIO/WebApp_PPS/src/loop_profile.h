@@ -0,0 +1,112 @@
+/**
+ * loop_profile.h
+ *
+ * Compile-time loop and task timing profiler, built with -D LOOP_PROFILE, otherwise every
+ * macro below is empty and nothing is linked.
+ *
+ * Sections are timed with the CPU cycle counter and kept as log-linear histograms
+ * (8 buckets per power of two, 12.5% resolution) of microseconds, so min/p50/p99/max can be
+ * reported at any time without storing samples:
+ *
+ *   void loop()
+ *   {
+ *     LOOP_PROFILE_MARK(LOOP_PROFILE_LOOP_PERIOD);     time since the previous loop()
+ *     LOOP_PROFILE_SCOPE(LOOP_PROFILE_LOOP);           time until the end of the block
+ *     ...
+ *   }
+ *
+ * Times are wall clock: a section preempted by a higher priority task (PD_UFP, async_tcp, BLE)
+ * includes the time it was preempted. The counter wraps after 2^32 cycles (26.8s at 160MHz),
+ * a longer section is reported modulo that.
+ *
+ * The PD task is timed by PD_UFP_c itself, pass loop_profile_pd_task() to
+ * PD_UFP_c::set_task_hook(). Its sections stay empty where run() is called from loop().
+ *
+ */
+
+#ifndef LOOP_PROFILE_H
+#define LOOP_PROFILE_H
+
+#include <stdint.h>
+
+#include <Arduino.h>
+
+enum loop_profile_id_t {
+    LOOP_PROFILE_LOOP_PERIOD = 0,   /* Start of loop() to the next start of loop() */
+    LOOP_PROFILE_LOOP,              /* loop() */
+    LOOP_PROFILE_CURRENT,           /* processCurrentReading() */
+    LOOP_PROFILE_ADC,               /* readFilteredADC() */
+    LOOP_PROFILE_HTTP,              /* Web server request handlers */
+    LOOP_PROFILE_PD_TASK,           /* PD task, run() calls of one wake up */
+    LOOP_PROFILE_PD_WAKE,           /* PD task, INT_N edge to the task running */
+    LOOP_PROFILE_NUM_OF_ID
+};
+
+#ifdef LOOP_PROFILE
+
+#define LOOP_PROFILE_NUM_OF_BUCKET  240     /* 8 exact buckets below 8us, then 8 per power of two */
+#define LOOP_PROFILE_PRINT_MS       10000   /* Serial report interval, 0 to disable */
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t bucket[LOOP_PROFILE_NUM_OF_BUCKET];
+} loop_profile_hist_t;
+
+static inline uint32_t loop_profile_cycles(void)
+{
+#if defined(__riscv)
+    /* ESP32-C3 has no mcycle, its machine performance counter (PCCR) counts CPU cycles */
+    uint32_t cycles;
+    __asm__ __volatile__("csrr %0, 0x7E2" : "=r"(cycles));
+    return cycles;
+#else
+    /* Host builds, one cycle per us */
+    return micros();
+#endif
+}
+
+void loop_profile_init(void);
+void loop_profile_reset(void);
+void loop_profile_record(enum loop_profile_id_t id, uint32_t cycles);
+void loop_profile_record_us(enum loop_profile_id_t id, uint32_t us);
+/* PD_UFP_task_hook_t, from the PD task */
+void loop_profile_pd_task(void * ctx, uint32_t run_us, uint32_t wake_us);
+void loop_profile_mark(enum loop_profile_id_t id);
+const loop_profile_hist_t * loop_profile_get(enum loop_profile_id_t id);
+uint32_t loop_profile_percentile(enum loop_profile_id_t id, uint8_t percent);
+/* Text table, truncated at whole lines, return the length written */
+int loop_profile_dump(char * buffer, int maxlen);
+void loop_profile_print(HardwareSerial & serial);
+/* Print to serial every LOOP_PROFILE_PRINT_MS, call from loop() outside any section */
+void loop_profile_report(HardwareSerial & serial);
+
+class loop_profile_scope_c
+{
+    public:
+        loop_profile_scope_c(enum loop_profile_id_t id) : id(id), start(loop_profile_cycles()) {}
+        ~loop_profile_scope_c() { loop_profile_record(id, loop_profile_cycles() - start); }
+
+    protected:
+        enum loop_profile_id_t id;
+        uint32_t start;
+};
+
+#define LOOP_PROFILE_CONCAT_(a, b)  a##b
+#define LOOP_PROFILE_CONCAT(a, b)   LOOP_PROFILE_CONCAT_(a, b)
+#define LOOP_PROFILE_SCOPE(id)      loop_profile_scope_c LOOP_PROFILE_CONCAT(loop_profile_scope_, __LINE__)(id)
+#define LOOP_PROFILE_MARK(id)       loop_profile_mark(id)
+#define LOOP_PROFILE_INIT()         loop_profile_init()
+#define LOOP_PROFILE_REPORT(serial) loop_profile_report(serial)
+
+#else
+
+#define LOOP_PROFILE_SCOPE(id)
+#define LOOP_PROFILE_MARK(id)
+#define LOOP_PROFILE_INIT()
+#define LOOP_PROFILE_REPORT(serial)
+
+#endif
+
+#endif
@@ -58,6 +58,7 @@
 #include <WiFiManager.h> // Include the WiFiManager library
 #include <ESPAsyncWebServer.h>
 #include <SPIFFS.h>
+#include "loop_profile.h" // Build with -D LOOP_PROFILE for loop and handler timing
 
 void initializeSerialAndPins();
 void initializeUSB_PD();
@@ -77,6 +78,8 @@ int adcSum = 0;
 unsigned long lastUpdateTime = 0;
 const unsigned long updateInterval = 100; // Set sample rate
 const int usb_pd_int_pin = 10;
+const int i2c_sda_pin = 1;
+const int i2c_scl_pin = 0;
 const int output_pin = 3;
 const int current_pin = 2;
 const int debug_led = 8;
@@ -87,8 +90,13 @@ float currentSet = 1;// in Ampere
 int adcError = 0;
 
 PD_UFP_c PD_UFP;
+#ifdef I2C_PROFILE
+PD_UFP_i2c_profile_t i2c_profile; // Per register I2C counters, served on /i2c_profile
+#endif
+PD_UFP_I2C_Wire_c pd_i2c(Wire, i2c_sda_pin, i2c_scl_pin, 400000); // FUSB302, recovered on its pins
 
 void handleCurrentChange(AsyncWebServerRequest *request) {
+  LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
   if (request->hasParam("current")) {
     float newCurrent = request->getParam("current")->value().toFloat();
     if (newCurrent != currentSet) {
@@ -106,6 +114,7 @@ void handleCurrentChange(AsyncWebServerRequest *request) {
 }
 void handleVoltageChange(AsyncWebServerRequest *request)
 {
+  LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
   if (request->hasParam("voltage"))
   {
     float newVoltage = request->getParam("voltage")->value().toFloat();
@@ -117,12 +126,12 @@ void handleVoltageChange(AsyncWebServerRequest *request)
       Serial.println(voltage);
       // esp_restart();                  // Restart ESP32-C3 to apply new voltage setting
       PD_UFP.set_PPS(PPS_V(voltage), PPS_A(currentSet));
+      request->send(200, "text/plain", String(voltage));
     }
     else
     {
       request->send(200, "text/plain", "Voltage unchanged");
     }
-    request->send(200, "text/plain", String(voltage));
   }
   else
   {
@@ -132,6 +141,7 @@ void handleVoltageChange(AsyncWebServerRequest *request)
 
 void handleOutputControl(AsyncWebServerRequest *request)
 {
+  LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
   if (request->hasParam("output"))
   {
     String outputState = request->getParam("output")->value();
@@ -166,6 +176,7 @@ void setup()
 
   Serial.begin(115200);
   Serial.println("Connected to WiFi");
+  LOOP_PROFILE_INIT();
 
   initializeUSB_PD();
   for (int i = 0; i < 30; i++)
@@ -186,15 +197,36 @@ void setup()
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
             { request->send(SPIFFS, "/index.html"); });
   server.on("/current", HTTP_GET, [](AsyncWebServerRequest *request)
-            { request->send(200, "text/plain", String(current)); });
+            { LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
+              request->send(200, "text/plain", String(current)); });
   server.on("/get_voltage", HTTP_GET, [](AsyncWebServerRequest *request)
-            { request->send(200, "text/plain", String(voltage)); });
+            { LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
+              request->send(200, "text/plain", String(voltage)); });
   server.on("/get_current", HTTP_GET, [](AsyncWebServerRequest *request)
-            { request->send(200, "text/plain", String(currentSet)); });
+            { LOOP_PROFILE_SCOPE(LOOP_PROFILE_HTTP);
+              request->send(200, "text/plain", String(currentSet)); });
   server.on("/set_voltage", HTTP_GET, handleVoltageChange);
 
   server.on("/set_output", HTTP_GET, handleOutputControl);
   server.on("/set_current", HTTP_GET, handleCurrentChange);
+#ifdef I2C_PROFILE
+  server.on("/i2c_profile", HTTP_GET, [](AsyncWebServerRequest *request)
+            { static char buf[1536];
+              PD_UFP_c::i2c_profile_dump(buf, sizeof(buf));
+              request->send(200, "text/plain", buf); });
+  server.on("/i2c_profile_reset", HTTP_GET, [](AsyncWebServerRequest *request)
+            { PD_UFP_c::i2c_profile_reset();
+              request->send(200, "text/plain", "I2C profile cleared"); });
+#endif
+#ifdef LOOP_PROFILE
+  server.on("/loop_profile", HTTP_GET, [](AsyncWebServerRequest *request)
+            { static char buf[640];
+              loop_profile_dump(buf, sizeof(buf));
+              request->send(200, "text/plain", buf); });
+  server.on("/loop_profile_reset", HTTP_GET, [](AsyncWebServerRequest *request)
+            { loop_profile_reset();
+              request->send(200, "text/plain", "Loop profile cleared"); });
+#endif
 
   server.begin();
 
@@ -205,8 +237,13 @@ void setup()
 
 void loop()
 {
-  updateStatus();
-  processCurrentReading();
+  LOOP_PROFILE_MARK(LOOP_PROFILE_LOOP_PERIOD);
+  {
+    LOOP_PROFILE_SCOPE(LOOP_PROFILE_LOOP);
+    updateStatus();
+    processCurrentReading();
+  }
+  LOOP_PROFILE_REPORT(Serial);
 }
 
 // Initialize Serial and Pin Modes
@@ -225,9 +262,17 @@ void initializeSerialAndPins()
 // Initialize USB Power Delivery
 void initializeUSB_PD()
 {
-  Wire.begin(1, 0);
+  Wire.begin(i2c_sda_pin, i2c_scl_pin);
   Wire.setClock(400000);
+  PD_UFP_c::i2c_transport_set(&pd_i2c); // Same pins and clock after a bus recovery
+#ifdef I2C_PROFILE
+  PD_UFP_c::i2c_profile_set(&i2c_profile); // Counts every FUSB302 access, off unless built with -D I2C_PROFILE
+#endif
   PD_UFP.init_PPS(usb_pd_int_pin, PPS_V(5), PPS_A(2.0));
+#ifdef LOOP_PROFILE
+  PD_UFP.set_task_hook(loop_profile_pd_task); // pd_task and pd_wake on /loop_profile
+#endif
+  PD_UFP.start_task(); // Service USB PD on INT_N from its own task, PD_UFP.run() stays for boards without one
  }
 
 // Update status at intervals
@@ -238,12 +283,13 @@ void updateStatus()
     lastUpdateTime = millis();
     // Add any periodic update logic here
   }
-  PD_UFP.run();
+  PD_UFP.run(); // Returns at once while the PD task runs
 }
 
 // Process current reading and adjust LED status
 void processCurrentReading()
 {
+  LOOP_PROFILE_SCOPE(LOOP_PROFILE_CURRENT);
   if (output)
   {
     digitalWrite(output_pin, HIGH);
@@ -259,6 +305,7 @@ void processCurrentReading()
 // Reads ADC value with a moving average filter
 int readFilteredADC(int pin)
 {
+  LOOP_PROFILE_SCOPE(LOOP_PROFILE_ADC);
   int newSample = analogRead(pin);
   adcSum -= adcSamples[adcIndex];
   adcSamples[adcIndex] = newSample;
@@ -21,6 +21,28 @@ extern "C" {
 #define CONFIG_USB_PD_PORT_COUNT 1
 extern struct i2c_master_module i2c_master_instance;
 
+/* Optional I2C accounting, per FUSB302 start register */
+#define TCPC_I2C_PROFILE_NUM_OF_REG 0x44
+struct tcpc_i2c_reg_stats_t {
+  uint32_t reads;         /* Read transactions */
+  uint32_t writes;        /* Write transactions */
+  uint32_t bytes_read;    /* Data bytes, register address not included */
+  uint32_t bytes_written;
+  uint32_t time_us;       /* Time spent in the transport */
+};
+
+struct tcpc_i2c_profile_t {
+  struct tcpc_i2c_reg_stats_t reg[TCPC_I2C_PROFILE_NUM_OF_REG];
+};
+
+/* Accounting is off until a profile buffer is set, NULL to disable */
+void tcpc_i2c_profile_set(struct tcpc_i2c_profile_t *profile);
+const struct tcpc_i2c_profile_t *tcpc_i2c_profile_get(void);
+void tcpc_i2c_profile_reset(void);
+/* Text table of the registers accessed so far, return the length written */
+int tcpc_i2c_profile_dump(char *buffer, int maxlen);
+void tcpc_i2c_profile_print(void);
+
 #ifdef __cplusplus
 }
 #endif
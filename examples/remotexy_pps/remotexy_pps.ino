@@ -88,6 +88,7 @@ PD_UFP_c PD_UFP;
 void setup() {
   Wire.begin(1,0);
   PD_UFP.init_PPS(FUSB302_INT_PIN, PPS_V(12.0), PPS_A(1.0));
+  PD_UFP.start_task(); // Service USB PD on INT_N from its own task, PD_UFP.run() stays for boards without one
   
   Serial.begin(9600);
   pinMode(OUTPUT_PIN,OUTPUT);
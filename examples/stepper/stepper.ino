@@ -56,6 +56,7 @@ void setup() {
   Wire.begin(1,0);
   Wire.setClock(400000);
   PD_UFP.init_PPS(usb_pd_int_pin, PPS_V(12.0), PPS_A(2.0));
+  PD_UFP.start_task(); // Service USB PD on INT_N from its own task, PD_UFP.run() stays for boards without one
   Serial1.println("USB PD initialized.");
 
   // Initialize stepper motor pins
@@ -8,6 +8,8 @@
 #include "tcpm_driver.h"
 #include "Arduino.h"
 #include <Wire.h>
+#include <stdio.h>
+#include <string.h>
 
 extern const struct tcpc_config_t tcpc_config[CONFIG_USB_PD_PORT_COUNT];
 
@@ -40,47 +42,171 @@ extern "C" {
   }
 }
 
+/* Optional I2C accounting */
+static struct tcpc_i2c_profile_t *i2c_profile;
+static int i2c_profile_last_reg;
+
+void tcpc_i2c_profile_set(struct tcpc_i2c_profile_t *profile)
+{
+  i2c_profile = profile;
+  tcpc_i2c_profile_reset();
+}
+
+const struct tcpc_i2c_profile_t *tcpc_i2c_profile_get(void)
+{
+  return i2c_profile;
+}
+
+void tcpc_i2c_profile_reset(void)
+{
+  if (i2c_profile) {
+    memset(i2c_profile, 0, sizeof(struct tcpc_i2c_profile_t));
+  }
+}
+
+static void i2c_profile_account(int reg, int bytes_read, int bytes_written, uint32_t time_start)
+{
+  struct tcpc_i2c_reg_stats_t *r;
+  if (reg < 0 || reg >= TCPC_I2C_PROFILE_NUM_OF_REG) {
+    reg = 0;
+  }
+  r = &i2c_profile->reg[reg];
+  if (bytes_written || bytes_read == 0) {
+    r->writes++;
+    r->bytes_written += bytes_written;
+  }
+  if (bytes_read) {
+    r->reads++;
+    r->bytes_read += bytes_read;
+  }
+  r->time_us += micros() - time_start;
+  i2c_profile_last_reg = reg;
+}
+
+static const char *i2c_profile_reg_name(int reg)
+{
+  static const char * const control_name[] = {
+    "DEVICE_ID", "SWITCHES0", "SWITCHES1", "MEASURE", "SLICE", "CONTROL0", "CONTROL1", "CONTROL2",
+    "CONTROL3", "MASK", "POWER", "RESET", "OCPREG", "MASKA", "MASKB", "CONTROL4"
+  };
+  static const char * const status_name[] = {
+    "STATUS0A", "STATUS1A", "INTERRUPTA", "INTERRUPTB", "STATUS0", "STATUS1", "INTERRUPT", "FIFOS"
+  };
+  if (reg >= TCPC_REG_DEVICE_ID && reg <= 0x10) {
+    return control_name[reg - TCPC_REG_DEVICE_ID];
+  }
+  if (reg >= 0x3C && reg <= TCPC_REG_FIFOS) {
+    return status_name[reg - 0x3C];
+  }
+  return "?";
+}
+
+static int i2c_profile_readline(char *buffer, int maxlen, int reg)
+{
+  const struct tcpc_i2c_reg_stats_t *r = &i2c_profile->reg[reg];
+  if (r->reads == 0 && r->writes == 0) {
+    buffer[0] = 0;
+    return 0;
+  }
+  return snprintf(buffer, maxlen, "0x%02X %-10s %8lu %8lu %9lu %9lu %10lu\n", reg, i2c_profile_reg_name(reg),
+    (unsigned long)r->reads, (unsigned long)r->writes, (unsigned long)r->bytes_read,
+    (unsigned long)r->bytes_written, (unsigned long)r->time_us);
+}
+
+static const char i2c_profile_header[] = "reg  name          reads   writes  rd_bytes  wr_bytes    time_us\n";
+
+int tcpc_i2c_profile_dump(char *buffer, int maxlen)
+{
+  char line[80];
+  int reg, n, len;
+  if (i2c_profile == NULL || maxlen <= (int)sizeof(i2c_profile_header)) {
+    return 0;
+  }
+  strcpy(buffer, i2c_profile_header);
+  len = sizeof(i2c_profile_header) - 1;
+  for (reg = 0; reg < TCPC_I2C_PROFILE_NUM_OF_REG; reg++) {
+    n = i2c_profile_readline(line, sizeof(line), reg);
+    if (len + n >= maxlen) {
+      break;
+    }
+    memcpy(buffer + len, line, n + 1);
+    len += n;
+  }
+  return len;
+}
+
+void tcpc_i2c_profile_print(void)
+{
+  char line[80];
+  int reg;
+  if (i2c_profile == NULL) {
+    return;
+  }
+  Serial.print(i2c_profile_header);
+  for (reg = 0; reg < TCPC_I2C_PROFILE_NUM_OF_REG; reg++) {
+    if (i2c_profile_readline(line, sizeof(line), reg)) {
+      Serial.print(line);
+    }
+  }
+}
+
 /* I2C wrapper functions - get I2C port / slave addr from config struct. */
 int tcpc_write(int port, int reg, int val)
 {
+  uint32_t time_start = i2c_profile ? micros() : 0;
   WirebeginTransmission(fusb302_I2C_SLAVE_ADDR);
   Wirewrite(reg & 0xFF);
   Wirewrite(val & 0xFF);
   WireendTransmission(true);
+  if (i2c_profile) {
+    i2c_profile_account(reg, 0, 1, time_start);
+  }
   
   return 0;
 }
 
 int tcpc_write16(int port, int reg, int val)
 {
+  uint32_t time_start = i2c_profile ? micros() : 0;
   WirebeginTransmission(fusb302_I2C_SLAVE_ADDR);
   Wirewrite(reg & 0xFF);
   Wirewrite(val & 0xFF);
   Wirewrite((val >> 8) & 0xFF);
   WireendTransmission(true);
+  if (i2c_profile) {
+    i2c_profile_account(reg, 0, 2, time_start);
+  }
   
   return 0;
 }
 
 int tcpc_read(int port, int reg, int *val)
 {
+  uint32_t time_start = i2c_profile ? micros() : 0;
   WirebeginTransmission(fusb302_I2C_SLAVE_ADDR);
   Wirewrite(reg & 0xFF);
   WireendTransmission(false);
   WirerequestFrom(fusb302_I2C_SLAVE_ADDR, 1, true);
   *val = Wireread();
+  if (i2c_profile) {
+    i2c_profile_account(reg, 1, 0, time_start);
+  }
 
   return 0;
 }
 
 int tcpc_read16(int port, int reg, int *val)
 {
+  uint32_t time_start = i2c_profile ? micros() : 0;
   WirebeginTransmission(fusb302_I2C_SLAVE_ADDR);
   Wirewrite(reg & 0xFF);
   WireendTransmission(false);
   WirerequestFrom(fusb302_I2C_SLAVE_ADDR, 1, true);
   *val  = Wireread();
   *val |= (Wireread() << 8);
+  if (i2c_profile) {
+    i2c_profile_account(reg, 1, 0, time_start);
+  }
 
   return 0;
 }
@@ -90,6 +216,12 @@ int tcpc_xfer(int port,
 	uint8_t *in, int in_size,
 	int flags)
 {
+  uint32_t time_start = i2c_profile ? micros() : 0;
+  /* First byte out is the register, a read without it continues from the last register */
+  int reg = out_size ? out[0] : i2c_profile_last_reg;
+  int bytes_written = out_size ? out_size - 1 : 0;
+  int bytes_read = in_size;
+
   if (out_size)
   {
     WirebeginTransmission(fusb302_I2C_SLAVE_ADDR);
@@ -114,6 +246,9 @@ int tcpc_xfer(int port,
         in++;
     }
   }
+  if (i2c_profile) {
+    i2c_profile_account(reg, bytes_read, bytes_written, time_start);
+  }
 
   return 0;
 }
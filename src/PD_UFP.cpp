@@ -22,6 +22,11 @@
 #define t_TypeCSinkWaitCap      350
 #define t_RequestToPSReady      580     // combine t_SenderResponse and t_PSTransition
 #define t_PPSRequest            5000    // must less than 10000 (10s)
+#define t_SenderResponse        30      // reply to Get_Source_Cap_Extended, Get_Status and Get_Manufacturer_Info
+#define t_PPSStatusGuard        100     // no Get_PPS_Status this close to the next keepalive Request
+#define v_PpsSmallStep          PPS_V(0.5)
+#define t_PD_TASK_WAKE          10      // PD task wake up for the timers when INT_N is idle
+#define t_I2CRecover            20      // I2C bus recovery retried no more often while it fails
 
 #define PIN_FUSB302_INT         12
 
@@ -36,8 +41,32 @@ enum {
     STATUS_LOG_POWER_REJECT,
     STATUS_LOG_LOAD_SW_ON,
     STATUS_LOG_LOAD_SW_OFF,
+    STATUS_LOG_MSG_TX_FAILED,
+    STATUS_LOG_I2C_ERROR,
+    STATUS_LOG_I2C_RECOVERED,
+    STATUS_LOG_HARD_RESET,
+    STATUS_LOG_SOFT_RESET,
+    STATUS_LOG_RESET_RECOVERED,
+    STATUS_LOG_SRC_CAP_EXT,
+    STATUS_LOG_STATUS,
+    STATUS_LOG_MFG_INFO,
+    STATUS_LOG_PPS_STATUS,
 };
 
+/* Default I2C transport */
+static PD_UFP_I2C_Wire_c i2c_wire;
+
+/* Default time source */
+static uint32_t arduino_clock_ms(void)
+{
+    return millis();
+}
+
+static void arduino_delay_ms(uint32_t ms)
+{
+    delay(ms);
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // PD_UFP_c
@@ -47,6 +76,10 @@ PD_UFP_c::PD_UFP_c():
     ready_current(0),
     PPS_voltage_next(0),
     PPS_current_next(0),
+    PPS_target_voltage(0),
+    PPS_target_current(0),
+    PPS_target_pending(0),
+    PPS_slew_step(v_PpsSmallStep),
     status_initialized(0),
     status_src_cap_received(0),
     status_power(STATUS_POWER_NA),
@@ -54,13 +87,45 @@ PD_UFP_c::PD_UFP_c():
     time_wait_src_cap(0),
     time_wait_ps_rdy(0),
     time_PPS_request(0),
+    time_wait_response(0),
+    time_PPS_status(0),
+    PPS_status_interval(0),
     get_src_cap_retry_count(0),
     wait_src_cap(0),
     wait_ps_rdy(0),
-    send_request(0)
+    send_request(0),
+    wait_response(0),
+    PPS_status_valid(0),
+    src_cache(0),
+    src_cap_first(0),
+    src_cap_flags(0),
+    src_cap_rp(0),
+    src_cap_silent(0),
+    wait_soft_reset(0),
+    time_reset(0),
+    reset_recovery(0),
+    tx_queued(0),
+    time_i2c_recover(0),
+    trace(0),
+#ifdef PD_UFP_TASK
+    task_handle(0),
+    task_lock(0),
+    time_isr(0),
+#endif
+    task_hook(0),
+    task_hook_ctx(0),
+    i2c_transport(0),
+    i2c_address(FUSB302_I2C_ADDRESS),
+    clock_prescaler(0),
+    clock_source(0),
+    delay_source(0)
 {
     memset(&FUSB302, 0, sizeof(FUSB302_dev_t));
     memset(&protocol, 0, sizeof(PD_protocol_t));
+    memset(&health, 0, sizeof(PD_UFP_health_t));
+    memset(&reset_stats, 0, sizeof(PD_UFP_reset_stats_t));
+    memset(&PPS_status, 0, sizeof(PPS_status_t));
+    health.bus_ok = 1;
 }
 
 void PD_UFP_c::init(uint8_t int_pin, enum PD_power_option_t power_option)
@@ -71,12 +136,25 @@ void PD_UFP_c::init(uint8_t int_pin, enum PD_power_option_t power_option)
 void PD_UFP_c::init_PPS(uint8_t int_pin, uint16_t PPS_voltage, uint8_t PPS_current, enum PD_power_option_t power_option)
 {
     this->int_pin = int_pin;
+    // Transport and time source not set for this instance
+    if (i2c_transport == 0) {
+        i2c_transport = default_i2c_transport;
+    }
+    if (clock_prescaler == 0) {
+        clock_prescaler = default_clock_prescaler;
+    }
+    if (clock_source == 0 || delay_source == 0) {
+        clock_source = default_clock_source;
+        delay_source = default_delay_source;
+    }
     // Initialize FUSB302
     pinMode(int_pin, INPUT_PULLUP); // Set FUSB302 int pin input ant pull up
-    FUSB302.i2c_address = 0x22;
+    FUSB302.i2c_address = i2c_address;
+    FUSB302.ctx = this;
     FUSB302.i2c_read = FUSB302_i2c_read;
     FUSB302.i2c_write = FUSB302_i2c_write;
     FUSB302.delay_ms = FUSB302_delay_ms;
+    FUSB302.clock_ms = FUSB302_clock_ms;
     if (FUSB302_init(&FUSB302) == FUSB302_SUCCESS && FUSB302_get_ID(&FUSB302, 0, 0) == FUSB302_SUCCESS) {
         status_initialized = 1;
     }
@@ -92,87 +170,488 @@ void PD_UFP_c::init_PPS(uint8_t int_pin, uint16_t PPS_voltage, uint8_t PPS_curre
     PD_protocol_init(&protocol);
     PD_protocol_set_power_option(&protocol, power_option);
     PD_protocol_set_PPS(&protocol, PPS_voltage, PPS_current, false);
+    PD_protocol_set_src_cache(&protocol, src_cache);
+    trace_config();
 
     status_log_event(STATUS_LOG_DEV);
 }
 
 void PD_UFP_c::run(void)
 {
-    if (timer() || digitalRead(int_pin) == 0) {
+#ifdef PD_UFP_TASK
+    if (task_handle && xTaskGetCurrentTaskHandle() != task_handle) {
+        return;     /* Serviced by the PD task */
+    }
+#endif
+    if (timer() || digitalRead(int_pin) == 0 || FUSB302_alert_pending(&FUSB302)) {
         FUSB302_event_t FUSB302_events = 0;
-        for (uint8_t i = 0; i < 3 && FUSB302_alert(&FUSB302, &FUSB302_events) != FUSB302_SUCCESS; i++) {}
+        FUSB302_ret_t ret = FUSB302_ERR_DEVICE_ID;     /* Not initialized, i2c_recover() runs init again */
+        bool recovered = false;
+        if (health.bus_ok) {
+            for (uint8_t i = 0; i < 3 && status_initialized && (ret = FUSB302_alert(&FUSB302, &FUSB302_events)) != FUSB302_SUCCESS; i++) {}
+            if (ret != FUSB302_SUCCESS) {
+                health.alert_errors++;
+                i2c_error();
+            }
+        }
+        if (health.bus_ok == 0 && (recovered = i2c_recover())) {
+            FUSB302_alert(&FUSB302, &FUSB302_events);
+        }
         if (FUSB302_events) {
             handle_FUSB302_event(FUSB302_events);
+        } else if (recovered) {
+            tx_send_queued();   /* Message not written while the bus was held */
         }
     }
+    if (FUSB302_vbus_measure_busy(&FUSB302)) {
+        FUSB302_vbus_measure_run(&FUSB302, 0);
+    }
 }
 
 bool PD_UFP_c::set_PPS(uint16_t PPS_voltage, uint8_t PPS_current)
 {
-    if (status_power == STATUS_POWER_PPS && PD_protocol_set_PPS(&protocol, PPS_voltage, PPS_current, true)) {
-        send_request = 1;
-        return true;
+    bool accepted = false;
+    lock();
+    if (status_power == STATUS_POWER_PPS && PPS_ramp_check(PPS_voltage, PPS_current)) {
+        /* Replaces a setting not Requested yet, Requested by timer() once no Request is in flight */
+        PPS_target_voltage = PPS_voltage;
+        PPS_target_current = PPS_current;
+        PPS_target_pending = PPS_voltage != PD_protocol_get_PPS_voltage(&protocol) ||
+                             PPS_current != PD_protocol_get_PPS_current(&protocol);
+        accepted = true;
     }
-    return false;
+    unlock();
+    return accepted;
 }
 
 void PD_UFP_c::set_power_option(enum PD_power_option_t power_option)
 {
-    if (PD_protocol_set_power_option(&protocol, power_option)) {
+    lock();
+    bool changed = PD_protocol_set_power_option(&protocol, power_option);
+    trace_config();
+    if (changed) {
         send_request = 1;
     }
+    unlock();
+}
+
+bool PD_UFP_c::request_src_cap_ext(void)
+{
+    return request_info(PD_PROTOCOL_EVENT_SRC_CAP_EXT);
+}
+
+bool PD_UFP_c::request_status(void)
+{
+    return request_info(PD_PROTOCOL_EVENT_STATUS);
+}
+
+bool PD_UFP_c::request_manufacturer_info(void)
+{
+    return request_info(PD_PROTOCOL_EVENT_MFG_INFO);
+}
+
+bool PD_UFP_c::get_src_cap_ext(PD_src_cap_ext_t * src_cap_ext)
+{
+    lock();
+    bool received = PD_protocol_get_src_cap_ext(&protocol, src_cap_ext);
+    unlock();
+    return received;
+}
+
+bool PD_UFP_c::get_status(PD_status_t * status)
+{
+    lock();
+    bool received = PD_protocol_get_status(&protocol, status);
+    unlock();
+    return received;
+}
+
+bool PD_UFP_c::get_manufacturer_info(PD_mfg_info_t * mfg_info)
+{
+    lock();
+    bool received = PD_protocol_get_mfg_info(&protocol, mfg_info);
+    unlock();
+    return received;
+}
+
+bool PD_UFP_c::get_PPS_status(PPS_status_t * status)
+{
+    lock();
+    bool valid = PPS_status_valid;
+    if (valid) {
+        *status = PPS_status;
+    }
+    unlock();
+    return valid;
+}
+
+void PD_UFP_c::set_PPS_status_polling(uint16_t interval_ms)
+{
+    lock();
+    PPS_status_interval = interval_ms;
+    unlock();
+}
+
+void PD_UFP_c::set_src_cache(PD_src_cache_t * cache)
+{
+    lock();
+    src_cache = cache;
+    PD_protocol_set_src_cache(&protocol, cache);
+    unlock();
+}
+
+bool PD_UFP_c::measure_vbus(void)
+{
+    lock();
+    FUSB302_ret_t ret = FUSB302_vbus_measure_start(&FUSB302);
+    unlock();
+    return ret == FUSB302_SUCCESS || ret == FUSB302_BUSY;
+}
+
+void PD_UFP_c::get_health(PD_UFP_health_t * health)
+{
+    lock();
+    *health = this->health;
+    health->read_errors = FUSB302.errors.read;
+    health->write_errors = FUSB302.errors.write;
+    health->rx_sync_errors = FUSB302.errors.rx_sync;
+    health->config_restores = FUSB302.errors.restore;
+    unlock();
+}
+
+void PD_UFP_c::reset_health(void)
+{
+    lock();
+    uint8_t bus_ok = health.bus_ok;
+    memset(&health, 0, sizeof(PD_UFP_health_t));
+    memset(&FUSB302.errors, 0, sizeof(FUSB302_errors_t));
+    health.bus_ok = bus_ok;
+    unlock();
+}
+
+void PD_UFP_c::get_reset_stats(PD_UFP_reset_stats_t * stats)
+{
+    lock();
+    *stats = reset_stats;
+    unlock();
+}
+
+#ifdef PD_UFP_TASK
+bool PD_UFP_c::start_task(uint8_t priority, uint16_t stack_size)
+{
+    if (task_handle) {
+        return true;
+    }
+    task_lock = xSemaphoreCreateRecursiveMutex();   /* set_PPS() may be called from a status callback */
+    if (task_lock == 0) {
+        return false;
+    }
+    if (xTaskCreate(task, "PD_UFP", stack_size, this, priority, &task_handle) != pdPASS) {
+        vSemaphoreDelete(task_lock);
+        task_lock = 0;
+        task_handle = 0;
+        return false;
+    }
+    attachInterruptArg(digitalPinToInterrupt(int_pin), isr, this, FALLING);
+    return true;
+}
+
+void PD_UFP_c::task(void * arg)
+{
+    PD_UFP_c * self = (PD_UFP_c *)arg;
+    uint16_t low_ms = 1;
+    uint32_t wake_us = 0;
+    for (;;) {
+        TickType_t wait;
+        uint32_t time_run = micros();
+        xSemaphoreTakeRecursive(self->task_lock, portMAX_DELAY);
+        /* INT_N stays low while events are pending, one alert is read per run() */
+        for (uint8_t i = 0; i < 3; i++) {
+            self->run();
+            if (digitalRead(self->int_pin)) {
+                break;
+            }
+        }
+        xSemaphoreGiveRecursive(self->task_lock);
+        if (self->task_hook) {
+            self->task_hook(self->task_hook_ctx, micros() - time_run, wake_us);
+        }
+        /* Wait for the next INT_N edge, or in time for the protocol timers. A line still low
+           after three alerts (a stuck INT_N, the FUSB302 not answering) is retried after 1, 2,
+           4.. ms up to t_PD_TASK_WAKE, so lower priority tasks still run */
+        if (digitalRead(self->int_pin)) {
+            low_ms = 1;
+            wait = pdMS_TO_TICKS(t_PD_TASK_WAKE);
+        } else {
+            wait = pdMS_TO_TICKS(low_ms);
+            low_ms = low_ms * 2 < t_PD_TASK_WAKE ? low_ms * 2 : t_PD_TASK_WAKE;
+        }
+        wake_us = ulTaskNotifyTake(pdTRUE, wait ? wait : 1) ? micros() - self->time_isr : 0;
+    }
+}
+
+void IRAM_ATTR PD_UFP_c::isr(void * arg)
+{
+    PD_UFP_c * self = (PD_UFP_c *)arg;
+    BaseType_t woken = pdFALSE;
+    self->time_isr = micros();
+    vTaskNotifyGiveFromISR(self->task_handle, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void PD_UFP_c::lock(void)
+{
+    if (task_lock) {
+        xSemaphoreTakeRecursive(task_lock, portMAX_DELAY);
+    }
+}
+
+void PD_UFP_c::unlock(void)
+{
+    if (task_lock) {
+        xSemaphoreGiveRecursive(task_lock);
+    }
+}
+#else
+bool PD_UFP_c::start_task(uint8_t priority, uint16_t stack_size)
+{
+    return false;
+}
+
+void PD_UFP_c::lock(void)
+{
 }
 
+void PD_UFP_c::unlock(void)
+{
+}
+#endif
+
 void PD_UFP_c::clock_prescale_set(uint8_t prescaler)
 {
     if (prescaler) {
-        clock_prescaler = prescaler;
+        default_clock_prescaler = prescaler;
     }
 }
 
-FUSB302_ret_t PD_UFP_c::FUSB302_i2c_read(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count)
+void PD_UFP_c::clock_source_set(PD_UFP_clock_ms_t clock_ms, PD_UFP_delay_ms_t delay_ms)
+{
+    default_clock_source = clock_ms ? clock_ms : arduino_clock_ms;
+    default_delay_source = delay_ms ? delay_ms : arduino_delay_ms;
+}
+
+void PD_UFP_c::i2c_transport_set(PD_UFP_I2C_c * transport)
+{
+    default_i2c_transport = transport ? transport : &i2c_wire;
+}
+
+void PD_UFP_c::set_i2c_transport(PD_UFP_I2C_c * transport, uint8_t i2c_address)
+{
+    this->i2c_transport = transport;
+    this->i2c_address = i2c_address ? i2c_address : FUSB302_I2C_ADDRESS;
+}
+
+void PD_UFP_c::set_clock_source(PD_UFP_clock_ms_t clock_ms, PD_UFP_delay_ms_t delay_ms, uint8_t prescaler)
 {
-    Wire.beginTransmission(dev_addr);
-    Wire.write(reg_addr);
-    Wire.endTransmission();
-    Wire.requestFrom(dev_addr, count);
-    while (Wire.available() && count > 0) {
-        *data++ = Wire.read();
-        count--;
+    clock_source = clock_ms;
+    delay_source = delay_ms;
+    clock_prescaler = prescaler;
+}
+
+FUSB302_ret_t PD_UFP_c::FUSB302_i2c_read(void * ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count)
+{
+    PD_UFP_c * self = (PD_UFP_c *)ctx;
+    uint32_t time_start = i2c_profile ? micros() : 0;
+    FUSB302_ret_t ret = self->i2c_transport->read(dev_addr, reg_addr, data, count);
+    if (i2c_profile) {
+        i2c_profile_account(reg_addr, count, false, time_start, ret);
     }
-    return count == 0 ? FUSB302_SUCCESS : FUSB302_ERR_READ_DEVICE;
+    return ret;
 }
 
-FUSB302_ret_t PD_UFP_c::FUSB302_i2c_write(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count)
+FUSB302_ret_t PD_UFP_c::FUSB302_i2c_write(void * ctx, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data, uint8_t count)
 {
-    Wire.beginTransmission(dev_addr);
-    Wire.write(reg_addr);
-    while (count > 0) {
-        Wire.write(*data++);
-        count--;
+    /* Returns once queued on a posted transport, time_us is the time the caller waited */
+    PD_UFP_c * self = (PD_UFP_c *)ctx;
+    uint32_t time_start = i2c_profile ? micros() : 0;
+    FUSB302_ret_t ret = self->i2c_transport->write(dev_addr, reg_addr, data, count);
+    if (i2c_profile) {
+        i2c_profile_account(reg_addr, count, true, time_start, ret);
     }
-    Wire.endTransmission();
-    return FUSB302_SUCCESS;
+    return ret;
 }
 
-FUSB302_ret_t PD_UFP_c::FUSB302_delay_ms(uint32_t t)
+FUSB302_ret_t PD_UFP_c::FUSB302_delay_ms(void * ctx, uint32_t t)
 {
-    delay(t / clock_prescaler);
+    PD_UFP_c * self = (PD_UFP_c *)ctx;
+    self->delay_source(t / self->clock_prescaler);
     return FUSB302_SUCCESS;
 }
 
+uint32_t PD_UFP_c::FUSB302_clock_ms(void * ctx)
+{
+    PD_UFP_c * self = (PD_UFP_c *)ctx;
+    return self->clock_source() * self->clock_prescaler;
+}
+
+void PD_UFP_c::i2c_profile_set(PD_UFP_i2c_profile_t * profile)
+{
+    i2c_profile = profile;
+    i2c_profile_reset();
+}
+
+void PD_UFP_c::i2c_profile_reset(void)
+{
+    if (i2c_profile) {
+        memset(i2c_profile, 0, sizeof(PD_UFP_i2c_profile_t));
+    }
+}
+
+void PD_UFP_c::i2c_profile_account(uint8_t reg_addr, uint8_t count, bool write, uint32_t time_start, FUSB302_ret_t ret)
+{
+    PD_UFP_i2c_reg_stats_t * r = &i2c_profile->reg[reg_addr < PD_UFP_I2C_PROFILE_NUM_OF_REG ? reg_addr : 0];
+    if (write) {
+        r->writes++;
+        r->bytes_written += count;
+    } else {
+        r->reads++;
+        r->bytes_read += count;
+    }
+    r->time_us += micros() - time_start;
+    if (ret != FUSB302_SUCCESS) {
+        i2c_profile->errors++;
+    }
+}
+
+static const char * i2c_profile_reg_name(uint8_t reg_addr)
+{
+    static const char * const control_name[] = {
+        "DEVICE_ID", "SWITCHES0", "SWITCHES1", "MEASURE", "SLICE", "CONTROL0", "CONTROL1", "CONTROL2",
+        "CONTROL3", "MASK", "POWER", "RESET", "OCPREG", "MASKA", "MASKB", "CONTROL4"
+    };
+    static const char * const status_name[] = {
+        "STATUS0A", "STATUS1A", "INTERRUPTA", "INTERRUPTB", "STATUS0", "STATUS1", "INTERRUPT", "FIFOS"
+    };
+    if (reg_addr >= 0x01 && reg_addr <= 0x10) {
+        return control_name[reg_addr - 0x01];
+    }
+    if (reg_addr >= 0x3C && reg_addr <= 0x43) {
+        return status_name[reg_addr - 0x3C];
+    }
+    return "?";
+}
+
+/* One line of the profile table: line 0 is the header, then registers, then the error count */
+int PD_UFP_c::i2c_profile_readline(char * buffer, int maxlen, uint8_t line)
+{
+    if (line == 0) {
+        return snprintf(buffer, maxlen, "reg  name          reads   writes  rd_bytes  wr_bytes    time_us\n");
+    }
+    if (line > PD_UFP_I2C_PROFILE_NUM_OF_REG) {
+        return snprintf(buffer, maxlen, "errors %lu\n", (unsigned long)i2c_profile->errors);
+    }
+    uint8_t reg_addr = line - 1;
+    const PD_UFP_i2c_reg_stats_t * r = &i2c_profile->reg[reg_addr];
+    if (r->reads == 0 && r->writes == 0) {
+        buffer[0] = 0;
+        return 0;
+    }
+    return snprintf(buffer, maxlen, "0x%02X %-10s %8lu %8lu %9lu %9lu %10lu\n", reg_addr, i2c_profile_reg_name(reg_addr),
+        (unsigned long)r->reads, (unsigned long)r->writes, (unsigned long)r->bytes_read,
+        (unsigned long)r->bytes_written, (unsigned long)r->time_us);
+}
+
+/* Text table of the registers accessed so far, truncated at whole lines, return the length written */
+int PD_UFP_c::i2c_profile_dump(char * buffer, int maxlen)
+{
+    char line[80];
+    int len = 0;
+    if (i2c_profile == 0 || maxlen <= 0) {
+        return 0;
+    }
+    buffer[0] = 0;
+    for (uint8_t i = 0; i <= PD_UFP_I2C_PROFILE_NUM_OF_REG + 1; i++) {
+        int n = i2c_profile_readline(line, sizeof(line), i);
+        if (len + n >= maxlen) {
+            break;
+        }
+        memcpy(buffer + len, line, n + 1);
+        len += n;
+    }
+    return len;
+}
+
+void PD_UFP_c::i2c_profile_print(HardwareSerial & serial)
+{
+    char line[80];
+    if (i2c_profile == 0) {
+        return;
+    }
+    for (uint8_t i = 0; i <= PD_UFP_I2C_PROFILE_NUM_OF_REG + 1; i++) {
+        if (i2c_profile_readline(line, sizeof(line), i)) {
+            serial.print(line);
+        }
+    }
+}
+
 void PD_UFP_c::handle_protocol_event(PD_protocol_event_t events)
 {    
+    if (events & PD_PROTOCOL_EVENT_PPS_STATUS) {
+        PPS_status_t s;
+        wait_response = 0;
+        if (status_power == STATUS_POWER_PPS && PD_protocol_get_PPS_status(&protocol, &s) &&
+            (!PPS_status_valid || s.output_voltage != PPS_status.output_voltage ||
+             s.output_current != PPS_status.output_current || s.flag_PTF != PPS_status.flag_PTF ||
+             s.flag_OMF != PPS_status.flag_OMF)) {
+            PPS_status = s;
+            PPS_status_valid = 1;
+            status_PPS_changed(&PPS_status);
+            status_log_event(STATUS_LOG_PPS_STATUS);
+        }
+    }
+    if (events & (PD_PROTOCOL_EVENT_SRC_CAP_EXT | PD_PROTOCOL_EVENT_STATUS | PD_PROTOCOL_EVENT_MFG_INFO)) {
+        wait_response = 0;
+        if (events & PD_PROTOCOL_EVENT_SRC_CAP_EXT) {
+            status_log_event(STATUS_LOG_SRC_CAP_EXT);
+        }
+        if (events & PD_PROTOCOL_EVENT_STATUS) {
+            status_log_event(STATUS_LOG_STATUS);
+        }
+        if (events & PD_PROTOCOL_EVENT_MFG_INFO) {
+            status_log_event(STATUS_LOG_MFG_INFO);
+        }
+    }
     if (events & PD_PROTOCOL_EVENT_SRC_CAP) {
+        if (src_cap_first) {
+            /* Remember how the source had to be brought to advertise */
+            PD_src_cache_entry_t * e = PD_protocol_get_src_cache_entry(&protocol);
+            src_cap_first = 0;
+            if (e) {
+                e->flags = src_cap_flags;
+                e->rp = src_cap_rp;
+            }
+        }
+        src_cap_silent = 0;
         wait_src_cap = 0;
         get_src_cap_retry_count = 0;
         wait_ps_rdy = 1;
         time_wait_ps_rdy = clock_ms();
         status_log_event(STATUS_LOG_SRC_CAP);
     }
+    if (events & PD_PROTOCOL_EVENT_SOFT_RESET) {
+        reset_stats.soft_resets++;
+        handle_reset(false);
+        status_log_event(STATUS_LOG_SOFT_RESET);
+    }
+    if (events & PD_PROTOCOL_EVENT_ACCEPT) {
+        wait_soft_reset = 0;        /* Source_Capabilities follow */
+    }
     if (events & PD_PROTOCOL_EVENT_REJECT) {
         if (wait_ps_rdy) {
             wait_ps_rdy = 0;
+            PPS_target_pending = 0;     /* The rest of a PPS ramp is not Requested */
             status_log_event(STATUS_LOG_POWER_REJECT);
         }
     }    
@@ -187,6 +666,7 @@ void PD_UFP_c::handle_protocol_event(PD_protocol_event_t events)
             if (PPS_voltage_next) {
                 // Two stage startup for PPS voltage < 5V
                 PD_protocol_set_PPS(&protocol, PPS_voltage_next, PPS_current_next, false);
+                trace_config();
                 PPS_voltage_next = 0;
                 send_request = 1;
                 status_log_event(STATUS_LOG_POWER_PPS_STARTUP);
@@ -195,21 +675,45 @@ void PD_UFP_c::handle_protocol_event(PD_protocol_event_t events)
                 status_power_ready(STATUS_POWER_PPS, 
                     PD_protocol_get_PPS_voltage(&protocol), PD_protocol_get_PPS_current(&protocol));
                 status_log_event(STATUS_LOG_POWER_READY);
+                reset_recovered();
             }
         } else {
             FUSB302_set_vbus_sense(&FUSB302, 1);
+            PPS_status_valid = 0;
             status_power_ready(STATUS_POWER_TYP, p.max_v, p.max_i);
             status_log_event(STATUS_LOG_POWER_READY);
+            reset_recovered();
         }
     }
 }
 
 void PD_UFP_c::handle_FUSB302_event(FUSB302_event_t events)
 {
+    if (trace) {
+        PD_trace_event(trace, clock_ms(), events);
+    }
+    if (events & (FUSB302_EVENT_DETACHED | FUSB302_EVENT_ATTACHED)) {
+        tx_queued = 0;
+        wait_soft_reset = 0;
+        reset_recovery = 0;
+        wait_response = 0;
+        PPS_status_valid = 0;
+        PPS_target_pending = 0;
+        src_cap_first = 0;
+        src_cap_silent = 0;
+    }
     if (events & FUSB302_EVENT_DETACHED) {
         PD_protocol_reset(&protocol);
         return;
     }
+    if (events & (FUSB302_EVENT_TX_SENT | FUSB302_EVENT_TX_FAILED | FUSB302_EVENT_HARD_RESET_SENT)) {
+        handle_tx_complete(events);
+    }
+    if (events & FUSB302_EVENT_HARD_RESET) {
+        reset_stats.hard_resets_received++;
+        handle_reset(true);
+        status_log_event(STATUS_LOG_HARD_RESET);
+    }
     if (events & FUSB302_EVENT_ATTACHED) {
         uint8_t cc1 = 0, cc2 = 0, cc = 0;
         FUSB302_get_cc(&FUSB302, &cc1, &cc2);
@@ -222,58 +726,93 @@ void PD_UFP_c::handle_FUSB302_event(FUSB302_event_t events)
         /* TODO: handle no cc detected error */
         if (cc > 1) {
             wait_src_cap = 1;
+            time_wait_src_cap = clock_ms();     /* tTypeCSinkWaitCap from attach */
+            src_cap_first = 1;
+            src_cap_flags = 0;
+            src_cap_rp = cc;
+            get_src_cap_retry_count = 0;
+            /* A recent source with this Rp level advertised only after a Hard Reset, see
+               handle_tx_complete() */
+            src_cap_silent = PD_protocol_src_cache_has(&protocol, PD_SRC_CACHE_HARD_RESET, cc);
         } else {
             set_default_power();
         }
         status_log_event(STATUS_LOG_CC);
     }
     if (events & FUSB302_EVENT_RX_SOP) {
-        PD_protocol_event_t protocol_event = 0;
-        uint16_t header;
-        uint32_t obj[7];
-        FUSB302_get_message(&FUSB302, &header, obj);
-        PD_protocol_handle_msg(&protocol, header, obj, &protocol_event);
-        status_log_event(STATUS_LOG_MSG_RX, obj);
-        if (protocol_event) {
-            handle_protocol_event(protocol_event);
+        /* every packet drained by this alert, in order, handled in place in the RX queue */
+        FUSB302_rx_msg_t * msg;
+        while ((msg = FUSB302_rx_peek(&FUSB302)) != 0) {
+            PD_protocol_event_t protocol_event = 0;
+            if (trace) {
+                PD_trace_msg(trace, clock_ms(), PD_TRACE_RX, msg->header, msg->obj);
+            }
+            PD_protocol_handle_msg(&protocol, msg->header, msg->obj, &protocol_event);
+            status_log_event(STATUS_LOG_MSG_RX, msg->obj);
+            FUSB302_rx_pop(&FUSB302);
+            if (protocol_event) {
+                handle_protocol_event(protocol_event);
+            }
         }
     }
     if (events & FUSB302_EVENT_GOOD_CRC_SENT) {
         uint16_t header;
         uint32_t obj[7];
-        delay_ms(2);  /* Delay respond in case there are retry messages */
         if (PD_protocol_respond(&protocol, &header, obj)) {
             status_log_event(STATUS_LOG_MSG_TX, obj);
-            FUSB302_tx_sop(&FUSB302, header, obj);
+            tx_sop(header, obj);
         }
     }
+    /* After the GoodCRC of the previous message in the RX queue, MessageID counted */
+    tx_send_queued();
 }
 
 bool PD_UFP_c::timer(void)
 {
     uint16_t t = clock_ms();
-    if (wait_src_cap && t - time_wait_src_cap > t_TypeCSinkWaitCap) {
+    if (health.bus_ok == 0) {
+        /* Nothing is sent until i2c_recover(), a message the bus failed to write waits in
+           tx_queued and no reply is timed out meanwhile. run() tries to recover */
+        time_wait_src_cap = t;
+        time_wait_ps_rdy = t;
+        time_wait_response = t;
+        return true;
+    }
+    if (wait_src_cap && FUSB302_hard_reset_busy(&FUSB302)) {
+        time_wait_src_cap = t;      /* tTypeCSinkWaitCap from VBUS back at vSafe5V */
+    }
+    if (wait_src_cap && (uint16_t)(t - time_wait_src_cap) > t_TypeCSinkWaitCap) {
         time_wait_src_cap = t;
+        if (trace) {
+            PD_trace_timer(trace, t, PD_TRACE_TIMER_SRC_CAP);
+        }
         if (get_src_cap_retry_count < 3) {
             uint16_t header;
             get_src_cap_retry_count += 1;
             /* Try to request soruce capabilities message (will not cause power cycle VBUS) */
             PD_protocol_create_get_src_cap(&protocol, &header);
             status_log_event(STATUS_LOG_MSG_TX);
-            FUSB302_tx_sop(&FUSB302, header, 0);
+            tx_sop(header, 0);
         } else {
-            get_src_cap_retry_count = 0;
-            /* Hard reset will cause the source power cycle VBUS. */
-            FUSB302_tx_hard_reset(&FUSB302);
-            PD_protocol_reset(&protocol);
+            src_cap_flags |= PD_SRC_CACHE_HARD_RESET;
+            tx_hard_reset();
         }
     }
+    if (PPS_target_pending && status_power == STATUS_POWER_PPS && !wait_ps_rdy && !send_request) {
+        PPS_step();
+    }
     if (wait_ps_rdy) {
-        if (t - time_wait_ps_rdy > t_RequestToPSReady) {
+        if ((uint16_t)(t - time_wait_ps_rdy) > t_RequestToPSReady) {
             wait_ps_rdy = 0;
+            if (trace) {
+                PD_trace_timer(trace, t, PD_TRACE_TIMER_PS_RDY);
+            }
             set_default_power();
         }
-    } else if (send_request || (status_power == STATUS_POWER_PPS && t - time_PPS_request > t_PPSRequest)) {
+    } else if (send_request || (status_power == STATUS_POWER_PPS && (uint16_t)(t - time_PPS_request) > t_PPSRequest)) {
+        if (trace && !send_request) {
+            PD_trace_timer(trace, t, PD_TRACE_TIMER_PPS_REQUEST);
+        }
         wait_ps_rdy = 1;
         send_request = 0;
         time_PPS_request = t;
@@ -283,15 +822,286 @@ bool PD_UFP_c::timer(void)
         PD_protocol_create_request(&protocol, &header, obj);
         status_log_event(STATUS_LOG_MSG_TX, obj);
         time_wait_ps_rdy = clock_ms();
-        FUSB302_tx_sop(&FUSB302, header, obj);
+        tx_sop(header, obj);
+    } else if (PPS_status_interval && status_power == STATUS_POWER_PPS && !wait_response && !tx_queued &&
+               (uint16_t)(t - time_PPS_status) >= PPS_status_interval &&
+               (uint16_t)(t - time_PPS_request) < t_PPSRequest - t_PPSStatusGuard) {
+        /* Output telemetry, kept clear of the next keepalive Request */
+        uint16_t header;
+        time_PPS_status = t;
+        wait_response = 1;
+        time_wait_response = t;
+        PD_protocol_create_get_PPS_status(&protocol, &header);
+        status_log_event(STATUS_LOG_MSG_TX);
+        tx_sop(header, 0);
     }
-    if (t - time_polling > t_PD_POLLING) {
+    if (wait_response && (uint16_t)(t - time_wait_response) > t_SenderResponse) {
+        wait_response = 0;      /* Not_Supported, or no reply */
+    }
+    if (wait_soft_reset && (uint16_t)(t - time_wait_response) > t_SenderResponse) {
+        tx_hard_reset();        /* Soft_Reset not accepted */
+    }
+    if ((uint16_t)(t - time_polling) > t_PD_POLLING) {
         time_polling = t;
         return true;
     }
     return false;
 }
 
+void PD_UFP_c::handle_tx_complete(FUSB302_event_t events)
+{
+    if (events & FUSB302_EVENT_TX_FAILED) {
+        PD_protocol_tx_failed(&protocol);
+        status_log_event(STATUS_LOG_MSG_TX_FAILED);
+        if (wait_src_cap && src_cap_silent) {
+            /* Get_Source_Cap without GoodCRC, the PD PHY of the source is not running. With a
+               source of the same Rp level in the cache that needed a Hard Reset the other retries
+               are skipped. A source that answers, one in a contract after a reset of this side,
+               is not reset */
+            src_cap_silent = 0;
+            get_src_cap_retry_count = 3;
+            time_wait_src_cap = clock_ms() - t_TypeCSinkWaitCap - 1;
+        }
+        if (wait_soft_reset) {
+            /* Soft_Reset not delivered either */
+            tx_hard_reset();
+        } else if (wait_ps_rdy) {
+            /* Reference: 6.8.1 Soft Reset and Protocol Error, the Request got no GoodCRC after
+               all retries of the PHY. The source sends Source_Capabilities again */
+            tx_soft_reset();
+        }
+    }
+}
+
+void PD_UFP_c::tx_sop(uint16_t header, uint32_t * obj)
+{
+    FUSB302_ret_t ret = FUSB302_BUSY;     /* Bus held, nothing is written until i2c_recover() */
+    if (health.bus_ok && (ret = FUSB302_tx_sop(&FUSB302, header, obj)) & (FUSB302_ERR_READ_DEVICE | FUSB302_ERR_WRITE_DEVICE)) {
+        /* Not in the TX FIFO and not on the line: no transmission error, the MessageID and the
+           retry counts stay. Kept until i2c_recover() succeeds, a Hard Reset would power cycle
+           the DUT for a bus fault */
+        health.tx_write_errors++;
+        i2c_error();
+    }
+    if (ret == FUSB302_BUSY || health.bus_ok == 0) {
+        /* Previous message still on the line or bus held, sent by tx_send_queued() after its
+           completion or the recovery with the MessageID of then. Only the latest is kept */
+        tx_queued = 1;
+        tx_queued_header = header;
+        if (obj) {
+            memcpy(tx_queued_obj, obj, ((header >> 12) & 0x7) * sizeof(uint32_t));
+        }
+        return;
+    }
+    if (trace && ret == FUSB302_SUCCESS) {
+        PD_trace_msg(trace, clock_ms(), PD_TRACE_TX, header, obj);
+    }
+}
+
+void PD_UFP_c::tx_send_queued(void)
+{
+    if (tx_queued && health.bus_ok) {
+        tx_queued = 0;
+        tx_sop(PD_protocol_tx_header(&protocol, tx_queued_header), tx_queued_obj);
+    }
+}
+
+/* PPS step after voltage, current toward target: at most PPS_slew_step away. The current is
+   lowered with the first step and raised only with the last one, so no step asks for more
+   current than both ends */
+void PD_UFP_c::PPS_next(uint16_t * voltage, uint8_t * current, uint16_t target_voltage, uint8_t target_current)
+{
+    uint16_t v = *voltage;
+    *voltage = target_voltage;
+    if (PPS_slew_step && target_voltage > v + PPS_slew_step) {
+        *voltage = v + PPS_slew_step;
+    } else if (PPS_slew_step && v > target_voltage + PPS_slew_step) {
+        *voltage = v - PPS_slew_step;
+    }
+    if (*voltage == target_voltage || target_current < *current) {
+        *current = target_current;
+    }
+}
+
+/* Every step from the present PPS setting to this one is covered by a PPS APDO */
+bool PD_UFP_c::PPS_ramp_check(uint16_t voltage, uint8_t current)
+{
+    uint16_t v = PD_protocol_get_PPS_voltage(&protocol);
+    uint8_t i = PD_protocol_get_PPS_current(&protocol);
+    do {
+        PPS_next(&v, &i, voltage, current);
+        if (!PD_protocol_check_PPS(&protocol, v, i)) {
+            return false;
+        }
+    } while (v != voltage || i != current);
+    return true;
+}
+
+/* Next PPS Request toward the set_PPS() setting */
+void PD_UFP_c::PPS_step(void)
+{
+    uint16_t v = PD_protocol_get_PPS_voltage(&protocol);
+    uint8_t i = PD_protocol_get_PPS_current(&protocol);
+    PPS_next(&v, &i, PPS_target_voltage, PPS_target_current);
+    if (!PD_protocol_check_PPS(&protocol, v, i) || !PD_protocol_set_PPS(&protocol, v, i, true)) {
+        /* No longer covered (new Source_Capabilities), the ramp stops in the PPS contract held */
+        PPS_target_pending = 0;
+        status_log_event(STATUS_LOG_POWER_REJECT);
+        return;
+    }
+    PPS_target_pending = v != PPS_target_voltage || i != PPS_target_current;
+    trace_config();
+    send_request = 1;
+}
+
+/* Get_Source_Cap_Extended, Get_Status or Get_Manufacturer_Info, info is the protocol event of the reply */
+bool PD_UFP_c::request_info(PD_protocol_event_t info)
+{
+    bool sent = false;
+    lock();
+    if (status_power != STATUS_POWER_NA && !is_ps_transition() && !tx_queued && !wait_response) {
+        uint16_t header;
+        uint32_t obj[7];
+        if (info == PD_PROTOCOL_EVENT_SRC_CAP_EXT) {
+            PD_protocol_create_get_src_cap_ext(&protocol, &header);
+        } else if (info == PD_PROTOCOL_EVENT_STATUS) {
+            PD_protocol_create_get_status(&protocol, &header);
+        } else {
+            PD_protocol_create_get_mfg_info(&protocol, &header, obj);
+        }
+        wait_response = 1;
+        time_wait_response = clock_ms();
+        status_log_event(STATUS_LOG_MSG_TX, obj);
+        tx_sop(header, obj);
+        sent = true;
+    }
+    unlock();
+    return sent;
+}
+
+void PD_UFP_c::tx_soft_reset(void)
+{
+    /* Accept is expected within t_SenderResponse, see timer() */
+    uint16_t header;
+    reset_stats.soft_resets_sent++;
+    handle_reset(false);
+    wait_soft_reset = 1;
+    time_wait_response = clock_ms();
+    PD_protocol_create_soft_reset(&protocol, &header);
+    status_log_event(STATUS_LOG_MSG_TX);
+    tx_sop(header, 0);
+    status_log_event(STATUS_LOG_SOFT_RESET);
+}
+
+void PD_UFP_c::tx_hard_reset(void)
+{
+    /* Hard reset will cause the source power cycle VBUS. */
+    if (trace) {
+        PD_trace_hard_reset(trace, clock_ms());
+    }
+    reset_stats.hard_resets_sent++;
+    handle_reset(true);
+    FUSB302_tx_hard_reset(&FUSB302);
+    status_log_event(STATUS_LOG_HARD_RESET);
+}
+
+void PD_UFP_c::handle_reset(bool hard)
+{
+    /* Reference: 6.8 Reset. The source sends Source_Capabilities again after either reset, the
+       protocol engine keeps the power option and the PPS setpoint so the Request that answers
+       them asks for the contract held before. Nothing waits for the lost Request any longer,
+       Get_Source_Cap is sent if they do not come */
+    uint16_t t = clock_ms();
+    tx_queued = 0;
+    wait_soft_reset = 0;
+    wait_ps_rdy = 0;
+    send_request = 0;
+    wait_response = 0;
+    wait_src_cap = 1;
+    get_src_cap_retry_count = 0;
+    time_wait_src_cap = t;
+    time_reset = t;
+    reset_recovery = 1;
+    if (hard) {
+        /* The contract is gone, VBUS goes to vSafe0V and back to vSafe5V (not a detach, see
+           FUSB302_hard_reset_busy()), the VBUSOK interrupt tells when it is back */
+        PD_protocol_reset(&protocol);
+        if (status_power == STATUS_POWER_PPS && PPS_voltage_next == 0 &&
+            PD_protocol_get_PPS_voltage(&protocol) < PPS_V(5.0)) {
+            /* Two stage startup again, from vSafe5V */
+            PPS_voltage_next = PD_protocol_get_PPS_voltage(&protocol);
+            PPS_current_next = PD_protocol_get_PPS_current(&protocol);
+            PD_protocol_set_PPS(&protocol, PPS_V(5.0), PPS_current_next, false);
+            trace_config();
+        }
+        FUSB302_set_vbus_sense(&FUSB302, 1);
+        PPS_status_valid = 0;
+        status_power_ready(STATUS_POWER_NA, 0, 0);
+    }
+}
+
+void PD_UFP_c::reset_recovered(void)
+{
+    if (reset_recovery) {
+        uint16_t t = clock_ms() - time_reset;
+        reset_recovery = 0;
+        reset_stats.recoveries++;
+        reset_stats.time_last_recovery = t;
+        if (t > reset_stats.time_max_recovery) {
+            reset_stats.time_max_recovery = t;
+        }
+        status_log_event(STATUS_LOG_RESET_RECOVERED);
+    }
+}
+
+void PD_UFP_c::i2c_error(void)
+{
+    uint16_t t = clock_ms();
+    health.time_last_error = t;
+    if (health.bus_ok) {
+        health.bus_ok = 0;
+        time_i2c_recover = t - t_I2CRecover;    /* Recover now */
+        status_log_event(STATUS_LOG_I2C_ERROR);
+    }
+}
+
+bool PD_UFP_c::i2c_recover(void)
+{
+    /* Clear the bus and check the FUSB302 kept its configuration. The attach state, the
+       contract and the protocol engine are kept, the source does not see a reset */
+    uint16_t t = clock_ms();
+    if ((uint16_t)(t - time_i2c_recover) < t_I2CRecover) {
+        return false;
+    }
+    time_i2c_recover = t;
+    health.bus_recoveries++;
+    FUSB302_ret_t ret = i2c_transport->recover();
+    if (ret == FUSB302_SUCCESS) {
+        if (status_initialized) {
+            ret = FUSB302_restore(&FUSB302);
+        } else if ((ret = FUSB302_init(&FUSB302)) == FUSB302_SUCCESS) {
+            /* Not found by init_PPS(), the bus was held from the start */
+            status_initialized = 1;
+            status_log_event(STATUS_LOG_DEV);
+        }
+    }
+    if (ret != FUSB302_SUCCESS) {
+        health.recover_errors++;
+        return false;
+    }
+    health.bus_ok = 1;
+    status_log_event(STATUS_LOG_I2C_RECOVERED);
+    return true;
+}
+
+void PD_UFP_c::trace_config(void)
+{
+    if (trace) {
+        PD_trace_config(trace, clock_ms(), protocol.power_option,
+            PD_protocol_get_PPS_voltage(&protocol), PD_protocol_get_PPS_current(&protocol));
+    }
+}
+
 void PD_UFP_c::set_default_power(void)
 {
     status_power_ready(STATUS_POWER_TYP, PD_V(5), PD_A(1));
@@ -305,14 +1115,18 @@ void PD_UFP_c::status_power_ready(status_power_t status, uint16_t voltage, uint1
     status_power = status;
 }
 
-uint8_t PD_UFP_c::clock_prescaler = 1;
+uint8_t PD_UFP_c::default_clock_prescaler = 1;
+PD_UFP_clock_ms_t PD_UFP_c::default_clock_source = arduino_clock_ms;
+PD_UFP_delay_ms_t PD_UFP_c::default_delay_source = arduino_delay_ms;
+PD_UFP_I2C_c * PD_UFP_c::default_i2c_transport = &i2c_wire;
+PD_UFP_i2c_profile_t * PD_UFP_c::i2c_profile = 0;
 
 void PD_UFP_c::delay_ms(uint16_t ms)
 {
-    delay(ms / clock_prescaler);
+    delay_source(ms / clock_prescaler);
 }
 
 uint16_t PD_UFP_c::clock_ms(void)
 {
-    return (uint16_t)millis() * clock_prescaler;
+    return (uint16_t)clock_source() * clock_prescaler;
 }
@@ -0,0 +1,160 @@
+/**
+ * PD_UFP_I2C.h
+ *
+ * I2C transport of the FUSB302 for PD_UFP_c, see PD_UFP_c::i2c_transport_set()
+ *
+ * Transactions are queued and complete in submission order, each with its result and an optional
+ * completion callback:
+ *
+ * - PD_UFP_I2C_Wire_c  Arduino Wire or another TwoWire port, the transaction completes inside
+ *                      submit(). Default, on Wire
+ * - PD_UFP_I2C_IDF_c   ESP-IDF i2c_master driver (IDF 5.2 or later, bus created with
+ *                      trans_queue_depth > 0). Transactions run from the driver queue, a caller
+ *                      waiting for one sleeps instead of polling the bus
+ *
+ * The FUSB302 driver needs a read before it can go on, reads are submitted and waited for.
+ * Register and FIFO writes on a transport with a posted queue return once queued, the bus time
+ * overlaps with the caller. A posted write that fails is returned by the next read or write.
+ *
+ * recover() frees a bus held by a slave after errors, PD_UFP_c calls it when the FUSB302 stops
+ * answering and then restores the FUSB302 configuration.
+ *
+ * Each FUSB302 (PD_UFP_c instance) can have a transport of its own, see
+ * PD_UFP_c::set_i2c_transport(). With ESP-IDF create one PD_UFP_I2C_IDF_c per FUSB302, several
+ * can share a bus handle.
+ *
+ * Do not mix a transport with Arduino Wire on the same I2C port.
+ *
+ */
+
+#ifndef PD_UFP_I2C_H
+#define PD_UFP_I2C_H
+
+#include <stdint.h>
+
+#include <Wire.h>
+
+#include "FUSB302_UFP.h"
+
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include(<driver/i2c_master.h>)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <driver/i2c_master.h>
+#define PD_UFP_I2C_IDF
+#endif
+#endif
+
+#define PD_UFP_I2C_WRITE_MAX    40      /* FUSB302_tx_sop() FIFO write, the longest */
+#define PD_UFP_I2C_POSTED       4       /* Writes in flight before a write waits */
+#define PD_UFP_I2C_TIMEOUT_MS   50
+
+typedef struct PD_UFP_i2c_txn_t PD_UFP_i2c_txn_t;
+/* Called once the transaction is complete, from the transport context (ISR with ESP-IDF) */
+typedef void (*PD_UFP_i2c_done_t)(PD_UFP_i2c_txn_t * txn);
+
+struct PD_UFP_i2c_txn_t {
+    uint8_t dev_addr;
+    uint8_t read;                   /* 1: read count bytes from the register into data */
+    uint8_t count;
+    uint8_t * data;                 /* Read destination, write data is copied into buffer */
+    volatile FUSB302_ret_t ret;     /* FUSB302_BUSY until complete */
+    PD_UFP_i2c_done_t done;         /* Optional */
+    void * ctx;
+    uint8_t buffer[1 + PD_UFP_I2C_WRITE_MAX];  /* Register address, then write data */
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_c
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class PD_UFP_I2C_c
+{
+    public:
+        PD_UFP_I2C_c();
+        virtual ~PD_UFP_I2C_c() {}
+        // Fill a transaction, write data is copied. FUSB302_ERR_PARAM if it does not fit
+        static FUSB302_ret_t prepare(PD_UFP_i2c_txn_t * txn, uint8_t dev_addr, uint8_t reg_addr, bool read,
+            uint8_t * data, uint8_t count);
+        // Queue a prepared transaction. The transaction must stay valid until complete
+        virtual FUSB302_ret_t submit(PD_UFP_i2c_txn_t * txn) = 0;
+        // Wait for the transaction to complete, return its result
+        virtual FUSB302_ret_t wait(PD_UFP_i2c_txn_t * txn) = 0;
+        // Used by PD_UFP_c: read waits, write is posted when the transport has a posted queue
+        FUSB302_ret_t read(uint8_t dev_addr, uint8_t reg_addr, uint8_t * data, uint8_t count);
+        FUSB302_ret_t write(uint8_t dev_addr, uint8_t reg_addr, const uint8_t * data, uint8_t count);
+        // Wait for every posted write, return the first error since the last call
+        FUSB302_ret_t flush(void);
+        // Free the bus after errors: posted writes are completed, a slave holding SDA is clocked
+        // out and the controller is set up again. FUSB302_BUSY if the bus is still held
+        virtual FUSB302_ret_t recover(void);
+
+    protected:
+        // Writes are posted into txn[size], called from the constructor of the transport
+        void posted_init(PD_UFP_i2c_txn_t * txn, uint8_t size);
+        FUSB302_ret_t posted_error_take(void);
+        static void posted_done(PD_UFP_i2c_txn_t * txn);
+        // Set the result and call done(), from submit() or the completion context
+        static void complete(PD_UFP_i2c_txn_t * txn, FUSB302_ret_t ret);
+        PD_UFP_i2c_txn_t * posted;
+        uint8_t posted_size;
+        uint8_t posted_next;
+        volatile FUSB302_ret_t posted_error;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_Wire_c, Arduino Wire
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define PD_UFP_I2C_CLEAR_US     5       /* Half SCL period of the bus clear, 100kHz */
+
+class PD_UFP_I2C_Wire_c : public PD_UFP_I2C_c
+{
+    public:
+        // With the SDA and SCL pins recover() clocks out a held bus, without it only restarts the
+        // port (on ESP32 on the default pins of the board). frequency is set again after a
+        // recovery, 0 for the clock in use before it on ESP32, the Wire default elsewhere
+        PD_UFP_I2C_Wire_c(TwoWire & wire = Wire, int sda = -1, int scl = -1, uint32_t frequency = 0);
+        virtual FUSB302_ret_t submit(PD_UFP_i2c_txn_t * txn);
+        virtual FUSB302_ret_t wait(PD_UFP_i2c_txn_t * txn) { return txn->ret; }
+        virtual FUSB302_ret_t recover(void);
+
+    protected:
+        bool bus_clear(void);
+        TwoWire * wire;
+        int sda;
+        int scl;
+        uint32_t frequency;
+};
+
+#ifdef PD_UFP_I2C_IDF
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PD_UFP_I2C_IDF_c, ESP-IDF i2c_master, asynchronous
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define PD_UFP_I2C_IDF_QUEUE    (PD_UFP_I2C_POSTED + 2)     /* trans_queue_depth of the bus at least this */
+
+class PD_UFP_I2C_IDF_c : public PD_UFP_I2C_c
+{
+    public:
+        PD_UFP_I2C_IDF_c(i2c_master_bus_handle_t bus, uint32_t scl_speed_hz = 400000);
+        virtual ~PD_UFP_I2C_IDF_c();
+        virtual FUSB302_ret_t submit(PD_UFP_i2c_txn_t * txn);
+        virtual FUSB302_ret_t wait(PD_UFP_i2c_txn_t * txn);
+        virtual FUSB302_ret_t recover(void);
+
+    protected:
+        static bool trans_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t * event, void * arg);
+        FUSB302_ret_t device(uint8_t dev_addr);
+        i2c_master_bus_handle_t bus;
+        i2c_master_dev_handle_t dev;
+        uint8_t dev_addr;
+        uint32_t scl_speed_hz;
+        SemaphoreHandle_t done_sem;     /* Given on every completion */
+        /* In flight, in driver order */
+        portMUX_TYPE queue_lock;
+        PD_UFP_i2c_txn_t * queue[PD_UFP_I2C_IDF_QUEUE];
+        volatile uint8_t queue_head;
+        volatile uint8_t queue_count;
+        PD_UFP_i2c_txn_t posted_txn[PD_UFP_I2C_POSTED];
+};
+#endif
+
+#endif
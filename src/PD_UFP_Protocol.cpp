@@ -11,7 +11,8 @@
  * No use of bit-field for better cross-platform compatibility
  *
  * Support PD3.0 PPS
- * Do not support extended message. Not necessary for PD trigger and PPS.
+ * Extended messages are chunked, received chunks are reassembled in a fixed size buffer and
+ * larger messages are dropped. Unchunked extended messages are not supported (FUSB302 FIFO).
  * 
  * Reference: USB_PD_R2_0 V1.3 - 20170112
  *            USB_PD_R3_0 V2.0 20190829 + ECNs 2020-12-10
@@ -27,15 +28,25 @@
 #define PD_CONTROL_MSG_TYPE_ACCEPT          0x3
 #define PD_CONTROL_MSG_TYPE_REJECT          0x4
 #define PD_CONTROL_MSG_TYPE_GET_SRC_CAP     0x7
+#define PD_CONTROL_MSG_TYPE_SOFT_RESET      0xD
 #define PD_CONTROL_MSG_TYPE_NOT_SUPPORT     0x10
+#define PD_CONTROL_MSG_TYPE_GET_SRC_CAP_EXT 0x11
+#define PD_CONTROL_MSG_TYPE_GET_STATUS      0x12
 #define PD_CONTROL_MSG_TYPE_GET_PPS_STATUS  0x14
 
 #define PD_DATA_MSG_TYPE_REQUEST            0x2
 #define PD_DATA_MSG_TYPE_SINK_CAP           0x4
 #define PD_DATA_MSG_TYPE_VENDOR_DEFINED     0xF
 
+#define PD_EXT_MSG_TYPE_GET_MFG_INFO        0x6
 #define PD_EXT_MSG_TYPE_SINK_CAP_EXT        0xF
 
+/* Reference: 6.2.1.2 Extended Message Header */
+#define EXT_HEADER_DATA_SIZE_MASK           0x1FF
+#define EXT_HEADER_REQUEST_CHUNK            (1 << 10)
+#define EXT_HEADER_CHUNK_NUMBER(n)          ((uint16_t)(n) << 11)
+#define EXT_HEADER_CHUNKED                  (1 << 15)
+
 typedef struct {
     uint8_t type;
     uint8_t spec_rev;
@@ -61,11 +72,13 @@ struct PD_msg_state_t {
 #define SET_MSG_STAGE(d, s) do { static struct PD_msg_state_t m; memcpy_P(&m, s, sizeof(struct PD_msg_state_t)); d = &m; } while (0)
 #define SET_MSG_NAME(d, s)  do { static char n[16]; strncpy_P(n, s, 15); d = n; } while (0)
 #define COPY_PDO(d, s)      do { memcpy_P(&d, &s, 4); } while (0)
+#define COPY_DATA(d, s, n)  do { memcpy_P(d, s, n); } while (0)
 #else
 #define PROGMEM
 #define SET_MSG_STAGE(d, s) do { d = s; } while (0)
 #define SET_MSG_NAME(d, s)  do { d = s; } while (0)
 #define COPY_PDO(d, s)      do { d = s; } while (0)
+#define COPY_DATA(d, s, n)  do { memcpy(d, s, n); } while (0)
 #endif
 
 #define T(name) static const char str_ ## name [] PROGMEM = #name
@@ -75,11 +88,15 @@ static void handler_goto_min   (PD_protocol_t * p, uint16_t header, uint32_t * o
 static void handler_accept     (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_reject     (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_ps_rdy     (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
+static void handler_soft_reset (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_source_cap (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_BIST       (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_alert      (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_vender_def (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 static void handler_PPS_Status (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
+static void handler_src_cap_ext(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
+static void handler_status     (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
+static void handler_mfg_info   (PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events);
 
 static bool responder_get_sink_cap  (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
 static bool responder_reject        (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
@@ -88,6 +105,7 @@ static bool responder_source_cap    (PD_protocol_t * p, uint16_t * header, uint3
 static bool responder_vender_def    (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
 static bool responder_sink_cap_ext  (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
 static bool responder_not_support   (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
+static bool responder_chunk         (PD_protocol_t * p, uint16_t * header, uint32_t * obj);
 
 T(C0); T(GoodCRC); T(GotoMin); T(Accept); T(Reject); T(Ping); T(PS_RDY); T(Get_Src_Cap);
 T(Get_Sink_Cap); T(DR_Swap); T(PR_Swap); T(VCONN_Swap); T(Wait); T(Soft_Rst); T(Dat_Rst); T(Dat_Rst_Cpt);
@@ -107,7 +125,7 @@ static const struct PD_msg_state_t ctrl_msg_list[] PROGMEM = {
     {.name = str_PR_Swap,       .handler = 0,                   .responder = responder_not_support},
     {.name = str_VCONN_Swap,    .handler = 0,                   .responder = responder_reject},
     {.name = str_Wait,          .handler = 0,                   .responder = 0},
-    {.name = str_Soft_Rst,      .handler = 0,                   .responder = responder_soft_reset},
+    {.name = str_Soft_Rst,      .handler = handler_soft_reset,  .responder = responder_soft_reset},
     {.name = str_Dat_Rst,       .handler = 0,                   .responder = 0},
     {.name = str_Dat_Rst_Cpt,   .handler = 0,                   .responder = 0},
     
@@ -152,13 +170,13 @@ T(E_R);
 
 static const struct PD_msg_state_t ext_msg_list[] PROGMEM = {
     {.name = str_E0,            .handler = 0,                   .responder = responder_not_support},
-    {.name = str_Src_Cap_Ext,   .handler = 0,                   .responder = 0},
-    {.name = str_Status,        .handler = 0,                   .responder = 0},
+    {.name = str_Src_Cap_Ext,   .handler = handler_src_cap_ext, .responder = 0},
+    {.name = str_Status,        .handler = handler_status,      .responder = 0},
     {.name = str_Get_Bat_cap,   .handler = 0,                   .responder = responder_not_support},
     {.name = str_Get_Bat_Stat,  .handler = 0,                   .responder = responder_not_support},
     {.name = str_Bat_Cap,       .handler = 0,                   .responder = 0},
     {.name = str_Get_Mfg_Info,  .handler = 0,                   .responder = responder_not_support},
-    {.name = str_Mfg_Info,      .handler = 0,                   .responder = 0},
+    {.name = str_Mfg_Info,      .handler = handler_mfg_info,    .responder = 0},
     {.name = str_Sec_Request,   .handler = 0,                   .responder = responder_not_support},
     {.name = str_Sec_Response,  .handler = 0,                   .responder = 0},
     {.name = str_FU_request,    .handler = 0,                   .responder = responder_not_support},
@@ -171,6 +189,12 @@ static const struct PD_msg_state_t ext_msg_list[] PROGMEM = {
     {.name = str_E_R,           .handler = 0,                   .responder = responder_not_support},
 };
 
+T(Chunk);
+
+/* Chunk of an extended message that is not complete yet, or a Chunk Request */
+static const struct PD_msg_state_t ext_chunk_state PROGMEM =
+    {.name = str_Chunk,         .handler = 0,                   .responder = responder_chunk};
+
 static const PD_power_option_setting_t power_option_setting[8] = {
     {.limit = 25,   .use_voltage = 1, .use_current = 0},    /* PD_POWER_OPTION_MAX_5V */
     {.limit = 45,   .use_voltage = 1, .use_current = 0},    /* PD_POWER_OPTION_MAX_9V */
@@ -236,22 +260,141 @@ static uint16_t generate_header(PD_protocol_t * p, uint8_t type, uint8_t obj_cou
     return h;
 }
 
-static uint16_t generate_header_ext(PD_protocol_t * p, uint8_t type, uint8_t data_size, uint32_t * obj)
+static inline uint8_t obj_byte(const uint32_t * obj, uint8_t i)
+{
+    return (obj[i >> 2] >> ((i & 3) * 8)) & 0xFF;
+}
+
+/* FNV-1a of the power data objects, never 0 (free cache entry) */
+static uint32_t src_cap_id(PD_protocol_t * p)
+{
+    uint32_t h = 2166136261UL;
+    for (uint8_t i = 0; i < p->power_data_obj_count * 4; i++) {
+        h = (h ^ obj_byte(p->power_data_obj, i)) * 16777619UL;
+    }
+    return h ? h : 1;
+}
+
+/* Selection for the present power data objects, from the cache if the source is in it with the
+   same setting, else evaluated and cached. The source moves to entry 0, a new one takes a free
+   entry or the least recent one */
+static uint8_t src_cache_select(PD_protocol_t * p)
+{
+    PD_src_cache_t * c = p->src_cache;
+    PD_src_cache_entry_t e;
+    uint32_t id;
+    uint8_t n;
+    p->src_cap_cached = 0;
+    if (c == 0) {
+        return evaluate_src_cap(p, p->PPS_voltage, p->PPS_current);
+    }
+    id = src_cap_id(p);
+    for (n = 0; n < PD_SRC_CACHE_SIZE - 1 && c->entry[n].id != id && c->entry[n].id; n++) {}
+    e = c->entry[n];
+    if (e.id == id && e.power_option == p->power_option && e.PPS_voltage == p->PPS_voltage &&
+        e.PPS_current == p->PPS_current && e.selected < p->power_data_obj_count) {
+        e.hits++;
+        p->src_cap_cached = 1;
+    } else {
+        if (e.id != id) {
+            memset(&e, 0, sizeof(e));
+            e.id = id;
+        }
+        e.power_option = p->power_option;
+        e.PPS_voltage = p->PPS_voltage;
+        e.PPS_current = p->PPS_current;
+        e.selected = evaluate_src_cap(p, p->PPS_voltage, p->PPS_current);
+    }
+    memmove(&c->entry[1], &c->entry[0], n * sizeof(PD_src_cache_entry_t));
+    c->entry[0] = e;
+    return e.selected;
+}
+
+static uint16_t generate_header_ext(PD_protocol_t * p, uint8_t type, uint16_t ext_header, uint8_t chunk_size, uint32_t * obj)
 {
-    uint16_t h = generate_header(p, type, (data_size + 5) >> 2); /* set obj_count to fit ext header and data */
+    uint16_t h = generate_header(p, type, (chunk_size + 5) >> 2); /* set obj_count to fit ext header and chunk */
     h |= (uint16_t)1 << 15;     /* Set extended field */
-    /* Reference: 6.2.1.2 Extended Message Headerr */ 
-    obj[0] |= ((uint16_t)data_size << 0) |  /*   8...0  ata Size */
-              /* Assume short message, set Chunk Number and Request Chunk to 0 */
-              ((uint16_t)1 << 15);          /*      15  Chunked */
+    /* Reference: 6.2.1.2 Extended Message Header, in the first 2 bytes of the data objects */
+    obj[0] = (obj[0] & 0xFFFF0000) | ext_header;
     p->tx_msg_header = h;
     return h;
 }
 
-static void handler_good_crc(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+/* Reference: 6.12.2.1.2 Chunking, chunk of data into obj, the first one is chunk 0 */
+static uint16_t generate_chunk(PD_protocol_t * p, uint8_t type, const uint8_t * data, uint16_t data_size, uint8_t chunk, uint32_t * obj)
+{
+    uint16_t offset = (uint16_t)chunk * PD_PROTOCOL_EXT_CHUNK_SIZE;
+    uint8_t chunk_size = 0;
+    if (offset < data_size) {
+        chunk_size = data_size - offset < PD_PROTOCOL_EXT_CHUNK_SIZE ? data_size - offset : PD_PROTOCOL_EXT_CHUNK_SIZE;
+    }
+    memset(obj, 0, ((chunk_size + 5) >> 2) * sizeof(uint32_t));
+    for (uint8_t i = 0; i < chunk_size; i++) {
+        obj[(i + 2) >> 2] |= (uint32_t)data[offset + i] << (((i + 2) & 3) * 8);
+    }
+    return generate_header_ext(p, type, (data_size & EXT_HEADER_DATA_SIZE_MASK) |
+        EXT_HEADER_CHUNK_NUMBER(chunk) | EXT_HEADER_CHUNKED, chunk_size, obj);
+}
+
+/* Add a received chunk to ext_rx, return true once the message is complete */
+static bool ext_rx_chunk(PD_protocol_t * p, const PD_msg_header_info_t * h, const uint32_t * obj)
+{
+    PD_ext_rx_t * rx = &p->ext_rx;
+    uint16_t ext_header = obj[0] & 0xFFFF;
+    uint16_t data_size = ext_header & EXT_HEADER_DATA_SIZE_MASK;
+    uint8_t chunk = (ext_header >> 11) & 0xF;
+    uint16_t offset = (uint16_t)chunk * PD_PROTOCOL_EXT_CHUNK_SIZE;
+    uint8_t chunk_size;
+    if (h->num_of_obj == 0) {
+        rx->type = 0;
+        return false;
+    }
+    if (ext_header & EXT_HEADER_REQUEST_CHUNK) {
+        /* the partner asks for the next chunk of the message sent to it */
+        p->ext_tx_type = h->type;
+        p->ext_tx_chunk = chunk;
+        return false;
+    }
+    p->ext_tx_type = 0;
+    if (chunk == 0) {
+        rx->type = h->type;
+        rx->size = data_size;
+    } else if (h->type != rx->type || chunk != rx->chunk || data_size != rx->size) {
+        rx->type = 0;   /* out of sequence, the rest of the message is dropped */
+        return false;
+    }
+    if (offset >= data_size) {
+        rx->type = 0;   /* no data left for this chunk */
+        return false;
+    }
+    chunk_size = data_size - offset < PD_PROTOCOL_EXT_CHUNK_SIZE ? data_size - offset : PD_PROTOCOL_EXT_CHUNK_SIZE;
+    if (data_size > sizeof(rx->data) || chunk_size > h->num_of_obj * 4 - 2 ||
+        ((ext_header & EXT_HEADER_CHUNKED) == 0 && chunk_size < data_size)) {
+        /* larger than the buffer: no Chunk Request, the sender gives up after tChunkSenderRequest */
+        rx->type = 0;
+        return false;
+    }
+    for (uint8_t i = 0; i < chunk_size; i++) {
+        rx->data[offset + i] = obj_byte(obj, i + 2);
+    }
+    if (offset + chunk_size < data_size) {
+        rx->chunk = chunk + 1;  /* requested by responder_chunk() */
+        return false;
+    }
+    rx->type = 0;
+    return true;
+}
+
+/* Copy the reassembled message into a data block, the part not sent is zero */
+static void ext_rx_copy(PD_protocol_t * p, uint8_t * block, uint8_t size)
+{
+    uint8_t n = p->ext_rx.size < size ? p->ext_rx.size : size;
+    memcpy(block, p->ext_rx.data, n);
+    memset(block + n, 0, size - n);
+}
+
+static void message_id_inc(PD_protocol_t * p)
 {
-    /* Reference: 6.2.1.3 Message ID 
-       MessageIDCounter Shall be initialized to zero at power-on / reset, increment when receive GoodCRC Message */
     uint8_t message_id = p->message_id;
     if (++message_id > 7) {
         message_id = 0;
@@ -259,6 +402,13 @@ static void handler_good_crc(PD_protocol_t * p, uint16_t header, uint32_t * obj,
     p->message_id = message_id;
 }
 
+static void handler_good_crc(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+{
+    /* Reference: 6.2.1.3 Message ID 
+       MessageIDCounter Shall be initialized to zero at power-on / reset, increment when receive GoodCRC Message */
+    message_id_inc(p);
+}
+
 static void handler_goto_min(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
 {
     // Not implemented
@@ -285,6 +435,15 @@ static void handler_ps_rdy(PD_protocol_t * p, uint16_t header, uint32_t * obj, P
     }
 }
 
+static void handler_soft_reset(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+{
+    /* Reference: 6.8.1 Soft Reset and Protocol Error, MessageIDCounter is reset, Accept is sent with 0 */
+    p->message_id = 0;
+    if (events) {
+        *events |= PD_PROTOCOL_EVENT_SOFT_RESET;
+    }
+}
+
 static void handler_source_cap(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
 {
     PD_msg_header_info_t h;
@@ -293,7 +452,7 @@ static void handler_source_cap(PD_protocol_t * p, uint16_t header, uint32_t * ob
     for (uint8_t i = 0; i < h.num_of_obj; i++) {
         p->power_data_obj[i] = obj[i];
     }
-    p->power_data_obj_selected = evaluate_src_cap(p, p->PPS_voltage, p->PPS_current);
+    p->power_data_obj_selected = src_cache_select(p);
     if (events) {
         *events |= PD_PROTOCOL_EVENT_SRC_CAP;
     }
@@ -316,16 +475,41 @@ static void handler_vender_def(PD_protocol_t * p, uint16_t header, uint32_t * ob
 
 static void handler_PPS_Status(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
 {
-    /* Handle chunked Extended message,  Offset 2 byte for Extended Message Header */
-    p->PPSSDB[0] = (obj[0] >> 16) & 0xFF;
-    p->PPSSDB[1] = (obj[0] >> 24) & 0xFF;
-    p->PPSSDB[2] = (obj[1] >>  0) & 0xFF;
-    p->PPSSDB[3] = (obj[1] >>  8) & 0xFF;
+    ext_rx_copy(p, p->PPSSDB, sizeof(p->PPSSDB));
+    p->ext_received |= PD_PROTOCOL_EVENT_PPS_STATUS;
     if (events) {
         *events |= PD_PROTOCOL_EVENT_PPS_STATUS;
     }
 }
 
+static void handler_src_cap_ext(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+{
+    ext_rx_copy(p, p->SCEDB, sizeof(p->SCEDB));
+    p->ext_received |= PD_PROTOCOL_EVENT_SRC_CAP_EXT;
+    if (events) {
+        *events |= PD_PROTOCOL_EVENT_SRC_CAP_EXT;
+    }
+}
+
+static void handler_status(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+{
+    ext_rx_copy(p, p->SDB, sizeof(p->SDB));
+    p->ext_received |= PD_PROTOCOL_EVENT_STATUS;
+    if (events) {
+        *events |= PD_PROTOCOL_EVENT_STATUS;
+    }
+}
+
+static void handler_mfg_info(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
+{
+    ext_rx_copy(p, p->MIDB, sizeof(p->MIDB) - 1);
+    p->MIDB[sizeof(p->MIDB) - 1] = 0;
+    p->ext_received |= PD_PROTOCOL_EVENT_MFG_INFO;
+    if (events) {
+        *events |= PD_PROTOCOL_EVENT_MFG_INFO;
+    }
+}
+
 static bool responder_get_sink_cap(PD_protocol_t * p, uint16_t * header, uint32_t * obj)
 {
     /* Reference: 6.4.1.2.3 Sink Fixed Supply Power Data Object */
@@ -339,47 +523,83 @@ static bool responder_get_sink_cap(PD_protocol_t * p, uint16_t * header, uint32_
     return true;
 }
 
+/* Reference: 6.5.13 Sink_Capabilities_Extended Message 
+              6.12.3 Applicability of Extended Messages  (Normative; Shall be supported) */
+#define SINK_CAP_VID                0
+#define SINK_CAP_PID                0
+#define SINK_CAP_XID                0       /* If the vendor does not have an XID, then it Shall return zero */
+#define SINK_CAP_FW_Version         1
+#define SINK_CAP_HW_Version         1
+#define SINK_CAP_SKEDB_Version      1
+#define SINK_CAP_SINK_MODE          0x3     /* Bit 0: PPS charging supported, Bit 1: VBUS powered */
+#define SINK_CAP_SINK_MIN_PDP       5       /* Minimum     PD Power in Watt */
+#define SINK_CAP_SINK_OP_PDP        5       /* Operational PD Power in Watt */
+#define SINK_CAP_SINK_MAX_PDP       100     /* Maximum     PD Power in Watt */
+static const uint8_t SKEDB[21] PROGMEM = {
+    SINK_CAP_VID & 0xFF, SINK_CAP_VID >> 8,             /* Byte  0...1  VID */
+    SINK_CAP_PID & 0xFF, SINK_CAP_PID >> 8,             /* Byte  2...3  PID */
+    (SINK_CAP_XID >> 0) & 0xFF, (SINK_CAP_XID >> 8) & 0xFF,
+    (SINK_CAP_XID >> 16) & 0xFF, (SINK_CAP_XID >> 24) & 0xFF,  /* Byte  4...7  XID */
+    SINK_CAP_FW_Version,                                /* Byte      8  FW Version */
+    SINK_CAP_HW_Version,                                /* Byte      9  HW Version */
+    SINK_CAP_SKEDB_Version,                             /* Byte     10  SKEDB Version */
+    0,                                                  /* Byte     11  Load Step, not set */
+    0, 0,                                               /* Byte 12..13  Sink Load Characteristics, not set */
+    0,                                                  /* Byte     14  Compliance, not set */
+    0,                                                  /* Byte     15  Touch Temp, not set */
+    0,                                                  /* Byte     16  Battery Info, not set */
+    SINK_CAP_SINK_MODE,                                 /* Byte     17  Sink Modes */
+    SINK_CAP_SINK_MIN_PDP,                              /* Byte     18  Minimum PDP */
+    SINK_CAP_SINK_OP_PDP,                               /* Byte     19  Operational PDP */
+    SINK_CAP_SINK_MAX_PDP,                              /* Byte     20  Maximum PDP */
+};
+
+/* Data of an extended message sent by the sink, return its size */
+#define EXT_TX_DATA_SIZE    sizeof(SKEDB)   /* Largest message of ext_tx_data() */
+
+static uint8_t ext_tx_data(PD_protocol_t * p, uint8_t type, uint8_t * data)
+{
+    switch (type) {
+    case PD_EXT_MSG_TYPE_SINK_CAP_EXT:
+        COPY_DATA(data, SKEDB, sizeof(SKEDB));
+        return sizeof(SKEDB);
+    case PD_EXT_MSG_TYPE_GET_MFG_INFO:
+        /* Reference: 6.5.6 Get_Manufacturer_Info Message, Manufacturer Info Target 0: Port/Cable Plug */
+        data[0] = 0;    /* Manufacturer Info Target */
+        data[1] = 0;    /* Manufacturer Info Ref */
+        return 2;
+    }
+    return 0;
+}
+
 static bool responder_sink_cap_ext(PD_protocol_t * p, uint16_t * header, uint32_t * obj)
 {
-    /* Reference: 6.5.13 Sink_Capabilities_Extended Message 
-                  6.12.3 Applicability of Extended Messages  (Normative; Shall be supported) */
-    #define SINK_CAP_VID                0
-    #define SINK_CAP_PID                0
-    #define SINK_CAP_XID                0       /* If the vendor does not have an XID, then it Shall return zero */
-    #define SINK_CAP_FW_Version         1
-    #define SINK_CAP_HW_Version         1
-    #define SINK_CAP_SKEDB_Version      1
-    #define SINK_CAP_SINK_MODE          0x3     /* Bit 0: PPS charging supported, Bit 1: VBUS powered */
-    #define SINK_CAP_SINK_MIN_PDP       5       /* Minimum     PD Power in Watt */
-    #define SINK_CAP_SINK_OP_PDP        5       /* Operational PD Power in Watt */
-    #define SINK_CAP_SINK_MAX_PDP       100     /* Maximum     PD Power in Watt */
-    static const uint32_t SKEDB[6] PROGMEM = { /* 2-byte header + 21-byte data, chunked to 6 PDO */
-    /* PDO[0], data byte  0...1  */
-        /* 16-bit LSB is reserved for Extended Message Header */
-        ((uint32_t)SINK_CAP_VID << 16),             /* Byte  0...1  VID */
-    /* PDO[1], data byte  2...5  */
-        ((uint32_t)SINK_CAP_PID << 0) |             /* Byte  2...3  PID */
-        (((uint32_t)SINK_CAP_XID & 0xFF) << 16),    /* Byte  4...5  XID */
-    /* PDO[2], data byte  6...9  */
-        (((uint32_t)SINK_CAP_XID >> 16) << 0) |     /* Byte  6...7  XID */
-        ((uint32_t)SINK_CAP_FW_Version << 16) |     /* Byte      8  FW Version */
-        ((uint32_t)SINK_CAP_HW_Version << 24),      /* Byte      9  HW Version */
-    /* PDO[3], data byte 10...13 */
-        ((uint32_t)SINK_CAP_SKEDB_Version << 0),    /* Byte     10  SKEDB Version */
-        /* Not set Byte 11 Load Step, Byte 13..12 Sink Load Characteristics */
-    /* PDO[4], data byte 14...17 */
-        /* Not set Byte 14 Compliance, Byte 15 Touch Temp, Byte 16 Battery Info */
-        ((uint32_t)SINK_CAP_SINK_MODE << 24),       /* Byte     17  Sink Modes */
-    /* PDO[5], data byte 18...20 */
-        ((uint32_t)SINK_CAP_SINK_MIN_PDP << 0) |    /* Byte     18  Minimum PDP */
-        ((uint32_t)SINK_CAP_SINK_OP_PDP << 8) |     /* Byte     19  Operational PDP */
-        ((uint32_t)SINK_CAP_SINK_MAX_PDP << 16)     /* Byte     20  Maximum PDP */
-    };
-    uint8_t i;
-    for (i = 0; i < 6; i++) {
-        COPY_PDO(obj[i], SKEDB[i]);
-    }
-    *header = generate_header_ext(p, PD_EXT_MSG_TYPE_SINK_CAP_EXT, 21, obj);
+    uint8_t data[EXT_TX_DATA_SIZE];
+    uint8_t size = ext_tx_data(p, PD_EXT_MSG_TYPE_SINK_CAP_EXT, data);
+    *header = generate_chunk(p, PD_EXT_MSG_TYPE_SINK_CAP_EXT, data, size, 0, obj);
+    return true;
+}
+
+static bool responder_chunk(PD_protocol_t * p, uint16_t * header, uint32_t * obj)
+{
+    /* Reference: 6.12.2.1.2 Chunking */
+    if (p->ext_tx_type) {
+        /* Next chunk of the message sent by the sink */
+        uint8_t data[EXT_TX_DATA_SIZE];
+        uint8_t size = ext_tx_data(p, p->ext_tx_type, data);
+        uint8_t type = p->ext_tx_type;
+        p->ext_tx_type = 0;
+        if ((uint16_t)p->ext_tx_chunk * PD_PROTOCOL_EXT_CHUNK_SIZE < size) {
+            *header = generate_chunk(p, type, data, size, p->ext_tx_chunk, obj);
+            return true;
+        }
+    } else if (p->ext_rx.type) {
+        /* Chunk Request for the next chunk of the message being received */
+        obj[0] = EXT_HEADER_CHUNK_NUMBER(p->ext_rx.chunk) | EXT_HEADER_REQUEST_CHUNK | EXT_HEADER_CHUNKED;
+        *header = generate_header(p, p->ext_rx.type, 1) | ((uint16_t)1 << 15);
+        p->tx_msg_header = *header;
+        return true;
+    }
     return false;
 }
 
@@ -431,17 +651,22 @@ static bool responder_vender_def(PD_protocol_t * p, uint16_t * header, uint32_t
     return false;
 }
 
+/* Message types past the end of a list map to its last, reserved entry */
+#define EXT_MSG_LIMIT   (sizeof(ext_msg_list) / sizeof(ext_msg_list[0]) - 1)
+#define DATA_MSG_LIMIT  (sizeof(data_msg_list) / sizeof(data_msg_list[0]) - 1)
+#define CTRL_MSG_LIMIT  (sizeof(ctrl_msg_list) / sizeof(ctrl_msg_list[0]) - 1)
+
 void PD_protocol_handle_msg(PD_protocol_t * p, uint16_t header, uint32_t * obj, PD_protocol_event_t * events)
 {
-    #define EXT_MSG_LIMIT   (sizeof(ext_msg_list) / sizeof(ext_msg_list[0]) - 1)
-    #define DATA_MSG_LIMIT  (sizeof(data_msg_list) / sizeof(data_msg_list[0]) - 1)
-    #define CTRL_MSG_LIMIT  (sizeof(ctrl_msg_list) / sizeof(ctrl_msg_list[0]) - 1)
-
     const struct PD_msg_state_t * state;
     PD_msg_header_info_t h;
     parse_header(&h, header);
     p->rx_msg_header = header;
     if ((header >> 15) & 0x1) {
+        if (!ext_rx_chunk(p, &h, obj)) {
+            SET_MSG_STAGE(p->msg_state, &ext_chunk_state);
+            return;
+        }
         state = &ext_msg_list[h.type > EXT_MSG_LIMIT ? EXT_MSG_LIMIT : h.type];
     } else if (h.num_of_obj) {
         state = &data_msg_list[h.type > DATA_MSG_LIMIT ? DATA_MSG_LIMIT : h.type];
@@ -467,11 +692,35 @@ void PD_protocol_create_get_src_cap(PD_protocol_t * p, uint16_t * header)
     *header = generate_header(p, PD_CONTROL_MSG_TYPE_GET_SRC_CAP, 0);
 }
 
+void PD_protocol_create_soft_reset(PD_protocol_t * p, uint16_t * header)
+{
+    /* Reference: 6.8.1 Soft Reset and Protocol Error, MessageIDCounter is reset, sent with 0 */
+    p->message_id = 0;
+    *header = generate_header(p, PD_CONTROL_MSG_TYPE_SOFT_RESET, 0);
+}
+
 void PD_protocol_create_get_PPS_status(PD_protocol_t *p, uint16_t *header)
 {
     *header = generate_header(p, PD_CONTROL_MSG_TYPE_GET_PPS_STATUS, 0);
 }
 
+void PD_protocol_create_get_src_cap_ext(PD_protocol_t * p, uint16_t * header)
+{
+    *header = generate_header(p, PD_CONTROL_MSG_TYPE_GET_SRC_CAP_EXT, 0);
+}
+
+void PD_protocol_create_get_status(PD_protocol_t * p, uint16_t * header)
+{
+    *header = generate_header(p, PD_CONTROL_MSG_TYPE_GET_STATUS, 0);
+}
+
+void PD_protocol_create_get_mfg_info(PD_protocol_t * p, uint16_t * header, uint32_t * obj)
+{
+    uint8_t data[2];
+    uint8_t size = ext_tx_data(p, PD_EXT_MSG_TYPE_GET_MFG_INFO, data);
+    *header = generate_chunk(p, PD_EXT_MSG_TYPE_GET_MFG_INFO, data, size, 0, obj);
+}
+
 void PD_protocol_create_request(PD_protocol_t * p, uint16_t * header, uint32_t * obj)
 {
     responder_source_cap(p, header, obj);
@@ -525,8 +774,9 @@ bool PD_protocol_get_msg_info(uint16_t header, PD_msg_info_t * msg_info)
         const char * name;
         const struct PD_msg_state_t * state;
         uint8_t type = h.type;
-        SET_MSG_STAGE(state, header & 0x8000 ? &ext_msg_list[type] :
-                        h.num_of_obj ? &data_msg_list[type] : &ctrl_msg_list[type]);
+        SET_MSG_STAGE(state, header & 0x8000 ? &ext_msg_list[type > EXT_MSG_LIMIT ? EXT_MSG_LIMIT : type] :
+                        h.num_of_obj ? &data_msg_list[type > DATA_MSG_LIMIT ? DATA_MSG_LIMIT : type] :
+                        &ctrl_msg_list[type > CTRL_MSG_LIMIT ? CTRL_MSG_LIMIT : type]);
         SET_MSG_NAME(name, state->name);
         msg_info->name = name;
         msg_info->id = h.id;
@@ -540,7 +790,7 @@ bool PD_protocol_get_msg_info(uint16_t header, PD_msg_info_t * msg_info)
 
 bool PD_protocol_get_PPS_status(PD_protocol_t *p, PPS_status_t * PPS_status)
 {
-    if (p && PPS_status) {
+    if (p && PPS_status && (p->ext_received & PD_PROTOCOL_EVENT_PPS_STATUS)) {
         /* Reference: 6.5.10 PPS_Status Message */
         PPS_status->output_voltage = ((uint16_t)p->PPSSDB[1] << 8) | p->PPSSDB[0];
         PPS_status->output_current = p->PPSSDB[2];
@@ -551,6 +801,70 @@ bool PD_protocol_get_PPS_status(PD_protocol_t *p, PPS_status_t * PPS_status)
     return false;
 }
 
+static inline uint16_t block_u16(const uint8_t * b, uint8_t i)
+{
+    return ((uint16_t)b[i + 1] << 8) | b[i];
+}
+
+bool PD_protocol_get_src_cap_ext(PD_protocol_t * p, PD_src_cap_ext_t * src_cap_ext)
+{
+    if (p && src_cap_ext && (p->ext_received & PD_PROTOCOL_EVENT_SRC_CAP_EXT)) {
+        /* Reference: 6.5.1 Source_Capabilities_Extended Message */
+        const uint8_t * b = p->SCEDB;
+        src_cap_ext->VID = block_u16(b, 0);                 /* Byte  0...1  VID */
+        src_cap_ext->PID = block_u16(b, 2);                 /* Byte  2...3  PID */
+        src_cap_ext->XID = ((uint32_t)block_u16(b, 6) << 16) | block_u16(b, 4);  /* Byte  4...7  XID */
+        src_cap_ext->fw_version = b[8];                     /* Byte      8  FW Version */
+        src_cap_ext->hw_version = b[9];                     /* Byte      9  HW Version */
+        src_cap_ext->voltage_regulation = b[10];            /* Byte     10  Voltage Regulation */
+        src_cap_ext->holdup_time = b[11];                   /* Byte     11  Holdup Time */
+        src_cap_ext->compliance = b[12];                    /* Byte     12  Compliance */
+        src_cap_ext->touch_current = b[13];                 /* Byte     13  Touch Current */
+        for (uint8_t i = 0; i < 3; i++) {
+            /* Byte 14...19  Peak Current1..3, Table 6-47 Peak Current */
+            uint16_t peak = block_u16(b, 14 + i * 2);
+            src_cap_ext->peak_current[i].percent = (peak & 0x1F) * 10;             /* Bit  4...0  in 10% units */
+            src_cap_ext->peak_current[i].period_ms = ((peak >> 5) & 0x3F) * 20;    /* Bit 10...5  in 20ms units */
+            src_cap_ext->peak_current[i].duty_cycle = ((peak >> 11) & 0xF) * 5;    /* Bit 14...11 in 5% units */
+            src_cap_ext->peak_current[i].vbus_droop = peak >> 15;                  /* Bit 15 */
+        }
+        src_cap_ext->touch_temp = b[20];                    /* Byte     20  Touch Temp */
+        src_cap_ext->source_inputs = b[21];                 /* Byte     21  Source Inputs */
+        src_cap_ext->batteries = b[22];                     /* Byte     22  Number of Batteries/Battery Slots */
+        src_cap_ext->source_PDP = b[23];                    /* Byte     23  Source PDP */
+        return true;
+    }
+    return false;
+}
+
+bool PD_protocol_get_status(PD_protocol_t * p, PD_status_t * status)
+{
+    if (p && status && (p->ext_received & PD_PROTOCOL_EVENT_STATUS)) {
+        /* Reference: 6.5.2 Status Message */
+        const uint8_t * b = p->SDB;
+        status->internal_temp = b[0];                       /* Byte      0  Internal Temp */
+        status->present_input = b[1];                       /* Byte      1  Present Input */
+        status->present_battery_input = b[2];               /* Byte      2  Present Battery Input */
+        status->event_flags = b[3];                         /* Byte      3  Event Flags */
+        status->temperature_status = (PPS_PTF_t)((b[4] >> 1) & 0x3);   /* Byte 4  Temperature Status, Bit 1 ... 2 */
+        status->power_status = b[5];                        /* Byte      5  Power Status */
+        return true;
+    }
+    return false;
+}
+
+bool PD_protocol_get_mfg_info(PD_protocol_t * p, PD_mfg_info_t * mfg_info)
+{
+    if (p && mfg_info && (p->ext_received & PD_PROTOCOL_EVENT_MFG_INFO)) {
+        /* Reference: 6.5.7 Manufacturer_Info Message */
+        mfg_info->VID = block_u16(p->MIDB, 0);              /* Byte  0...1  VID */
+        mfg_info->PID = block_u16(p->MIDB, 2);              /* Byte  2...3  PID */
+        memcpy(mfg_info->name, &p->MIDB[4], sizeof(mfg_info->name));  /* Byte 4...25  Manufacturer String */
+        return true;
+    }
+    return false;
+}
+
 bool PD_protocol_set_power_option(PD_protocol_t * p, enum PD_power_option_t option)
 {
     p->power_option = option;
@@ -586,10 +900,60 @@ bool PD_protocol_set_PPS(PD_protocol_t * p, uint16_t PPS_voltage, uint8_t PPS_cu
     return false;
 }
 
+bool PD_protocol_check_PPS(PD_protocol_t * p, uint16_t PPS_voltage, uint8_t PPS_current)
+{
+    PD_power_info_t info;
+    uint8_t selected = evaluate_src_cap(p, PPS_voltage, PPS_current);
+    return PD_protocol_get_power_info(p, selected, &info) && info.type == PD_PDO_TYPE_AUGMENTED_PDO;
+}
+
+void PD_protocol_set_src_cache(PD_protocol_t * p, PD_src_cache_t * cache)
+{
+    if (cache && cache->magic != PD_SRC_CACHE_MAGIC) {
+        memset(cache, 0, sizeof(PD_src_cache_t));
+        cache->magic = PD_SRC_CACHE_MAGIC;
+    }
+    p->src_cache = cache;
+}
+
+PD_src_cache_entry_t * PD_protocol_get_src_cache_entry(PD_protocol_t * p)
+{
+    if (p->src_cache && p->power_data_obj_count && p->src_cache->entry[0].id == src_cap_id(p)) {
+        return &p->src_cache->entry[0];
+    }
+    return 0;
+}
+
+bool PD_protocol_src_cache_has(PD_protocol_t * p, uint8_t flags, uint8_t rp)
+{
+    for (uint8_t n = 0; p->src_cache && n < PD_SRC_CACHE_SIZE; n++) {
+        if (p->src_cache->entry[n].id && p->src_cache->entry[n].rp == rp && (p->src_cache->entry[n].flags & flags)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t PD_protocol_tx_header(PD_protocol_t * p, uint16_t header)
+{
+    /* Reference: 6.2.1.3 Message ID, the counter may have moved on since the message was created */
+    p->tx_msg_header = (header & ~((uint16_t)0x7 << 9)) | ((uint16_t)p->message_id << 9);
+    return p->tx_msg_header;
+}
+
+void PD_protocol_tx_failed(PD_protocol_t * p)
+{
+    /* Reference: 6.2.1.3 Message ID, a transmission error increments MessageIDCounter as GoodCRC does */
+    message_id_inc(p);
+}
+
 void PD_protocol_reset(PD_protocol_t * p)
 {
     p->msg_state = &ctrl_msg_list[0];
     p->message_id = 0;
+    p->ext_rx.type = 0;
+    p->ext_tx_type = 0;
+    p->ext_received = 0;
 }
 
 void PD_protocol_init(PD_protocol_t * p)
@@ -0,0 +1,203 @@
+/**
+ * PD_UFP_Trace.cpp
+ *
+ * Compact binary trace of the PD traffic seen by PD_UFP_c, see PD_UFP_Trace.h
+ *
+ */
+
+#include <string.h>
+#include "PD_UFP_Trace.h"
+
+static uint8_t record_size(uint8_t type, uint16_t header)
+{
+    switch (type) {
+    case PD_TRACE_CONFIG:       return 3 + 4;
+    case PD_TRACE_EVENT:        return 3 + 1;
+    case PD_TRACE_RX:
+    case PD_TRACE_TX:           return 3 + 2 + 4 * ((header >> 12) & 0x7);
+    case PD_TRACE_HARD_RESET:   return 3;
+    case PD_TRACE_TIMER:        return 3 + 1;
+    }
+    return 0;
+}
+
+static uint8_t ring_get(const PD_trace_t * t, uint16_t offset)
+{
+    return t->buffer[offset < t->size ? offset : offset - t->size];
+}
+
+static void ring_drop_oldest(PD_trace_t * t)
+{
+    uint16_t header = ring_get(t, t->tail + 3) | ((uint16_t)ring_get(t, t->tail + 4) << 8);
+    uint8_t n = record_size(ring_get(t, t->tail), header);
+    t->tail = (t->tail + n) % t->size;
+    t->used -= n;
+    t->dropped++;
+}
+
+static void ring_put(PD_trace_t * t, const uint8_t * record, uint8_t n)
+{
+    if (t == 0 || t->buffer == 0 || n > t->size) {
+        return;
+    }
+    while ((uint16_t)(t->size - t->used) < n) {
+        ring_drop_oldest(t);
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        t->buffer[t->head] = record[i];
+        t->head = t->head + 1 < t->size ? t->head + 1 : 0;
+    }
+    t->used += n;
+}
+
+static uint8_t put16(uint8_t * p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return 2;
+}
+
+static uint8_t put32(uint8_t * p, uint32_t v)
+{
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+    return 4;
+}
+
+static uint16_t get16(const uint8_t * p)
+{
+    return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t * p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint8_t record_begin(uint8_t * record, uint8_t type, uint16_t time)
+{
+    record[0] = type;
+    return 1 + put16(record + 1, time);
+}
+
+void PD_trace_init(PD_trace_t * t, uint8_t * buffer, uint16_t size)
+{
+    t->buffer = buffer;
+    t->size = size;
+    PD_trace_clear(t);
+}
+
+void PD_trace_clear(PD_trace_t * t)
+{
+    t->head = 0;
+    t->tail = 0;
+    t->used = 0;
+    t->dropped = 0;
+}
+
+void PD_trace_config(PD_trace_t * t, uint16_t time, uint8_t power_option, uint16_t PPS_voltage, uint8_t PPS_current)
+{
+    uint8_t record[PD_TRACE_MAX_RECORD_SIZE];
+    uint8_t n = record_begin(record, PD_TRACE_CONFIG, time);
+    record[n++] = power_option;
+    n += put16(record + n, PPS_voltage);
+    record[n++] = PPS_current;
+    ring_put(t, record, n);
+}
+
+void PD_trace_event(PD_trace_t * t, uint16_t time, uint8_t events)
+{
+    uint8_t record[PD_TRACE_MAX_RECORD_SIZE];
+    uint8_t n = record_begin(record, PD_TRACE_EVENT, time);
+    record[n++] = events;
+    ring_put(t, record, n);
+}
+
+void PD_trace_msg(PD_trace_t * t, uint16_t time, enum PD_trace_type_t type, uint16_t header, const uint32_t * obj)
+{
+    uint8_t record[PD_TRACE_MAX_RECORD_SIZE];
+    uint8_t num_of_obj = (header >> 12) & 0x7;
+    uint8_t n = record_begin(record, type, time);
+    n += put16(record + n, header);
+    for (uint8_t i = 0; i < num_of_obj; i++) {
+        n += put32(record + n, obj ? obj[i] : 0);
+    }
+    ring_put(t, record, n);
+}
+
+void PD_trace_hard_reset(PD_trace_t * t, uint16_t time)
+{
+    uint8_t record[PD_TRACE_MAX_RECORD_SIZE];
+    ring_put(t, record, record_begin(record, PD_TRACE_HARD_RESET, time));
+}
+
+void PD_trace_timer(PD_trace_t * t, uint16_t time, enum PD_trace_timer_t timer)
+{
+    uint8_t record[PD_TRACE_MAX_RECORD_SIZE];
+    uint8_t n = record_begin(record, PD_TRACE_TIMER, time);
+    record[n++] = timer;
+    ring_put(t, record, n);
+}
+
+uint16_t PD_trace_copy(const PD_trace_t * t, uint8_t * image, uint16_t maxlen)
+{
+    uint16_t size = PD_trace_image_size(t);
+    if (maxlen < size) {
+        return 0;
+    }
+    memcpy(image, "PDTR", 4);
+    image[4] = PD_TRACE_VERSION;
+    image[5] = 0;
+    put16(image + 6, t->dropped);
+    for (uint16_t i = 0; i < t->used; i++) {
+        image[PD_TRACE_IMAGE_HEADER_SIZE + i] = ring_get(t, t->tail + i);
+    }
+    return size;
+}
+
+bool PD_trace_next(const uint8_t * image, uint32_t size, uint32_t * offset, PD_trace_record_t * r)
+{
+    uint32_t i = *offset;
+    if (i == 0) {
+        if (size < PD_TRACE_IMAGE_HEADER_SIZE || memcmp(image, "PDTR", 4) != 0 ||
+            image[4] == 0 || image[4] > PD_TRACE_VERSION) {
+            return false;
+        }
+        i = PD_TRACE_IMAGE_HEADER_SIZE;
+    }
+    if (i + 3 > size) {
+        return false;
+    }
+    uint8_t type = image[i];
+    uint16_t header = i + 5 <= size ? get16(image + i + 3) : 0;
+    uint8_t n = record_size(type, header);
+    if (n == 0 || i + n > size) {
+        return false;
+    }
+    memset(r, 0, sizeof(PD_trace_record_t));
+    r->type = (enum PD_trace_type_t)type;
+    r->time = get16(image + i + 1);
+    switch (type) {
+    case PD_TRACE_CONFIG:
+        r->power_option = image[i + 3];
+        r->PPS_voltage = get16(image + i + 4);
+        r->PPS_current = image[i + 6];
+        break;
+    case PD_TRACE_EVENT:
+        r->events = image[i + 3];
+        break;
+    case PD_TRACE_TIMER:
+        r->timer = image[i + 3];
+        break;
+    case PD_TRACE_RX:
+    case PD_TRACE_TX:
+        r->header = header;
+        r->num_of_obj = (header >> 12) & 0x7;
+        for (uint8_t k = 0; k < r->num_of_obj; k++) {
+            r->obj[k] = get32(image + i + 5 + 4 * k);
+        }
+        break;
+    }
+    *offset = i + n;
+    return true;
+}